@@ -0,0 +1,472 @@
+#include "raylib.h"
+#include "raymath.h"
+#include "rods.h"
+#include "collision.h"
+#include "replay.h"
+#include "tap.h"
+#include "pool.h"
+#include <dirent.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Session analytics: scans the user*/rods_u*p*.tap and .tapb files under a directory,
+// replays their drags on the collision engine, one session per tile of the
+// worker pool, and writes a table of per-session metrics, tab separated,
+// followed by the totals. Runs without a window.
+//
+// Usage: haptic_rods_analytics [-j threads] [-o table.tsv] [directory]
+
+typedef struct SessionMetrics
+{
+  char *tapName;
+  int userId;
+  int problemId;
+  off_t size;
+  // False when the tap couldn't be read.
+  bool valid;
+  int nbRods;
+  int nbEvents;
+  // From the start of the session to the last release.
+  double solveTime;
+  // Travelled by the mouse while the button was down.
+  double pathLength;
+  int nbPickups;
+  int nbSpawns;
+  // Starts of the collisions of the dragged rods.
+  int nbCollisions;
+  // Between a release, or the start, and the next press.
+  double idleTime;
+} SessionMetrics;
+
+typedef struct SessionList
+{
+  int nbSessions;
+  int capacity;
+  SessionMetrics *sessions;
+} SessionList;
+
+void AddSession(SessionList *list, const char *tapName, int userId, int problemId, off_t size)
+{
+  if (list->nbSessions == list->capacity)
+  {
+    list->capacity = list->capacity == 0 ? 64 : 2 * list->capacity;
+    list->sessions = realloc(list->sessions, list->capacity * sizeof(SessionMetrics));
+  }
+  list->sessions[list->nbSessions] = (SessionMetrics){.tapName = strdup(tapName), .userId = userId,
+                                                      .problemId = problemId, .size = size, .valid = false};
+  list->nbSessions += 1;
+}
+
+// Whole names only: sscanf would also take user12.bak.
+bool MatchUserFolder(const char *name, int *userId)
+{
+  int end = 0;
+  return sscanf(name, "user%d%n", userId, &end) == 1 && name[end] == '\0';
+}
+
+// Text and binary taps alike.
+bool MatchTapName(const char *name, int *userId, int *problemId)
+{
+  int end = 0;
+  if (sscanf(name, "rods_u%dp%d.tap%n", userId, problemId, &end) != 2 || end == 0)
+  {
+    return false;
+  }
+  return name[end] == '\0' || strcmp(name + end, TAP_BINARY_EXTENSION + strlen(".tap")) == 0;
+}
+
+void ScanSessions(const char *rootName, SessionList *list)
+{
+  DIR *root = opendir(rootName);
+  if (root == NULL)
+  {
+    perror("Couldn't open the session tree");
+    return;
+  }
+  struct dirent *userEntry;
+  while ((userEntry = readdir(root)) != NULL)
+  {
+    int userId;
+    if (!MatchUserFolder(userEntry->d_name, &userId))
+    {
+      continue;
+    }
+    char folderName[512];
+    snprintf(folderName, sizeof(folderName), "%s/%s", rootName, userEntry->d_name);
+    DIR *folder = opendir(folderName);
+    if (folder == NULL)
+    {
+      continue;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(folder)) != NULL)
+    {
+      int tapUserId;
+      int problemId;
+      if (!MatchTapName(entry->d_name, &tapUserId, &problemId))
+      {
+        continue;
+      }
+      char tapName[1024];
+      snprintf(tapName, sizeof(tapName), "%s/%s", folderName, entry->d_name);
+      struct stat info;
+      if (stat(tapName, &info) == 0 && S_ISREG(info.st_mode))
+      {
+        AddSession(list, tapName, tapUserId, problemId, info.st_size);
+      }
+    }
+    closedir(folder);
+  }
+  closedir(root);
+}
+
+// Adds the rod to the world, growing the group as the app does, and picks it
+// up. Another rod may have been in the way: as in the app, the rod follows
+// the mouse from where it should have been, its top left left in spawnedAt.
+int SpawnSessionRod(CollisionWorld *world, int numericLength, Vector2 *spawnedAt)
+{
+  if (world->rodGroup->nbRods == world->rodGroup->capacity)
+  {
+    ResizeCollisionWorld(world, GrowRodGroup(world->rodGroup));
+  }
+  Rod rod = NewSpawnedRod(numericLength);
+  *spawnedAt = GetTopLeft(rod);
+  int rodIndex = AddRodToWorld(world, rod);
+  PickUpRod(world, rodIndex);
+  return rodIndex;
+}
+
+int CompareRodIndicesDown(const void *a, const void *b)
+{
+  return *(const int *)b - *(const int *)a;
+}
+
+// In free play, the dropped rods off the tablet are deleted. Removing the
+// highest indices first, the rods moved into the freed places are never
+// among those left to check.
+void DeleteRodsOffTablet(CollisionWorld *world, int *rods, int nbRods)
+{
+  Rectangle tablet = {0, 0, TABLET_LENGTH, TABLED_HEIGHT};
+  qsort(rods, nbRods, sizeof(int), CompareRodIndicesDown);
+  for (int i = 0; i < nbRods; i++)
+  {
+    if (!CheckCollisionRecs(world->rodGroup->rods[rods[i]].rect, tablet))
+    {
+      RemoveRodFromWorld(world, rods[i]);
+    }
+  }
+}
+
+// The name of the tap without its extension, which both formats of a session
+// share.
+size_t GetStemLength(const char *tapName)
+{
+  return strrchr(tapName, '.') - tapName;
+}
+
+bool HaveSameStem(const char *a, const char *b)
+{
+  size_t len = GetStemLength(a);
+  return GetStemLength(b) == len && strncmp(a, b, len) == 0;
+}
+
+// By stem, the binary tap first.
+int CompareSessionStems(const void *a, const void *b)
+{
+  const SessionMetrics *sa = a;
+  const SessionMetrics *sb = b;
+  size_t la = GetStemLength(sa->tapName);
+  size_t lb = GetStemLength(sb->tapName);
+  int order = strncmp(sa->tapName, sb->tapName, la < lb ? la : lb);
+  if (order != 0)
+  {
+    return order;
+  }
+  if (la != lb)
+  {
+    return la < lb ? -1 : 1;
+  }
+  return HasBinaryTapName(sb->tapName) - HasBinaryTapName(sa->tapName);
+}
+
+// A session converted with tapconv, or recorded in both formats, is analyzed
+// once, from its binary tap.
+void KeepOneTapPerSession(SessionList *list)
+{
+  qsort(list->sessions, list->nbSessions, sizeof(SessionMetrics), CompareSessionStems);
+  int nbKept = 0;
+  for (int i = 0; i < list->nbSessions; i++)
+  {
+    SessionMetrics *m = &list->sessions[i];
+    if (nbKept > 0 && HaveSameStem(list->sessions[nbKept - 1].tapName, m->tapName))
+    {
+      free(m->tapName);
+      continue;
+    }
+    list->sessions[nbKept] = *m;
+    nbKept += 1;
+  }
+  list->nbSessions = nbKept;
+}
+
+// Replays the drags of the session as the app does: a press picks the rod
+// under the mouse, or the train it belongs to, or spawns a rod in free play,
+// which then follows the mouse through the collision engine until the
+// release drops it.
+void AnalyzeSession(SessionMetrics *m)
+{
+  Replay *replay = LoadReplay(m->tapName);
+  if (replay == NULL || replay->rodGroup == NULL)
+  {
+    FreeReplay(replay);
+    return;
+  }
+  RodGroup *rodGroup = replay->rodGroup;
+  float width = TABLET_LENGTH;
+  float height = TABLED_HEIGHT;
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    width = fmaxf(width, GetRight(rodGroup->rods[i]));
+    height = fmaxf(height, GetBottom(rodGroup->rods[i]));
+  }
+  // The sessions are spread over the threads already. Spawns may move the
+  // group: from here on, it is reached through the world.
+  CollisionWorld *world = NewCollisionWorld(rodGroup, width, height, NULL);
+
+  m->valid = true;
+  m->nbRods = world->rodGroup->nbRods;
+  m->nbEvents = replay->nbEvents;
+  bool down = false;
+  bool train = false;
+  bool dragsTrain = false;
+  bool collided = false;
+  bool freePlay = false;
+  int nbDropped = 0;
+  int *dropped = NULL;
+  int spawnLength = 0;
+  int rodIndex = -1;
+  Vector2 offset = {0, 0};
+  Vector2 mouse = {0, 0};
+  float startTime = replay->nbEvents > 0 ? replay->events[0].time : 0;
+  float releaseTime = startTime;
+  ReplayEvent event;
+  while (NextReplayEvent(replay, &event))
+  {
+    switch (event.kind)
+    {
+    case MOVE_EVENT:
+      if (!down)
+      {
+        down = true;
+        m->idleTime += fmaxf(event.time - releaseTime, 0);
+        rodIndex = -1;
+        collided = false;
+        dragsTrain = false;
+        if (spawnLength > 0)
+        {
+          Vector2 spawnedAt;
+          m->nbSpawns += 1;
+          rodIndex = SpawnSessionRod(world, spawnLength, &spawnedAt);
+          offset = Vector2Subtract(spawnedAt, event.position);
+        }
+        else
+        {
+          rodIndex = PickRod(world, event.position);
+          if (rodIndex != -1)
+          {
+            m->nbPickups += 1;
+            dragsTrain = train && PickUpTrain(world, rodIndex) > 1;
+            if (!dragsTrain)
+            {
+              PickUpRod(world, rodIndex);
+            }
+            offset = Vector2Subtract(GetTopLeft(world->rodGroup->rods[rodIndex]), event.position);
+          }
+        }
+      }
+      else
+      {
+        m->pathLength += Vector2Distance(mouse, event.position);
+        if (rodIndex != -1)
+        {
+          Vector2 topLeft = Vector2Add(event.position, offset);
+          Rod target = NewRod(world->rodGroup->rods[rodIndex].numericLength, topLeft.x, topLeft.y);
+          bool collides = dragsTrain ? MoveTrain(world, rodIndex, target) : MoveRod(world, rodIndex, target);
+          m->nbCollisions += collides && !collided;
+          collided = collides;
+        }
+      }
+      mouse = event.position;
+      break;
+    case RELEASE_EVENT:
+      if (down)
+      {
+        if (rodIndex != -1)
+        {
+          // Removals forget the train, so the dropped rods are kept aside.
+          nbDropped = dragsTrain ? world->nbTrainRods : 1;
+          dropped = realloc(dropped, nbDropped * sizeof(int));
+          if (dragsTrain)
+          {
+            memcpy(dropped, world->trainRods, nbDropped * sizeof(int));
+          }
+          else
+          {
+            DropRod(world, rodIndex);
+            dropped[0] = rodIndex;
+          }
+          if (freePlay)
+          {
+            DeleteRodsOffTablet(world, dropped, nbDropped);
+          }
+        }
+        m->solveTime = event.time - startTime;
+        releaseTime = event.time;
+      }
+      down = false;
+      train = false;
+      spawnLength = 0;
+      break;
+    case TRAIN_EVENT:
+      train = true;
+      break;
+    case SPAWN_EVENT:
+      spawnLength = event.arg;
+      break;
+    case FREE_PLAY_EVENT:
+      freePlay = true;
+      break;
+    case RESOLVER_EVENT:
+      SetResolver(world, event.arg);
+      world->snapDistance = event.snapDistance;
+      break;
+    }
+  }
+  free(dropped);
+  replay->rodGroup = world->rodGroup;
+  FreeCollisionWorld(world);
+  FreeReplay(replay);
+}
+
+void AnalyzeSessionTile(void *context, int tile, int worker)
+{
+  SessionList *list = context;
+  (void)worker;
+  AnalyzeSession(&list->sessions[tile]);
+}
+
+// Largest first, so that no thread is left with a long session at the end.
+int CompareSessionSizes(const void *a, const void *b)
+{
+  const SessionMetrics *sa = a;
+  const SessionMetrics *sb = b;
+  return (sb->size > sa->size) - (sb->size < sa->size);
+}
+
+int CompareSessionIds(const void *a, const void *b)
+{
+  const SessionMetrics *sa = a;
+  const SessionMetrics *sb = b;
+  if (sa->userId != sb->userId)
+  {
+    return sa->userId - sb->userId;
+  }
+  if (sa->problemId != sb->problemId)
+  {
+    return sa->problemId - sb->problemId;
+  }
+  return strcmp(sa->tapName, sb->tapName);
+}
+
+void WriteSessionTable(SessionList *list, FILE *table)
+{
+  fprintf(table, "user\tproblem\trods\tevents\tsolve_s\tpath_px\tpickups\tspawns\tcollisions\tidle_s\ttap\n");
+  SessionMetrics total = {0};
+  int nbValid = 0;
+  for (int i = 0; i < list->nbSessions; i++)
+  {
+    SessionMetrics *m = &list->sessions[i];
+    if (!m->valid)
+    {
+      fprintf(stderr, "Tap %s skipped.\n", m->tapName);
+      continue;
+    }
+    fprintf(table, "%d\t%d\t%d\t%d\t%.3f\t%.1f\t%d\t%d\t%d\t%.3f\t%s\n", m->userId, m->problemId, m->nbRods,
+            m->nbEvents, m->solveTime, m->pathLength, m->nbPickups, m->nbSpawns, m->nbCollisions, m->idleTime,
+            m->tapName);
+    nbValid += 1;
+    total.nbRods += m->nbRods;
+    total.nbEvents += m->nbEvents;
+    total.solveTime += m->solveTime;
+    total.pathLength += m->pathLength;
+    total.nbPickups += m->nbPickups;
+    total.nbSpawns += m->nbSpawns;
+    total.nbCollisions += m->nbCollisions;
+    total.idleTime += m->idleTime;
+  }
+  fprintf(table, "all\tall\t%d\t%d\t%.3f\t%.1f\t%d\t%d\t%d\t%.3f\t%d sessions\n", total.nbRods, total.nbEvents,
+          total.solveTime, total.pathLength, total.nbPickups, total.nbSpawns, total.nbCollisions, total.idleTime,
+          nbValid);
+}
+
+int main(int argc, char **argv)
+{
+  int nbThreads = GetCoreCount();
+  const char *tableName = NULL;
+  int c;
+  while ((c = getopt(argc, argv, "j:o:")) != -1)
+  {
+    switch (c)
+    {
+    case 'j':
+      nbThreads = atoi(optarg);
+      break;
+    case 'o':
+      tableName = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-j threads] [-o table.tsv] [directory]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  const char *rootName = optind < argc ? argv[optind] : ".";
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  SessionList list = {0};
+  ScanSessions(rootName, &list);
+  KeepOneTapPerSession(&list);
+  qsort(list.sessions, list.nbSessions, sizeof(SessionMetrics), CompareSessionSizes);
+
+  WorkerPool *pool = NewWorkerPool(nbThreads > 1 ? nbThreads - 1 : 0);
+  RunTiles(pool, list.nbSessions, AnalyzeSessionTile, &list);
+  FreeWorkerPool(pool);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  qsort(list.sessions, list.nbSessions, sizeof(SessionMetrics), CompareSessionIds);
+  FILE *table = tableName != NULL ? fopen(tableName, "w") : stdout;
+  if (table == NULL)
+  {
+    fprintf(stderr, "Couldn't write the table to %s.\n", tableName);
+    return EXIT_FAILURE;
+  }
+  WriteSessionTable(&list, table);
+  if (table != stdout)
+  {
+    fclose(table);
+  }
+
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  fprintf(stderr, "%d sessions analyzed in %.3f s on %d threads\n", list.nbSessions, seconds, nbThreads);
+  for (int i = 0; i < list.nbSessions; i++)
+  {
+    free(list.sessions[i].tapName);
+  }
+  free(list.sessions);
+  return EXIT_SUCCESS;
+}
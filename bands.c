@@ -0,0 +1,344 @@
+#include "bands.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int GetBand(BandIndex *index, float top)
+{
+  float band = floorf(top / ROD_HEIGHT);
+  if (band < 0)
+  {
+    return 0;
+  }
+  return band >= index->nbBands ? index->nbBands - 1 : (int)band;
+}
+
+// First position of the band whose left is >= left.
+int LowerBound(RodBand *band, float left)
+{
+  int low = 0;
+  int high = band->nbRods;
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+    if (band->lefts[middle] < left)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// First position of the band whose left is > left.
+int UpperBound(RodBand *band, float left)
+{
+  int low = 0;
+  int high = band->nbRods;
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+    if (band->lefts[middle] <= left)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+void AddToBand(RodBand *band, float left, int rodIndex)
+{
+  if (band->nbRods == band->capacity)
+  {
+    band->capacity = band->capacity == 0 ? 8 : 2 * band->capacity;
+    band->lefts = realloc(band->lefts, band->capacity * sizeof(float));
+    band->rods = realloc(band->rods, band->capacity * sizeof(int));
+  }
+  int position = LowerBound(band, left);
+  memmove(&band->lefts[position + 1], &band->lefts[position], (band->nbRods - position) * sizeof(float));
+  memmove(&band->rods[position + 1], &band->rods[position], (band->nbRods - position) * sizeof(int));
+  band->lefts[position] = left;
+  band->rods[position] = rodIndex;
+  band->nbRods += 1;
+}
+
+void RemoveFromBand(RodBand *band, float left, int rodIndex)
+{
+  for (int position = LowerBound(band, left); position < band->nbRods; position++)
+  {
+    if (band->rods[position] == rodIndex)
+    {
+      band->nbRods -= 1;
+      memmove(&band->lefts[position], &band->lefts[position + 1], (band->nbRods - position) * sizeof(float));
+      memmove(&band->rods[position], &band->rods[position + 1], (band->nbRods - position) * sizeof(int));
+      return;
+    }
+  }
+}
+
+BandIndex *NewBandIndex(RodGroup *rodGroup, float height)
+{
+  BandIndex *index = malloc(sizeof(BandIndex));
+  index->rodGroup = rodGroup;
+  index->nbBands = ceilf(height / ROD_HEIGHT);
+  index->bands = calloc(index->nbBands, sizeof(RodBand));
+  index->bandOfRod = malloc(rodGroup->capacity * sizeof(int));
+  index->found = malloc(rodGroup->capacity * sizeof(int));
+  index->maxWidth = 0;
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    Rod rod = rodGroup->rods[i];
+    index->bandOfRod[i] = GetBand(index, GetTop(rod));
+    AddToBand(&index->bands[index->bandOfRod[i]], GetLeft(rod), i);
+    index->maxWidth = fmaxf(index->maxWidth, rod.rect.width);
+  }
+  return index;
+}
+
+void FreeBandIndex(BandIndex *index)
+{
+  if (index == NULL)
+  {
+    return;
+  }
+  for (int b = 0; b < index->nbBands; b++)
+  {
+    free(index->bands[b].lefts);
+    free(index->bands[b].rods);
+  }
+  free(index->bands);
+  free(index->bandOfRod);
+  free(index->found);
+  free(index);
+}
+
+// To call when the group was reallocated, to follow it and make room for
+// its new rods.
+void ResizeBandIndex(BandIndex *index, RodGroup *rodGroup)
+{
+  index->rodGroup = rodGroup;
+  index->bandOfRod = realloc(index->bandOfRod, rodGroup->capacity * sizeof(int));
+  index->found = realloc(index->found, rodGroup->capacity * sizeof(int));
+}
+
+// Position of the rod in its band.
+int FindInBand(RodBand *band, int rodIndex)
+{
+  for (int position = 0; position < band->nbRods; position++)
+  {
+    if (band->rods[position] == rodIndex)
+    {
+      return position;
+    }
+  }
+  return -1;
+}
+
+// The band keeps the left the rod had when it was inserted, which is how it
+// is found again here, before the new one is inserted.
+void MoveRodInBands(BandIndex *index, int rodIndex)
+{
+  RodBand *oldBand = &index->bands[index->bandOfRod[rodIndex]];
+  int position = FindInBand(oldBand, rodIndex);
+  if (position != -1)
+  {
+    RemoveFromBand(oldBand, oldBand->lefts[position], rodIndex);
+  }
+  AddRodToBands(index, rodIndex);
+}
+
+// For the rod appended to the group, and for a moved rod once taken out.
+void AddRodToBands(BandIndex *index, int rodIndex)
+{
+  Rod rod = index->rodGroup->rods[rodIndex];
+  index->bandOfRod[rodIndex] = GetBand(index, GetTop(rod));
+  AddToBand(&index->bands[index->bandOfRod[rodIndex]], GetLeft(rod), rodIndex);
+  index->maxWidth = fmaxf(index->maxWidth, rod.rect.width);
+}
+
+// To call before the rod is removed from the group: the last rod takes its
+// index.
+void RemoveRodFromBands(BandIndex *index, int rodIndex)
+{
+  RodBand *band = &index->bands[index->bandOfRod[rodIndex]];
+  RemoveFromBand(band, band->lefts[FindInBand(band, rodIndex)], rodIndex);
+  int lastRod = index->rodGroup->nbRods - 1;
+  if (rodIndex == lastRod)
+  {
+    return;
+  }
+  band = &index->bands[index->bandOfRod[lastRod]];
+  band->rods[FindInBand(band, lastRod)] = rodIndex;
+  index->bandOfRod[rodIndex] = index->bandOfRod[lastRod];
+}
+
+// Returns the rods strictly overlapping the area, in a buffer owned by the
+// index and valid until the next query.
+int QueryBands(BandIndex *index, Rectangle area, const int **rods)
+{
+  int nbFound = 0;
+  int firstBand = GetBand(index, area.y - ROD_HEIGHT);
+  int lastBand = GetBand(index, area.y + area.height);
+  for (int b = firstBand; b <= lastBand; b++)
+  {
+    RodBand *band = &index->bands[b];
+    for (int position = LowerBound(band, area.x - index->maxWidth);
+         position < band->nbRods && band->lefts[position] < area.x + area.width; position++)
+    {
+      int rodIndex = band->rods[position];
+      Rod rod = index->rodGroup->rods[rodIndex];
+      if (GetRight(rod) > area.x && GetTop(rod) < area.y + area.height && GetBottom(rod) > area.y)
+      {
+        index->found[nbFound] = rodIndex;
+        nbFound += 1;
+      }
+    }
+  }
+  *rods = index->found;
+  return nbFound;
+}
+
+bool OverlapVertically(Rod rod, Rectangle rect)
+{
+  return GetTop(rod) < rect.y + rect.height && GetBottom(rod) > rect.y;
+}
+
+// Largest right among the rods overlapping the rect vertically, -INFINITY
+// when there are none: a rect put past it is free.
+float GetRightmostBeside(BandIndex *index, Rectangle rect)
+{
+  float rightmost = -INFINITY;
+  int firstBand = GetBand(index, rect.y - ROD_HEIGHT);
+  int lastBand = GetBand(index, rect.y + rect.height);
+  for (int b = firstBand; b <= lastBand; b++)
+  {
+    RodBand *band = &index->bands[b];
+    for (int position = band->nbRods - 1; position >= 0 && band->lefts[position] > rightmost - index->maxWidth; position--)
+    {
+      Rod rod = index->rodGroup->rods[band->rods[position]];
+      if (OverlapVertically(rod, rect))
+      {
+        rightmost = fmaxf(rightmost, GetRight(rod));
+      }
+    }
+  }
+  return rightmost;
+}
+
+bool OverlapHorizontally(Rod rod, Rectangle rect)
+{
+  return GetLeft(rod) < rect.x + rect.width && GetRight(rod) > rect.x;
+}
+
+// Rod with the largest right <= rect's left among those beside it, or -1.
+int NearestLeft(BandIndex *index, Rectangle rect, int excludedRod)
+{
+  int nearest = -1;
+  float nearestRight = -INFINITY;
+  int firstBand = GetBand(index, rect.y - ROD_HEIGHT);
+  int lastBand = GetBand(index, rect.y + rect.height);
+  for (int b = firstBand; b <= lastBand; b++)
+  {
+    RodBand *band = &index->bands[b];
+    // A rod starting before nearestRight - maxWidth ends before nearestRight.
+    for (int position = UpperBound(band, rect.x) - 1;
+         position >= 0 && band->lefts[position] > nearestRight - index->maxWidth; position--)
+    {
+      int rodIndex = band->rods[position];
+      Rod rod = index->rodGroup->rods[rodIndex];
+      if (rodIndex != excludedRod && GetRight(rod) <= rect.x && GetRight(rod) > nearestRight && OverlapVertically(rod, rect))
+      {
+        nearest = rodIndex;
+        nearestRight = GetRight(rod);
+      }
+    }
+  }
+  return nearest;
+}
+
+// Rod with the smallest left >= rect's right among those beside it, or -1.
+int NearestRight(BandIndex *index, Rectangle rect, int excludedRod)
+{
+  int nearest = -1;
+  float nearestLeft = INFINITY;
+  int firstBand = GetBand(index, rect.y - ROD_HEIGHT);
+  int lastBand = GetBand(index, rect.y + rect.height);
+  for (int b = firstBand; b <= lastBand; b++)
+  {
+    RodBand *band = &index->bands[b];
+    for (int position = LowerBound(band, rect.x + rect.width);
+         position < band->nbRods && band->lefts[position] < nearestLeft; position++)
+    {
+      int rodIndex = band->rods[position];
+      Rod rod = index->rodGroup->rods[rodIndex];
+      if (rodIndex != excludedRod && OverlapVertically(rod, rect))
+      {
+        nearest = rodIndex;
+        nearestLeft = GetLeft(rod);
+      }
+    }
+  }
+  return nearest;
+}
+
+// Rod with the largest bottom <= rect's top among those above it, or -1.
+int NearestAbove(BandIndex *index, Rectangle rect, int excludedRod)
+{
+  int nearest = -1;
+  float nearestBottom = -INFINITY;
+  for (int b = GetBand(index, rect.y - ROD_HEIGHT); b >= 0; b--)
+  {
+    // Rods of band b end before the bottom of band b + 1.
+    if (b < index->nbBands - 1 && (b + 2) * ROD_HEIGHT <= nearestBottom)
+    {
+      break;
+    }
+    RodBand *band = &index->bands[b];
+    for (int position = LowerBound(band, rect.x - index->maxWidth);
+         position < band->nbRods && band->lefts[position] < rect.x + rect.width; position++)
+    {
+      int rodIndex = band->rods[position];
+      Rod rod = index->rodGroup->rods[rodIndex];
+      if (rodIndex != excludedRod && GetBottom(rod) <= rect.y && GetBottom(rod) > nearestBottom && OverlapHorizontally(rod, rect))
+      {
+        nearest = rodIndex;
+        nearestBottom = GetBottom(rod);
+      }
+    }
+  }
+  return nearest;
+}
+
+// Rod with the smallest top >= rect's bottom among those below it, or -1.
+int NearestBelow(BandIndex *index, Rectangle rect, int excludedRod)
+{
+  int nearest = -1;
+  float nearestTop = INFINITY;
+  for (int b = GetBand(index, rect.y + rect.height); b < index->nbBands; b++)
+  {
+    if (b > 0 && b * ROD_HEIGHT >= nearestTop)
+    {
+      break;
+    }
+    RodBand *band = &index->bands[b];
+    for (int position = LowerBound(band, rect.x - index->maxWidth);
+         position < band->nbRods && band->lefts[position] < rect.x + rect.width; position++)
+    {
+      int rodIndex = band->rods[position];
+      Rod rod = index->rodGroup->rods[rodIndex];
+      if (rodIndex != excludedRod && GetTop(rod) >= rect.y + rect.height && GetTop(rod) < nearestTop && OverlapHorizontally(rod, rect))
+      {
+        nearest = rodIndex;
+        nearestTop = GetTop(rod);
+      }
+    }
+  }
+  return nearest;
+}
@@ -0,0 +1,43 @@
+#ifndef BANDS_H
+#define BANDS_H
+
+#include "rods.h"
+
+// Rods of a band, sorted by their left.
+typedef struct RodBand
+{
+  int nbRods;
+  int capacity;
+  float *lefts;
+  int *rods;
+} RodBand;
+
+// Index exploiting that every rod is ROD_HEIGHT high: a rod whose top lies in
+// band b only overlaps bands b and b + 1, so vertical overlap is decided by at
+// most two bands. Within a band, since no rod is wider than maxWidth, the rods
+// overlapping [x, x + w) are those whose left lies in (x - maxWidth, x + w),
+// found by binary search. Rods above or below the index go to the border bands.
+typedef struct BandIndex
+{
+  RodGroup *rodGroup;
+  int nbBands;
+  RodBand *bands;
+  int *bandOfRod;
+  float maxWidth;
+  int *found;
+} BandIndex;
+
+BandIndex *NewBandIndex(RodGroup *rodGroup, float height);
+void FreeBandIndex(BandIndex *index);
+void ResizeBandIndex(BandIndex *index, RodGroup *rodGroup);
+void MoveRodInBands(BandIndex *index, int rodIndex);
+void AddRodToBands(BandIndex *index, int rodIndex);
+void RemoveRodFromBands(BandIndex *index, int rodIndex);
+int QueryBands(BandIndex *index, Rectangle area, const int **rods);
+float GetRightmostBeside(BandIndex *index, Rectangle rect);
+int NearestLeft(BandIndex *index, Rectangle rect, int excludedRod);
+int NearestRight(BandIndex *index, Rectangle rect, int excludedRod);
+int NearestAbove(BandIndex *index, Rectangle rect, int excludedRod);
+int NearestBelow(BandIndex *index, Rectangle rect, int excludedRod);
+
+#endif
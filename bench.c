@@ -0,0 +1,502 @@
+#include "raylib.h"
+#include "raymath.h"
+#include "rods.h"
+#include "collision.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Collision benchmark: generated layouts (random, packed, staircase) from 10
+// to 100k rods plus the .rods files given as arguments, one rod dragged along
+// synthetic paths with each resolver, then whole trains of touching rods, and
+// rods spawned and deleted as in free play. The large layouts are benched
+// again once stored in Z-order, and with more threads.
+// Runs without a window.
+
+const int BENCH_FRAMES = 4000;
+const int FRAMES_PER_DRAG = 100;
+const int BENCH_PICKS = 100000;
+const int BENCH_BUILDS = 10;
+const int BENCH_SPAWNS = 10000;
+const int BENCH_TESTS = 10000000;
+const float HOLE_PROBABILITY = 0.15;
+const float RANDOM_DENSITY = 0.4;
+// Rows per staircase, each one three units longer than the previous.
+const int STAIR_STEPS = 10;
+const int MAX_TRAIN_BENCH_RODS = 10000;
+// Below, the whole layout fits in the cache whatever the order.
+const int MIN_MORTON_BENCH_RODS = 10000;
+
+#ifdef BENCH_COUNT_ALLOCS
+// Linked with -Wl,--wrap so that the allocations made by the collision code
+// are counted too, from the worker threads as well.
+static long nbAllocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **ptr, size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+  __atomic_add_fetch(&nbAllocs, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  __atomic_add_fetch(&nbAllocs, 1, __ATOMIC_RELAXED);
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  __atomic_add_fetch(&nbAllocs, 1, __ATOMIC_RELAXED);
+  return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  __atomic_add_fetch(&nbAllocs, 1, __ATOMIC_RELAXED);
+  return __real_posix_memalign(ptr, alignment, size);
+}
+
+long CountAllocs(void)
+{
+  return nbAllocs;
+}
+#else
+long CountAllocs(void)
+{
+  return 0;
+}
+#endif
+
+typedef RodGroup *(*LayoutGenerator)(int nbRods, float *width, float *height);
+
+typedef enum DragPath
+{
+  // Random walk, mostly small steps with a few fast swipes.
+  WALK_PATH,
+  // Straight line at a steady speed, pushing through whatever is in the way.
+  SWEEP_PATH,
+  NB_PATHS,
+} DragPath;
+
+static const char *PATH_NAMES[NB_PATHS] = {"walk", "sweep"};
+
+float RandomFloat(void)
+{
+  return (float)rand() / RAND_MAX;
+}
+
+double Now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int CompareDoubles(const void *a, const void *b)
+{
+  double da = *(const double *)a;
+  double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+RodGroup *AllocRodGroup(int nbRods)
+{
+  RodGroup *rodGroup = malloc(sizeof(RodGroup) + nbRods * sizeof(Rod));
+  rodGroup->nbRods = 0;
+  rodGroup->capacity = nbRods;
+  return rodGroup;
+}
+
+void AddRod(RodGroup *rodGroup, int l, float x, float y)
+{
+  rodGroup->rods[rodGroup->nbRods] = NewRod(l, x, y);
+  rodGroup->nbRods += 1;
+}
+
+// Fills rows of rods of random lengths, end to end, the rows touching each other.
+RodGroup *NewPackedRodGroup(int nbRods, float *width, float *height)
+{
+  RodGroup *rodGroup = AllocRodGroup(nbRods);
+  int rowLength = 10 * (int)ceilf(sqrtf(nbRods));
+  float x = 0;
+  float y = 0;
+  while (rodGroup->nbRods < nbRods)
+  {
+    int l = 1 + rand() % 10;
+    if (x + l * UNIT_ROD_LENGTH > rowLength * UNIT_ROD_LENGTH)
+    {
+      x = 0;
+      y += ROD_HEIGHT;
+    }
+    if (RandomFloat() >= HOLE_PROBABILITY)
+    {
+      AddRod(rodGroup, l, x, y);
+    }
+    x += l * UNIT_ROD_LENGTH;
+  }
+  *width = rowLength * UNIT_ROD_LENGTH;
+  *height = y + ROD_HEIGHT;
+  return rodGroup;
+}
+
+// Rods thrown at random whole pixel positions in a square, the ones landing
+// on another rod being thrown again.
+RodGroup *NewRandomRodGroup(int nbRods, float *width, float *height)
+{
+  RodGroup *rodGroup = AllocRodGroup(nbRods);
+  float meanArea = 5.5 * UNIT_ROD_LENGTH * ROD_HEIGHT;
+  int side = sqrtf(nbRods * meanArea / RANDOM_DENSITY);
+  Bitboard *board = NewBitboard(0, 0, side, side, ROD_HEIGHT);
+  for (int attempt = 0; attempt < 20 * nbRods && rodGroup->nbRods < nbRods; attempt++)
+  {
+    int l = 1 + rand() % 10;
+    int x = rand() % (side - l * UNIT_ROD_LENGTH);
+    int y = rand() % (side - ROD_HEIGHT);
+    if (IsBitboardRectFree(board, x, y, l * UNIT_ROD_LENGTH, ROD_HEIGHT))
+    {
+      SetBitboardRect(board, x, y, l * UNIT_ROD_LENGTH, ROD_HEIGHT, true);
+      AddRod(rodGroup, l, x, y);
+    }
+  }
+  FreeBitboard(board);
+  *width = side;
+  *height = side;
+  return rodGroup;
+}
+
+// Staircases side by side: row j of a staircase is filled with rods of random
+// lengths up to 3 * (j + 1) units, so every row juts out of the one above.
+RodGroup *NewStaircaseRodGroup(int nbRods, float *width, float *height)
+{
+  RodGroup *rodGroup = AllocRodGroup(nbRods);
+  int stairLength = 3 * STAIR_STEPS + 1;
+  int stairsPerRow = (int)ceilf(sqrtf(nbRods / (1.5 * STAIR_STEPS)));
+  int stair = 0;
+  while (rodGroup->nbRods < nbRods)
+  {
+    float x0 = (stair % stairsPerRow) * stairLength * UNIT_ROD_LENGTH;
+    float y0 = (stair / stairsPerRow) * STAIR_STEPS * ROD_HEIGHT;
+    for (int j = 0; j < STAIR_STEPS && rodGroup->nbRods < nbRods; j++)
+    {
+      int filled = 0;
+      while (filled < 3 * (j + 1) && rodGroup->nbRods < nbRods)
+      {
+        int l = 1 + rand() % 10;
+        l = l > 3 * (j + 1) - filled ? 3 * (j + 1) - filled : l;
+        AddRod(rodGroup, l, x0 + filled * UNIT_ROD_LENGTH, y0 + j * ROD_HEIGHT);
+        filled += l;
+      }
+    }
+    stair += 1;
+  }
+  *width = stairsPerRow * stairLength * UNIT_ROD_LENGTH;
+  *height = (stair / stairsPerRow + 1) * STAIR_STEPS * ROD_HEIGHT;
+  return rodGroup;
+}
+
+// A spec as the application loads it, the tablet grown to fit every rod.
+RodGroup *LoadRodGroup(const char *fileName, float *width, float *height)
+{
+  RodGroup *rodGroup = NewRodGroup(fileName);
+  *width = 1000;
+  *height = 600;
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    *width = fmaxf(*width, GetRight(rodGroup->rods[i]));
+    *height = fmaxf(*height, GetBottom(rodGroup->rods[i]));
+  }
+  return rodGroup;
+}
+
+// Mean time of PickRod over random points of the layout.
+double BenchPick(RodGroup *rodGroup, float width, float height)
+{
+  CollisionWorld *world = NewCollisionWorld(rodGroup, width, height, NULL);
+  volatile int sink = 0;
+  double start = Now();
+  for (int i = 0; i < BENCH_PICKS; i++)
+  {
+    sink += PickRod(world, (Vector2){RandomFloat() * width, RandomFloat() * height});
+  }
+  double elapsed = Now() - start;
+  FreeCollisionWorld(world);
+  return elapsed / BENCH_PICKS;
+}
+
+// With trains, the rods touching the picked one are dragged along with it.
+void BenchDrag(const char *layoutName, RodGroup *layout, float width, float height, DragPath path, Resolver resolver,
+               bool trains, WorkerPool *pool)
+{
+  // Resolvers move the rods, every run starts from the same layout.
+  size_t size = sizeof(RodGroup) + layout->nbRods * sizeof(Rod);
+  RodGroup *rodGroup = malloc(size);
+  memcpy(rodGroup, layout, size);
+  CollisionWorld *world = NewCollisionWorld(rodGroup, width, height, pool);
+  SetResolver(world, resolver);
+  double *frameTimes = malloc(BENCH_FRAMES * sizeof(double));
+  int nbCollisions = 0;
+  long allocs = 0;
+  long nbTrainRods = 0;
+  int nbTrains = 0;
+  srand(0);
+
+  int selected = -1;
+  Vector2 mouse = {0, 0};
+  Vector2 offset = {0, 0};
+  Vector2 velocity = {0, 0};
+  for (int frame = 0; frame < BENCH_FRAMES; frame++)
+  {
+    if (frame % FRAMES_PER_DRAG == 0 || selected == -1)
+    {
+      mouse = (Vector2){RandomFloat() * width, RandomFloat() * height};
+      selected = PickRod(world, mouse);
+      if (selected != -1 && trains)
+      {
+        nbTrainRods += PickUpTrain(world, selected);
+        nbTrains += 1;
+      }
+      else if (selected != -1)
+      {
+        PickUpRod(world, selected);
+      }
+      if (selected != -1)
+      {
+        offset = Vector2Subtract(GetTopLeft(rodGroup->rods[selected]), mouse);
+      }
+      float angle = RandomFloat() * 2 * PI;
+      velocity = (Vector2){cosf(angle) * UNIT_ROD_LENGTH / 2., sinf(angle) * UNIT_ROD_LENGTH / 2.};
+    }
+    if (path == WALK_PATH)
+    {
+      float step = RandomFloat() < 0.1 ? 8 * UNIT_ROD_LENGTH : UNIT_ROD_LENGTH / 2.;
+      mouse.x += (RandomFloat() - 0.5) * 2 * step;
+      mouse.y += (RandomFloat() - 0.5) * 2 * step;
+    }
+    else
+    {
+      mouse = Vector2Add(mouse, velocity);
+    }
+    mouse.x = Clamp(mouse.x, 0, width);
+    mouse.y = Clamp(mouse.y, 0, height);
+
+    long allocsBefore = CountAllocs();
+    double start = Now();
+    if (selected != -1)
+    {
+      Vector2 topLeft = Vector2Add(mouse, offset);
+      Rod targetRod = NewRod(rodGroup->rods[selected].numericLength, topLeft.x, topLeft.y);
+      nbCollisions += trains ? MoveTrain(world, selected, targetRod) : MoveRod(world, selected, targetRod);
+    }
+    frameTimes[frame] = Now() - start;
+    allocs += CountAllocs() - allocsBefore;
+  }
+
+  double total = 0;
+  for (int frame = 0; frame < BENCH_FRAMES; frame++)
+  {
+    total += frameTimes[frame];
+  }
+  qsort(frameTimes, BENCH_FRAMES, sizeof(double), CompareDoubles);
+  printf("%-12s %7d rods  %-5s %-8s %9.0f ns/resolve  p99 %9.0f ns  max %9.0f ns  %5.1f%% colliding  %6.3f allocs/frame  ",
+         layoutName, rodGroup->nbRods, PATH_NAMES[path], trains ? "train" : GetResolverName(resolver), total / BENCH_FRAMES,
+         frameTimes[BENCH_FRAMES * 99 / 100], frameTimes[BENCH_FRAMES - 1], 100. * nbCollisions / BENCH_FRAMES,
+         (double)allocs / BENCH_FRAMES);
+  if (trains)
+  {
+    printf("%5.1f rods/train\n", nbTrains == 0 ? 0 : (double)nbTrainRods / nbTrains);
+  }
+  else
+  {
+    printf("%5.1f%% warm\n", 100. * GetWarmHitRate(world));
+  }
+
+  free(frameTimes);
+  FreeCollisionWorld(world);
+  free(rodGroup);
+}
+
+// Free play: a random rod deleted, then a rod of the same length spawned in
+// its place, over and over. The group starts full, so it grows on the first
+// spawn. A deletion that splits a component of the contact graph searches
+// and renumbers its smaller side: rare among random rods, common in the
+// staircases, whose stairs hang from each other by a rod or two.
+void BenchSpawns(const char *layoutName, RodGroup *layout, float width, float height)
+{
+  size_t size = sizeof(RodGroup) + layout->nbRods * sizeof(Rod);
+  RodGroup *rodGroup = malloc(size);
+  memcpy(rodGroup, layout, size);
+  rodGroup->capacity = layout->nbRods;
+  CollisionWorld *world = NewCollisionWorld(rodGroup, width, height, NULL);
+  srand(0);
+  double spawnTime = 0;
+  double deleteTime = 0;
+  long allocs = CountAllocs();
+  for (int i = 0; i < BENCH_SPAWNS && rodGroup->nbRods > 0; i++)
+  {
+    int rodIndex = rand() % rodGroup->nbRods;
+    Rod rod = rodGroup->rods[rodIndex];
+    double start = Now();
+    RemoveRodFromWorld(world, rodIndex);
+    double middle = Now();
+    if (rodGroup->nbRods == rodGroup->capacity)
+    {
+      rodGroup = GrowRodGroup(rodGroup);
+      ResizeCollisionWorld(world, rodGroup);
+    }
+    AddRodToWorld(world, rod);
+    deleteTime += middle - start;
+    spawnTime += Now() - middle;
+  }
+  allocs = CountAllocs() - allocs;
+  printf("%-12s %7d rods  delete %9.0f ns  spawn %9.0f ns  %6.3f allocs/spawn\n", layoutName, layout->nbRods,
+         deleteTime / BENCH_SPAWNS, spawnTime / BENCH_SPAWNS, (double)allocs / BENCH_SPAWNS);
+  FreeCollisionWorld(world);
+  free(rodGroup);
+}
+
+void BenchLayout(const char *layoutName, RodGroup *layout, float width, float height)
+{
+  printf("%-12s %7d rods  pick %9.0f ns\n", layoutName, layout->nbRods, BenchPick(layout, width, height));
+  for (int path = 0; path < NB_PATHS; path++)
+  {
+    for (int resolver = 0; resolver < NB_RESOLVERS; resolver++)
+    {
+      BenchDrag(layoutName, layout, width, height, path, resolver, false, NULL);
+    }
+  }
+  // Trains move the same way whatever the resolver. In a packed layout the
+  // train is most of the layout, so the largest ones are left out.
+  if (layout->nbRods <= MAX_TRAIN_BENCH_RODS)
+  {
+    BenchDrag(layoutName, layout, width, height, WALK_PATH, CORNER_RESOLVER, true, NULL);
+  }
+  BenchSpawns(layoutName, layout, width, height);
+}
+
+// The same drags on a copy of the layout stored in Z-order, which the app
+// keeps its rods in.
+void BenchMortonOrder(const char *layoutName, RodGroup *layout, float width, float height)
+{
+  size_t size = sizeof(RodGroup) + layout->nbRods * sizeof(Rod);
+  RodGroup *sorted = malloc(size);
+  memcpy(sorted, layout, size);
+  int *order = malloc(layout->nbRods * sizeof(int));
+  SortRodGroupByMorton(sorted, order);
+  free(order);
+  char sortedName[32];
+  snprintf(sortedName, sizeof(sortedName), "%s-z", layoutName);
+  printf("%-12s %7d rods  pick %9.0f ns\n", sortedName, sorted->nbRods, BenchPick(sorted, width, height));
+  for (int resolver = 0; resolver < NB_RESOLVERS; resolver++)
+  {
+    BenchDrag(sortedName, sorted, width, height, WALK_PATH, resolver, false, NULL);
+  }
+  free(sorted);
+}
+
+// World builds and train drags with 1, 2, 4... threads, up to the cores.
+void BenchThreads(const char *layoutName, RodGroup *layout, float width, float height)
+{
+  for (int nbThreads = 1; nbThreads <= GetCoreCount(); nbThreads *= 2)
+  {
+    WorkerPool *pool = NewWorkerPool(nbThreads - 1);
+    double start = Now();
+    for (int i = 0; i < BENCH_BUILDS; i++)
+    {
+      FreeCollisionWorld(NewCollisionWorld(layout, width, height, pool));
+    }
+    char threadsName[32];
+    snprintf(threadsName, sizeof(threadsName), "%s x%d", layoutName, nbThreads);
+    printf("%-12s %7d rods  build %9.0f ns\n", threadsName, layout->nbRods, (Now() - start) / BENCH_BUILDS);
+    BenchDrag(threadsName, layout, width, height, WALK_PATH, CORNER_RESOLVER, true, pool);
+    FreeWorkerPool(pool);
+  }
+}
+
+// Raw throughput of the single tests the resolvers are built on: the scalar
+// CheckStrictCollision, the SIMD lanes, and the bitboard rect test.
+void BenchCollisionTests(void)
+{
+  float width, height;
+  srand(0);
+  RodGroup *rodGroup = NewRandomRodGroup(1024, &width, &height);
+  Rod *rods = rodGroup->rods;
+  int n = rodGroup->nbRods;
+  volatile int sink = 0;
+
+  double start = Now();
+  for (int i = 0; i < BENCH_TESTS; i++)
+  {
+    sink += CheckStrictCollision(rods[i % n], rods[(i + 1) % n], rods[(i * 7) % n]);
+  }
+  printf("CheckStrictCollision  %12.0f tests/s\n", BENCH_TESTS / (Now() - start) * 1e9);
+
+  RodSoA soa = NewRodSoA();
+  FillRodSoA(&soa, rodGroup, NULL, n, -1);
+  start = Now();
+  for (int i = 0; i < BENCH_TESTS / n; i++)
+  {
+    sink += StrictCollisionMask(&soa, rods[i % n].rect);
+  }
+  printf("StrictCollisionMask   %12.0f tests/s\n", (double)(BENCH_TESTS / n) * n / (Now() - start) * 1e9);
+  FreeRodSoA(&soa);
+
+  Bitboard *board = NewBitboard(0, 0, width, height, ROD_HEIGHT);
+  for (int i = 0; i < n; i++)
+  {
+    SetBitboardRect(board, rods[i].rect.x, rods[i].rect.y, rods[i].rect.width, rods[i].rect.height, true);
+  }
+  start = Now();
+  for (int i = 0; i < BENCH_TESTS; i++)
+  {
+    Rectangle rect = rods[i % n].rect;
+    sink += IsBitboardRectFree(board, rect.x + i % 7, rect.y + i % 5, rect.width, rect.height);
+  }
+  printf("IsBitboardRectFree    %12.0f tests/s\n", BENCH_TESTS / (Now() - start) * 1e9);
+  FreeBitboard(board);
+  free(rodGroup);
+}
+
+int main(int argc, char **argv)
+{
+  const char *layoutNames[] = {"random", "packed", "staircase"};
+  LayoutGenerator generators[] = {NewRandomRodGroup, NewPackedRodGroup, NewStaircaseRodGroup};
+  int sizes[] = {10, 100, 1000, 10000, 100000};
+
+#ifndef BENCH_COUNT_ALLOCS
+  printf("Allocations are not counted (build with -DBENCH_COUNT_ALLOCS and -Wl,--wrap).\n");
+#endif
+  BenchCollisionTests();
+  for (int i = 1; i < argc; i++)
+  {
+    float width, height;
+    RodGroup *layout = LoadRodGroup(argv[i], &width, &height);
+    BenchLayout(argv[i], layout, width, height);
+    free(layout);
+  }
+  for (int g = 0; g < (int)(sizeof(generators) / sizeof(generators[0])); g++)
+  {
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+    {
+      float width, height;
+      srand(sizes[i]);
+      RodGroup *layout = generators[g](sizes[i], &width, &height);
+      BenchLayout(layoutNames[g], layout, width, height);
+      if (sizes[i] >= MIN_MORTON_BENCH_RODS)
+      {
+        BenchMortonOrder(layoutNames[g], layout, width, height);
+      }
+      if (sizes[i] == MAX_TRAIN_BENCH_RODS)
+      {
+        BenchThreads(layoutNames[g], layout, width, height);
+      }
+      free(layout);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+#include "bitboard.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORD_BITS 64
+
+Bitboard *NewBitboard(int originX, int originY, int width, int height, int spanHeight)
+{
+  Bitboard *board = malloc(sizeof(Bitboard));
+  board->originX = originX;
+  board->originY = originY;
+  board->width = width;
+  board->height = height;
+  board->wordsPerRow = (width + WORD_BITS - 1) / WORD_BITS;
+  board->rows = calloc((size_t)board->wordsPerRow * height, sizeof(uint64_t));
+  board->spanHeight = spanHeight;
+  board->spans = calloc((size_t)board->wordsPerRow * height, sizeof(uint64_t));
+  board->blocked = malloc(board->wordsPerRow * sizeof(uint64_t));
+  board->starts = malloc(board->wordsPerRow * sizeof(uint64_t));
+  return board;
+}
+
+void FreeBitboard(Bitboard *board)
+{
+  if (board == NULL)
+  {
+    return;
+  }
+  free(board->rows);
+  free(board->spans);
+  free(board->blocked);
+  free(board->starts);
+  free(board);
+}
+
+uint64_t *GetRow(Bitboard *board, int y)
+{
+  return &board->rows[(size_t)y * board->wordsPerRow];
+}
+
+uint64_t *GetSpan(Bitboard *board, int y)
+{
+  return &board->spans[(size_t)y * board->wordsPerRow];
+}
+
+// Bits [first, last) of word w.
+uint64_t SpanMask(int w, int first, int last)
+{
+  int low = first - w * WORD_BITS;
+  int high = last - w * WORD_BITS;
+  uint64_t fromLow = low <= 0 ? ~0ull : ~0ull << low;
+  uint64_t belowHigh = high >= WORD_BITS ? ~0ull : (1ull << high) - 1;
+  return fromLow & belowHigh;
+}
+
+void SetBitboardRect(Bitboard *board, int x, int y, int width, int height, bool occupied)
+{
+  int first = x - board->originX;
+  int last = first + width;
+  first = first < 0 ? 0 : first;
+  last = last > board->width ? board->width : last;
+  int firstRow = y - board->originY;
+  int lastRow = firstRow + height;
+  firstRow = firstRow < 0 ? 0 : firstRow;
+  lastRow = lastRow > board->height ? board->height : lastRow;
+  if (first >= last || firstRow >= lastRow)
+  {
+    return;
+  }
+  int firstWord = first / WORD_BITS;
+  int lastWord = (last - 1) / WORD_BITS;
+  for (int row = firstRow; row < lastRow; row++)
+  {
+    uint64_t *words = GetRow(board, row);
+    for (int w = firstWord; w <= lastWord; w++)
+    {
+      if (occupied)
+      {
+        words[w] |= SpanMask(w, first, last);
+      }
+      else
+      {
+        words[w] &= ~SpanMask(w, first, last);
+      }
+    }
+  }
+
+  // Spans starting up to spanHeight - 1 rows above the rect see it. Setting
+  // only adds bits, clearing recomputes these spans over the rect's words.
+  int firstSpan = firstRow - board->spanHeight + 1 < 0 ? 0 : firstRow - board->spanHeight + 1;
+  for (int span = firstSpan; span < lastRow; span++)
+  {
+    uint64_t *words = GetSpan(board, span);
+    for (int w = firstWord; w <= lastWord; w++)
+    {
+      if (occupied)
+      {
+        words[w] |= SpanMask(w, first, last);
+      }
+      else
+      {
+        uint64_t bits = 0;
+        for (int row = span; row < span + board->spanHeight && row < board->height; row++)
+        {
+          bits |= GetRow(board, row)[w];
+        }
+        words[w] = bits;
+      }
+    }
+  }
+}
+
+bool IsBitboardRectFree(Bitboard *board, int x, int y, int width, int height)
+{
+  int first = x - board->originX;
+  int last = first + width;
+  int firstRow = y - board->originY;
+  if (first < 0 || last > board->width || firstRow < 0 || firstRow + height > board->height)
+  {
+    return false;
+  }
+  bool spanned = height == board->spanHeight;
+  for (int row = firstRow; row < (spanned ? firstRow + 1 : firstRow + height); row++)
+  {
+    uint64_t *words = spanned ? GetSpan(board, row) : GetRow(board, row);
+    for (int w = first / WORD_BITS; w <= (last - 1) / WORD_BITS; w++)
+    {
+      if (words[w] & SpanMask(w, first, last))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// starts[i] &= starts[i + shift], over the words [firstWord, lastWord]; bits
+// shifted in from past lastWord are 0.
+void AndShifted(uint64_t *starts, int firstWord, int lastWord, int shift)
+{
+  int wordShift = shift / WORD_BITS;
+  int bitShift = shift % WORD_BITS;
+  for (int w = firstWord; w <= lastWord; w++)
+  {
+    int source = w + wordShift;
+    uint64_t low = source <= lastWord ? starts[source] : 0;
+    uint64_t high = source + 1 <= lastWord ? starts[source + 1] : 0;
+    uint64_t shifted = bitShift == 0 ? low : (low >> bitShift) | (high << (WORD_BITS - bitShift));
+    starts[w] &= shifted;
+  }
+}
+
+// Nearest set bit of starts to bit x within [firstWord, lastWord], or -1.
+int NearestSetBit(uint64_t *starts, int firstWord, int lastWord, int x)
+{
+  int after = -1;
+  for (int w = x / WORD_BITS; w <= lastWord && after == -1; w++)
+  {
+    uint64_t word = w == x / WORD_BITS ? starts[w] & (~0ull << (x % WORD_BITS)) : starts[w];
+    if (word != 0)
+    {
+      after = w * WORD_BITS + __builtin_ctzll(word);
+    }
+  }
+  int before = -1;
+  for (int w = x / WORD_BITS; w >= firstWord && before == -1; w--)
+  {
+    uint64_t word = w == x / WORD_BITS ? starts[w] & ((1ull << (x % WORD_BITS)) - 1) : starts[w];
+    if (word != 0)
+    {
+      before = w * WORD_BITS + WORD_BITS - 1 - __builtin_clzll(word);
+    }
+  }
+  if (after == -1 || (before != -1 && x - before <= after - x))
+  {
+    return before;
+  }
+  return after;
+}
+
+// Finds the free position closest to the target, strictly closer than
+// sqrt(maxDistSqr). Rows are visited by increasing |dy|. For each one, the
+// rows the rect would cover are ORed together (or read from the spans), the
+// positions starting a free run of width pixels are found by log(width)
+// shift-ANDs, and the nearest one to the target is a bit scan. Only the words
+// within reach are looked at.
+bool NearestFreePosition(Bitboard *board, int targetX, int targetY, int width, int height, int maxDistSqr, int *x, int *y)
+{
+  int bx = targetX - board->originX;
+  int by = targetY - board->originY;
+  int bestDistSqr = maxDistSqr;
+  bool found = false;
+
+  for (int dy = 0; dy * dy < bestDistSqr; dy = dy > 0 ? -dy : -dy + 1)
+  {
+    int row = by + dy;
+    if (row < 0 || row + height > board->height)
+    {
+      continue;
+    }
+    int reach = ceil(sqrt(bestDistSqr - dy * dy));
+    int firstX = bx - reach < 0 ? 0 : bx - reach;
+    int lastX = bx + reach + width > board->width ? board->width : bx + reach + width;
+    if (firstX >= lastX)
+    {
+      continue;
+    }
+    int firstWord = firstX / WORD_BITS;
+    int lastWord = (lastX - 1) / WORD_BITS;
+
+    if (height == board->spanHeight)
+    {
+      memcpy(&board->blocked[firstWord], &GetSpan(board, row)[firstWord], (lastWord - firstWord + 1) * sizeof(uint64_t));
+    }
+    else
+    {
+      memset(&board->blocked[firstWord], 0, (lastWord - firstWord + 1) * sizeof(uint64_t));
+      for (int r = row; r < row + height; r++)
+      {
+        uint64_t *words = GetRow(board, r);
+        for (int w = firstWord; w <= lastWord; w++)
+        {
+          board->blocked[w] |= words[w];
+        }
+      }
+    }
+    for (int w = firstWord; w <= lastWord; w++)
+    {
+      board->starts[w] = ~board->blocked[w] & SpanMask(w, firstX, lastX);
+    }
+    for (int length = 1; length < width;)
+    {
+      int shift = length < width - length ? length : width - length;
+      AndShifted(board->starts, firstWord, lastWord, shift);
+      length += shift;
+    }
+
+    int clampedX = bx < firstX ? firstX : (bx >= lastX ? lastX - 1 : bx);
+    int freeX = NearestSetBit(board->starts, firstWord, lastWord, clampedX);
+    if (freeX == -1)
+    {
+      continue;
+    }
+    int distSqr = (freeX - bx) * (freeX - bx) + dy * dy;
+    if (distSqr < bestDistSqr)
+    {
+      bestDistSqr = distSqr;
+      *x = freeX + board->originX;
+      *y = row + board->originY;
+      found = true;
+    }
+  }
+  return found;
+}
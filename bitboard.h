@@ -0,0 +1,36 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Occupancy of the tablet at pixel resolution, one bitset per row: bit x of
+// row y is set when pixel (originX + x, originY + y) is covered by a rod.
+// Coordinates given to the functions are tablet pixels, and everything
+// outside the board counts as occupied.
+typedef struct Bitboard
+{
+  int originX;
+  int originY;
+  int width;
+  int height;
+  int wordsPerRow;
+  uint64_t *rows;
+  // Row y of spans is the OR of rows y to y + spanHeight - 1: the pixels a
+  // rect of that height would hit when its top is on row y.
+  int spanHeight;
+  uint64_t *spans;
+  // Two rows of scratch for the free space scans.
+  uint64_t *blocked;
+  uint64_t *starts;
+} Bitboard;
+
+Bitboard *NewBitboard(int originX, int originY, int width, int height, int spanHeight);
+void FreeBitboard(Bitboard *board);
+void SetBitboardRect(Bitboard *board, int x, int y, int width, int height, bool occupied);
+bool IsBitboardRectFree(Bitboard *board, int x, int y, int width, int height);
+uint64_t SpanMask(int w, int first, int last);
+int NearestSetBit(uint64_t *starts, int firstWord, int lastWord, int x);
+bool NearestFreePosition(Bitboard *board, int targetX, int targetY, int width, int height, int maxDistSqr, int *x, int *y);
+
+#endif
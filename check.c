@@ -0,0 +1,345 @@
+#include "raylib.h"
+#include "rods.h"
+#include "grid.h"
+#include "contacts.h"
+#include "tap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Self checks, run without a window:
+// - taps converted from text to binary and back come out byte for byte the
+//   same: a generated one, with negative zeros, and the .tap files given as
+//   arguments;
+// - the contact graph, through random moves, spawns and deletions, gives the
+//   components a brute-force search over every pair of rods finds.
+//
+// Usage: haptic_rods_check [tap...]
+
+const char CHECK_TAP[] = "check_rods.tap";
+const char CHECK_TAPB[] = "check_rods.tapb";
+const char CHECK_BACK_TAP[] = "check_rods_back.tap";
+const int CHECK_TAP_DRAGS = 200;
+const int CHECK_SEEDS = 20;
+const int CHECK_STEPS = 500;
+const int CHECK_MAX_RODS = 120;
+// Small enough for the rods to touch often, in units.
+const int CHECK_COLUMNS = 40;
+const int CHECK_ROWS = 16;
+
+float RandomUnits(int max)
+{
+  return (rand() % max) * UNIT_ROD_LENGTH;
+}
+
+// Converts the tap to the format of the output's name, record by record.
+long ConvertTap(const char *inputName, const char *outputName)
+{
+  TapReader *reader = OpenTapReader(inputName);
+  if (reader == NULL)
+  {
+    return -1;
+  }
+  TapWriter *writer = OpenTapWriter(outputName, HasBinaryTapName(outputName));
+  if (writer == NULL)
+  {
+    CloseTapReader(reader);
+    return -1;
+  }
+  long nbRecords = 0;
+  TapRecord record;
+  while (ReadTapRecord(reader, &record))
+  {
+    WriteTapRecord(writer, &record);
+    nbRecords += 1;
+  }
+  CloseTapReader(reader);
+  CloseTapWriter(writer);
+  return nbRecords;
+}
+
+bool HaveSameBytes(const char *nameA, const char *nameB)
+{
+  FILE *a = fopen(nameA, "rb");
+  FILE *b = fopen(nameB, "rb");
+  bool same = a != NULL && b != NULL;
+  while (same)
+  {
+    int c = fgetc(a);
+    same = c == fgetc(b);
+    if (c == EOF)
+    {
+      break;
+    }
+  }
+  if (a != NULL)
+  {
+    fclose(a);
+  }
+  if (b != NULL)
+  {
+    fclose(b);
+  }
+  return same;
+}
+
+bool CheckTapRoundTrip(const char *tapName)
+{
+  long nbRecords = ConvertTap(tapName, CHECK_TAPB);
+  bool same = nbRecords >= 0 && ConvertTap(CHECK_TAPB, CHECK_BACK_TAP) == nbRecords &&
+              HaveSameBytes(tapName, CHECK_BACK_TAP);
+  printf("%-40s %6ld records  %s\n", tapName, nbRecords, same ? "ok" : "FAILED");
+  remove(CHECK_TAPB);
+  remove(CHECK_BACK_TAP);
+  return same;
+}
+
+// A session of every kind of record, the mouse wandering around the origin
+// so that some coordinates are negative zeros.
+void WriteCheckTap(const char *tapName)
+{
+  RodGroup *rodGroup = malloc(sizeof(RodGroup) + CHECK_MAX_RODS * sizeof(Rod));
+  rodGroup->capacity = CHECK_MAX_RODS;
+  rodGroup->nbRods = 0;
+  for (int i = 0; i < CHECK_MAX_RODS; i++)
+  {
+    rodGroup->rods[i] = NewRod(1 + rand() % NB_RODS_MENU, RandomUnits(CHECK_COLUMNS) - 0.25f * (rand() % 3),
+                               RandomUnits(CHECK_ROWS) / 3.0f);
+    rodGroup->nbRods += 1;
+  }
+  TapWriter *writer = OpenTapWriter(tapName, false);
+  WriteTapDate(writer, 1700000000);
+  WriteTapResolver(writer, "corner", 7.5f);
+  WriteTapMark(writer, 'f');
+  WriteTapRods(writer, rodGroup);
+  float time = 0;
+  for (int d = 0; d < CHECK_TAP_DRAGS; d++)
+  {
+    if (d % 7 == 0)
+    {
+      WriteTapSpawn(writer, 1 + rand() % NB_RODS_MENU);
+    }
+    else if (d % 5 == 0)
+    {
+      WriteTapMark(writer, 'g');
+    }
+    int nbMoves = 1 + rand() % 20;
+    for (int m = 0; m < nbMoves; m++)
+    {
+      time += 0.025f;
+      float x = (rand() % 5 - 2) * (m % 3 == 0 ? 1e-9f : 1.5f);
+      float y = m % 4 == 0 ? -0.0f : (rand() % 2000 - 1000) / 7.0f;
+      WriteTapMove(writer, time, x, y);
+    }
+    time += 0.025f;
+    WriteTapRelease(writer, time);
+  }
+  CloseTapWriter(writer);
+  free(rodGroup);
+}
+
+// Labels the components by a search over the pairs of touching rods.
+int LabelComponents(RodGroup *rodGroup, int *labels, int *stack)
+{
+  int n = rodGroup->nbRods;
+  for (int i = 0; i < n; i++)
+  {
+    labels[i] = -1;
+  }
+  int nbLabels = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (labels[i] != -1)
+    {
+      continue;
+    }
+    labels[i] = nbLabels;
+    int nbStacked = 1;
+    stack[0] = i;
+    while (nbStacked > 0)
+    {
+      nbStacked -= 1;
+      int rodIndex = stack[nbStacked];
+      for (int j = 0; j < n; j++)
+      {
+        if (labels[j] == -1 && j != rodIndex && SoftlyCollide(rodGroup->rods[rodIndex], rodGroup->rods[j]))
+        {
+          labels[j] = nbLabels;
+          stack[nbStacked] = j;
+          nbStacked += 1;
+        }
+      }
+    }
+    nbLabels += 1;
+  }
+  return nbLabels;
+}
+
+// The graph agrees with the search when the rods of a label, and only they,
+// share a component, of the label's size and length, and each rod has as many
+// contacts as rods it touches.
+bool CheckComponents(ContactGraph *graph, int *labels, int *stack, int *roots, int *sizes, int *lengths)
+{
+  RodGroup *rodGroup = graph->rodGroup;
+  int n = rodGroup->nbRods;
+  int nbLabels = LabelComponents(rodGroup, labels, stack);
+  for (int l = 0; l < nbLabels; l++)
+  {
+    roots[l] = -1;
+    sizes[l] = 0;
+    lengths[l] = 0;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    int root = FindComponent(graph, i);
+    if (roots[labels[i]] == -1)
+    {
+      roots[labels[i]] = root;
+    }
+    if (roots[labels[i]] != root)
+    {
+      return false;
+    }
+    sizes[labels[i]] += 1;
+    lengths[labels[i]] += rodGroup->rods[i].numericLength;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    const int *rods;
+    int nbContacts = GetContacts(graph, i, &rods);
+    int nbTouching = 0;
+    for (int j = 0; j < n; j++)
+    {
+      nbTouching += j != i && SoftlyCollide(rodGroup->rods[i], rodGroup->rods[j]);
+    }
+    if (nbContacts != nbTouching || GetComponentSize(graph, i) != sizes[labels[i]] ||
+        GetComponentLength(graph, i) != lengths[labels[i]])
+    {
+      return false;
+    }
+  }
+  // Distinct labels on a shared root would be merged components.
+  for (int a = 0; a < nbLabels; a++)
+  {
+    for (int b = a + 1; b < nbLabels; b++)
+    {
+      if (roots[a] == roots[b])
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A rod put at random, or flush against another one so that components merge
+// and, moved again, split.
+Rod NewCheckRod(RodGroup *rodGroup, int numericLength)
+{
+  Rod rod = NewRod(numericLength, RandomUnits(CHECK_COLUMNS), RandomUnits(CHECK_ROWS));
+  if (rodGroup->nbRods > 0 && rand() % 2 == 0)
+  {
+    Rod other = rodGroup->rods[rand() % rodGroup->nbRods];
+    switch (rand() % 4)
+    {
+    case 0:
+      SetTopLeft(&rod, (Vector2){GetRight(other), GetTop(other)});
+      break;
+    case 1:
+      SetTopLeft(&rod, (Vector2){GetLeft(other) - rod.rect.width, GetTop(other) + ROD_HEIGHT / 2});
+      break;
+    case 2:
+      SetTopLeft(&rod, (Vector2){GetLeft(other) + RandomUnits(other.numericLength), GetBottom(other)});
+      break;
+    default:
+      // Just apart: no contact.
+      SetTopLeft(&rod, (Vector2){GetLeft(other), GetTop(other) - ROD_HEIGHT - 0.5f});
+    }
+  }
+  return rod;
+}
+
+bool CheckContactGraph(int seed)
+{
+  srand(seed);
+  RodGroup *rodGroup = malloc(sizeof(RodGroup) + CHECK_MAX_RODS * sizeof(Rod));
+  rodGroup->capacity = CHECK_MAX_RODS;
+  rodGroup->nbRods = 0;
+  for (int i = 0; i < CHECK_MAX_RODS / 2; i++)
+  {
+    rodGroup->rods[i] = NewCheckRod(rodGroup, 1 + rand() % NB_RODS_MENU);
+    rodGroup->nbRods += 1;
+  }
+  float width = CHECK_COLUMNS * UNIT_ROD_LENGTH;
+  float height = CHECK_ROWS * ROD_HEIGHT;
+  RodGrid *grid = NewRodGrid(rodGroup, width, height, UNIT_ROD_LENGTH, ROD_HEIGHT);
+  ContactGraph *graph = NewContactGraph(rodGroup, grid, NULL);
+  int *scratch = malloc(5 * CHECK_MAX_RODS * sizeof(int));
+  int *labels = scratch;
+  int *stack = &scratch[CHECK_MAX_RODS];
+  int *roots = &scratch[2 * CHECK_MAX_RODS];
+  int *sizes = &scratch[3 * CHECK_MAX_RODS];
+  int *lengths = &scratch[4 * CHECK_MAX_RODS];
+  bool ok = CheckComponents(graph, labels, stack, roots, sizes, lengths);
+  int step = 0;
+  for (; ok && step < CHECK_STEPS; step++)
+  {
+    int action = rand() % 10;
+    if (action < 2 && rodGroup->nbRods < CHECK_MAX_RODS)
+    {
+      int rodIndex = rodGroup->nbRods;
+      rodGroup->rods[rodIndex] = NewCheckRod(rodGroup, 1 + rand() % NB_RODS_MENU);
+      rodGroup->nbRods += 1;
+      AddRodToGrid(grid, rodGroup, rodIndex);
+      AddRodToContacts(graph, rodIndex);
+    }
+    else if (action < 4 && rodGroup->nbRods > 0)
+    {
+      // As RemoveRodFromWorld does: the last rod takes the index.
+      int rodIndex = rand() % rodGroup->nbRods;
+      RemoveRodFromContacts(graph, rodIndex);
+      RemoveRodFromGrid(grid, rodIndex);
+      rodGroup->nbRods -= 1;
+      rodGroup->rods[rodIndex] = rodGroup->rods[rodGroup->nbRods];
+    }
+    else if (rodGroup->nbRods > 0)
+    {
+      int rodIndex = rand() % rodGroup->nbRods;
+      Rod moved = NewCheckRod(rodGroup, rodGroup->rods[rodIndex].numericLength);
+      SetTopLeft(&rodGroup->rods[rodIndex], GetTopLeft(moved));
+      MoveRodInGrid(grid, rodGroup, rodIndex);
+      MoveRodInContacts(graph, rodIndex);
+    }
+    ok = CheckComponents(graph, labels, stack, roots, sizes, lengths);
+  }
+  if (!ok)
+  {
+    printf("contacts seed %-2d  FAILED at step %d, %d rods\n", seed, step, rodGroup->nbRods);
+  }
+  free(scratch);
+  FreeContactGraph(graph);
+  FreeRodGrid(grid);
+  free(rodGroup);
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  int nbFailed = 0;
+  srand(0);
+  WriteCheckTap(CHECK_TAP);
+  nbFailed += !CheckTapRoundTrip(CHECK_TAP);
+  remove(CHECK_TAP);
+  for (int i = 1; i < argc; i++)
+  {
+    nbFailed += !CheckTapRoundTrip(argv[i]);
+  }
+  int nbSeedsFailed = 0;
+  for (int seed = 0; seed < CHECK_SEEDS; seed++)
+  {
+    nbSeedsFailed += !CheckContactGraph(seed);
+  }
+  printf("contacts %d seeds of %d steps  %s\n", CHECK_SEEDS, CHECK_STEPS, nbSeedsFailed == 0 ? "ok" : "FAILED");
+  nbFailed += nbSeedsFailed;
+  return nbFailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
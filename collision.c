@@ -0,0 +1,1190 @@
+#include "collision.h"
+#include "raymath.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *RESOLVER_NAMES[NB_RESOLVERS] = {"corner", "swept", "bitboard", "cspace"};
+
+CandidateAxis NewCandidateAxis(void)
+{
+  return (CandidateAxis){.nbValues = 0, .capacity = 0, .values = NULL, .dists = NULL};
+}
+
+void FreeCandidateAxis(CandidateAxis *axis)
+{
+  free(axis->values);
+  free(axis->dists);
+}
+
+void AddCandidate(CandidateAxis *axis, float value)
+{
+  if (axis->nbValues == axis->capacity)
+  {
+    axis->capacity = axis->capacity == 0 ? 16 : 2 * axis->capacity;
+    axis->values = realloc(axis->values, axis->capacity * sizeof(float));
+    axis->dists = realloc(axis->dists, axis->capacity * sizeof(float));
+  }
+  axis->values[axis->nbValues] = value;
+  axis->nbValues += 1;
+}
+
+int CompareFloats(const void *a, const void *b)
+{
+  float fa = *(const float *)a;
+  float fb = *(const float *)b;
+  return (fa > fb) - (fa < fb);
+}
+
+// Removes duplicates, then orders the values by distance to the target and by
+// value for equal distances, so that the chosen position doesn't depend on
+// the order the rods were found in.
+void SortCandidates(CandidateAxis *axis, float target)
+{
+  qsort(axis->values, axis->nbValues, sizeof(float), CompareFloats);
+  int n = 0;
+  for (int i = 0; i < axis->nbValues; i++)
+  {
+    if (n == 0 || axis->values[i] != axis->values[n - 1])
+    {
+      axis->values[n] = axis->values[i];
+      n += 1;
+    }
+  }
+  axis->nbValues = n;
+
+  // Insertion sort: values are already ordered, distances are V-shaped.
+  for (int i = 0; i < n; i++)
+  {
+    float value = axis->values[i];
+    float dist = (target - value) * (target - value);
+    int j = i;
+    while (j > 0 && axis->dists[j - 1] > dist)
+    {
+      axis->values[j] = axis->values[j - 1];
+      axis->dists[j] = axis->dists[j - 1];
+      j -= 1;
+    }
+    axis->values[j] = value;
+    axis->dists[j] = dist;
+  }
+}
+
+// The pool, which may be NULL, runs the work split in tiles: the first
+// contacts, and the neighbours of the rods of a train.
+CollisionWorld *NewCollisionWorld(RodGroup *rodGroup, float width, float height, WorkerPool *pool)
+{
+  CollisionWorld *world = malloc(sizeof(CollisionWorld));
+  world->resolver = CORNER_RESOLVER;
+  world->snapDistance = 0;
+  world->rodGroup = rodGroup;
+  world->grid = NewRodGrid(rodGroup, width, height, UNIT_ROD_LENGTH, ROD_HEIGHT);
+  world->bands = NewBandIndex(rodGroup, height);
+  world->pool = pool;
+  world->contacts = NewContactGraph(rodGroup, world->grid, pool);
+  world->nearRods = NewRodSoA();
+  world->nearRod = -1;
+  world->nbNearQueries = 0;
+  world->nbNearHits = 0;
+  world->lefts = NewCandidateAxis();
+  world->tops = NewCandidateAxis();
+  world->heap = NULL;
+  world->heapCapacity = 0;
+  world->sweptRods = NULL;
+  world->sweptRodsCapacity = 0;
+  world->width = width;
+  world->height = height;
+  world->board = NULL;
+  world->boardRects = NULL;
+  world->cspace = NULL;
+  world->nbTrainRods = 0;
+  world->trainCapacity = 0;
+  world->trainRods = NULL;
+  world->trainStarts = NULL;
+  world->trainMarks = calloc(rodGroup->capacity + 1, sizeof(int));
+  world->trainMark = 0;
+  world->nbTrainTiles = 0;
+  world->trainTileCapacity = 0;
+  world->trainTiles = NULL;
+  world->tileAllowed = NULL;
+  return world;
+}
+
+void FreeCollisionWorld(CollisionWorld *world)
+{
+  if (world == NULL)
+  {
+    return;
+  }
+  FreeRodGrid(world->grid);
+  FreeBandIndex(world->bands);
+  FreeContactGraph(world->contacts);
+  FreeRodSoA(&world->nearRods);
+  FreeCandidateAxis(&world->lefts);
+  FreeCandidateAxis(&world->tops);
+  free(world->heap);
+  free(world->sweptRods);
+  FreeBitboard(world->board);
+  free(world->boardRects);
+  FreeCSpaceMap(world->cspace);
+  free(world->trainRods);
+  free(world->trainStarts);
+  for (int tile = 0; tile < world->trainTileCapacity; tile++)
+  {
+    free(world->trainTiles[tile].rods);
+  }
+  free(world->trainTiles);
+  free(world->tileAllowed);
+  free(world->trainMarks);
+  free(world);
+}
+
+void PaintRod(CollisionWorld *world, int rodIndex)
+{
+  Rectangle rect = world->rodGroup->rods[rodIndex].rect;
+  SetBitboardRect(world->board, rect.x, rect.y, rect.width, rect.height, true);
+  world->boardRects[rodIndex] = rect;
+}
+
+// Clears the area painted for the rod, then repaints the rods overlapping it
+// so that their pixels stay set.
+void ErasePaintedRod(CollisionWorld *world, int rodIndex)
+{
+  Rectangle rect = world->boardRects[rodIndex];
+  SetBitboardRect(world->board, rect.x, rect.y, rect.width, rect.height, false);
+  const int *rods;
+  int nbRods = QueryRodGrid(world->grid, rect, &rods);
+  for (int i = 0; i < nbRods; i++)
+  {
+    Rectangle other = world->boardRects[rods[i]];
+    if (rods[i] != rodIndex && CheckCollisionRecs(rect, other))
+    {
+      SetBitboardRect(world->board, other.x, other.y, other.width, other.height, true);
+    }
+  }
+}
+
+// The grid first: the contacts are found with it.
+void UpdateRodQueries(CollisionWorld *world, int rodIndex)
+{
+  if (rodIndex != world->nearRod)
+  {
+    world->nearRod = -1;
+  }
+  if (world->cspace != NULL && rodIndex != world->cspace->rodIndex)
+  {
+    world->cspace->rodIndex = -1;
+  }
+  MoveRodInGrid(world->grid, world->rodGroup, rodIndex);
+  MoveRodInBands(world->bands, rodIndex);
+  MoveRodInContacts(world->contacts, rodIndex);
+}
+
+void UpdateRodIndices(CollisionWorld *world, int rodIndex)
+{
+  if (world->board != NULL)
+  {
+    ErasePaintedRod(world, rodIndex);
+    PaintRod(world, rodIndex);
+  }
+  UpdateRodQueries(world, rodIndex);
+}
+
+// The bitboard and configuration space resolvers round every rod to whole
+// pixels. Their maps cover the tablet, the rods, and the margin a dragged rod
+// may take out of the window: the length of the longest rod, at least that
+// of the classic rods.
+void SetResolver(CollisionWorld *world, Resolver resolver)
+{
+  world->resolver = resolver;
+  FreeBitboard(world->board);
+  free(world->boardRects);
+  FreeCSpaceMap(world->cspace);
+  world->board = NULL;
+  world->boardRects = NULL;
+  world->cspace = NULL;
+  if (resolver != BITBOARD_RESOLVER && resolver != CSPACE_RESOLVER)
+  {
+    return;
+  }
+
+  RodGroup *rodGroup = world->rodGroup;
+  float margin = fmaxf(NB_RODS_MENU * UNIT_ROD_LENGTH, world->bands->maxWidth);
+  float minX = -margin;
+  float minY = -margin;
+  float maxX = world->width + margin;
+  float maxY = world->height + margin;
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    RoundRod(&rodGroup->rods[i]);
+    UpdateRodQueries(world, i);
+    minX = fminf(minX, GetLeft(rodGroup->rods[i]) - margin);
+    minY = fminf(minY, GetTop(rodGroup->rods[i]) - margin);
+    maxX = fmaxf(maxX, GetRight(rodGroup->rods[i]) + margin);
+    maxY = fmaxf(maxY, GetBottom(rodGroup->rods[i]) + margin);
+  }
+  if (resolver == CSPACE_RESOLVER)
+  {
+    world->cspace = NewCSpaceMap(rodGroup, world->grid, minX, minY, maxX - minX, maxY - minY);
+    return;
+  }
+  world->board = NewBitboard(minX, minY, maxX - minX, maxY - minY, ROD_HEIGHT);
+  world->boardRects = malloc(rodGroup->capacity * sizeof(Rectangle));
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    PaintRod(world, i);
+  }
+}
+
+// To call once the group was reallocated: the world follows it, with room
+// for every rod it may hold.
+void ResizeCollisionWorld(CollisionWorld *world, RodGroup *rodGroup)
+{
+  int formerCapacity = world->grid->rodCapacity;
+  world->rodGroup = rodGroup;
+  ResizeRodGrid(world->grid, rodGroup->capacity);
+  ResizeBandIndex(world->bands, rodGroup);
+  ResizeContactGraph(world->contacts, rodGroup);
+  world->trainMarks = realloc(world->trainMarks, (rodGroup->capacity + 1) * sizeof(int));
+  memset(&world->trainMarks[formerCapacity], 0, (rodGroup->capacity - formerCapacity) * sizeof(int));
+  if (world->board != NULL)
+  {
+    world->boardRects = realloc(world->boardRects, rodGroup->capacity * sizeof(Rectangle));
+  }
+  if (world->cspace != NULL)
+  {
+    world->cspace->rodGroup = rodGroup;
+  }
+}
+
+// Appends the rod to the group, which must have room for it. When its place
+// is taken, it starts right of the rods beside it, where it is free, and the
+// resolver moves it as close to its place as it can. Returns its index.
+int AddRodToWorld(CollisionWorld *world, Rod rod)
+{
+  RodGroup *rodGroup = world->rodGroup;
+  int rodIndex = rodGroup->nbRods;
+  if (world->board != NULL || world->cspace != NULL)
+  {
+    RoundRod(&rod);
+  }
+  const int *rods;
+  bool fits = QueryBands(world->bands, rod.rect, &rods) == 0 &&
+              (world->board == NULL || IsBitboardRectFree(world->board, rod.rect.x, rod.rect.y, rod.rect.width, rod.rect.height));
+  rodGroup->rods[rodIndex] = rod;
+  if (!fits)
+  {
+    SetLeft(&rodGroup->rods[rodIndex], floorf(GetRightmostBeside(world->bands, rod.rect)) + 1);
+  }
+  rodGroup->nbRods += 1;
+
+  // The other rods now have a new neighbour.
+  world->nearRod = -1;
+  if (world->cspace != NULL)
+  {
+    world->cspace->rodIndex = -1;
+  }
+  world->trainMarks[rodIndex] = 0;
+  AddRodToGrid(world->grid, rodGroup, rodIndex);
+  AddRodToBands(world->bands, rodIndex);
+  AddRodToContacts(world->contacts, rodIndex);
+  if (world->board != NULL)
+  {
+    PaintRod(world, rodIndex);
+  }
+  if (!fits)
+  {
+    MoveRod(world, rodIndex, rod);
+  }
+  return rodIndex;
+}
+
+// Removes the rod from the group. The last rod takes its index, in the group
+// as in every index.
+void RemoveRodFromWorld(CollisionWorld *world, int rodIndex)
+{
+  RodGroup *rodGroup = world->rodGroup;
+  int lastRod = rodGroup->nbRods - 1;
+  world->nearRod = -1;
+  if (world->cspace != NULL)
+  {
+    world->cspace->rodIndex = -1;
+  }
+  if (world->board != NULL)
+  {
+    ErasePaintedRod(world, rodIndex);
+    world->boardRects[rodIndex] = world->boardRects[lastRod];
+  }
+  RemoveRodFromContacts(world->contacts, rodIndex);
+  RemoveRodFromBands(world->bands, rodIndex);
+  RemoveRodFromGrid(world->grid, rodIndex);
+  world->trainMarks[rodIndex] = world->trainMarks[lastRod];
+  world->nbTrainRods = 0;
+  rodGroup->rods[rodIndex] = rodGroup->rods[lastRod];
+  rodGroup->nbRods = lastRod;
+}
+
+int PickRod(CollisionWorld *world, Vector2 point)
+{
+  return PickRodInGrid(world->grid, world->rodGroup, point);
+}
+
+// To call when a drag starts, for the resolvers preparing the drag.
+void PickUpRod(CollisionWorld *world, int rodIndex)
+{
+  if (world->cspace != NULL)
+  {
+    PickUpInCSpace(world->cspace, rodIndex);
+  }
+}
+
+bool ContainsRec(Rectangle outer, Rectangle inner)
+{
+  return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.width <= outer.x + outer.width &&
+         inner.y + inner.height <= outer.y + outer.height;
+}
+
+// Gathers the rods around the area, except the moving one, in nearRods. The
+// rods gathered for the previous frames are kept when they cover the area:
+// they are a superset of the ones overlapping it, which is all the strict
+// collision tests need.
+void GatherNearRods(CollisionWorld *world, int rodIndex, Rectangle area)
+{
+  world->nbNearQueries += 1;
+  if (world->nearRod == rodIndex && ContainsRec(world->nearArea, area))
+  {
+    world->nbNearHits += 1;
+    return;
+  }
+  world->nearArea = (Rectangle){area.x - WARM_MARGIN, area.y - WARM_MARGIN, area.width + 2 * WARM_MARGIN, area.height + 2 * WARM_MARGIN};
+  world->nearRod = rodIndex;
+  const int *cellRods;
+  int nbCellRods = QueryRodGrid(world->grid, world->nearArea, &cellRods);
+  FillRodSoA(&world->nearRods, world->rodGroup, cellRods, nbCellRods, rodIndex);
+}
+
+// Share of the neighbourhood queries answered by the rods kept from the
+// previous frames.
+float GetWarmHitRate(CollisionWorld *world)
+{
+  return world->nbNearQueries == 0 ? 0 : (float)world->nbNearHits / world->nbNearQueries;
+}
+
+bool PairBefore(CandidatePair a, CandidatePair b)
+{
+  if (a.dist != b.dist)
+  {
+    return a.dist < b.dist;
+  }
+  if (a.ix != b.ix)
+  {
+    return a.ix < b.ix;
+  }
+  return a.iy < b.iy;
+}
+
+void PushPair(CollisionWorld *world, int *heapSize, CandidatePair pair)
+{
+  int i = *heapSize;
+  *heapSize += 1;
+  while (i > 0 && PairBefore(pair, world->heap[(i - 1) / 2]))
+  {
+    world->heap[i] = world->heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  world->heap[i] = pair;
+}
+
+CandidatePair PopPair(CollisionWorld *world, int *heapSize)
+{
+  CandidatePair top = world->heap[0];
+  *heapSize -= 1;
+  CandidatePair last = world->heap[*heapSize];
+  int i = 0;
+  for (;;)
+  {
+    int child = 2 * i + 1;
+    if (child >= *heapSize)
+    {
+      break;
+    }
+    if (child + 1 < *heapSize && PairBefore(world->heap[child + 1], world->heap[child]))
+    {
+      child += 1;
+    }
+    if (!PairBefore(world->heap[child], last))
+    {
+      break;
+    }
+    world->heap[i] = world->heap[child];
+    i = child;
+  }
+  world->heap[i] = last;
+  return top;
+}
+
+const char *GetResolverName(Resolver resolver)
+{
+  return RESOLVER_NAMES[resolver];
+}
+
+int FindResolver(const char *name)
+{
+  for (int i = 0; i < NB_RESOLVERS; i++)
+  {
+    if (strcmp(name, RESOLVER_NAMES[i]) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Moves the rod as close as possible to the target. When the target collides
+// with other rods, the candidate positions put the rod flush against one of
+// the rods it would enter (or at the target's or current coordinate) on each
+// axis. Candidates are visited by increasing distance to the target, and the
+// first free one closer than the current position wins. Returns whether the
+// target collided.
+bool ResolveFromCorners(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  RodGroup *rodGroup = world->rodGroup;
+  Rod *rod = &rodGroup->rods[rodIndex];
+  CandidateAxis *lefts = &world->lefts;
+  CandidateAxis *tops = &world->tops;
+  lefts->nbValues = 0;
+  tops->nbValues = 0;
+
+  GatherNearRods(world, rodIndex, targetRod.rect);
+  StrictCollisionMask(&world->nearRods, targetRod.rect);
+
+  bool collided = false;
+  for (int k = 0; k < world->nearRods.nbRods; k++)
+  {
+    if (!(world->nearRods.mask[k / 32] & (1u << (k % 32))))
+    {
+      continue;
+    }
+    Rod otherRod = rodGroup->rods[world->nearRods.indices[k]];
+    Rod candidateRod = *rod;
+    StrictCollisionType collisionType = CheckStrictCollision(*rod, targetRod, otherRod);
+    collided = collided || collisionType != NO_STRICT_COLLISION;
+    switch (collisionType)
+    {
+    case FROM_ABOVE:
+      SetBottom(&candidateRod, GetTop(otherRod));
+      AddCandidate(tops, GetTop(candidateRod));
+      break;
+    case FROM_BELOW:
+      AddCandidate(tops, GetBottom(otherRod));
+      break;
+    case FROM_LEFT:
+      SetRight(&candidateRod, GetLeft(otherRod));
+      AddCandidate(lefts, GetLeft(candidateRod));
+      break;
+    case FROM_RIGHT:
+      AddCandidate(lefts, GetRight(otherRod));
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (!collided)
+  {
+    *rod = targetRod;
+    UpdateRodIndices(world, rodIndex);
+    return false;
+  }
+
+  // The target's and the current coordinates are candidates too, computed the
+  // same way as the bounds of the other rods.
+  Rod candidateRod = *rod;
+  SetBottom(&candidateRod, GetBottom(targetRod));
+  AddCandidate(tops, GetTop(candidateRod));
+  SetBottom(&candidateRod, GetBottom(*rod));
+  AddCandidate(tops, GetTop(candidateRod));
+  SetRight(&candidateRod, GetRight(targetRod));
+  AddCandidate(lefts, GetLeft(candidateRod));
+  SetRight(&candidateRod, GetRight(*rod));
+  AddCandidate(lefts, GetLeft(candidateRod));
+
+  SortCandidates(lefts, GetLeft(targetRod));
+  SortCandidates(tops, GetTop(targetRod));
+
+  // Every candidate lies in the box spanned by the extreme values, so the rods
+  // that may block any of them are gathered once.
+  float minLeft = INFINITY, maxLeft = -INFINITY, minTop = INFINITY, maxTop = -INFINITY;
+  for (int ix = 0; ix < lefts->nbValues; ix++)
+  {
+    minLeft = fminf(minLeft, lefts->values[ix]);
+    maxLeft = fmaxf(maxLeft, lefts->values[ix]);
+  }
+  for (int iy = 0; iy < tops->nbValues; iy++)
+  {
+    minTop = fminf(minTop, tops->values[iy]);
+    maxTop = fmaxf(maxTop, tops->values[iy]);
+  }
+  Rectangle candidatesArea = {minLeft, minTop, maxLeft - minLeft + rod->rect.width, maxTop - minTop + rod->rect.height};
+  GatherNearRods(world, rodIndex, candidatesArea);
+
+  if (world->heapCapacity < lefts->nbValues + 1)
+  {
+    world->heapCapacity = 2 * lefts->nbValues + 1;
+    world->heap = realloc(world->heap, world->heapCapacity * sizeof(CandidatePair));
+  }
+
+  // Pairs are enumerated by increasing distance: (ix, iy) is only pushed once
+  // the pair before it on one axis has been popped.
+  float currentDist = Vector2DistanceSqr(GetTopLeft(targetRod), GetTopLeft(*rod));
+  int heapSize = 0;
+  PushPair(world, &heapSize, (CandidatePair){lefts->dists[0] + tops->dists[0], 0, 0});
+  for (int nbTested = 0; heapSize > 0 && nbTested < MAX_CANDIDATES_TESTED; nbTested++)
+  {
+    CandidatePair pair = PopPair(world, &heapSize);
+    if (pair.dist >= currentDist)
+    {
+      break;
+    }
+    Rectangle candidate = {lefts->values[pair.ix], tops->values[pair.iy], rod->rect.width, rod->rect.height};
+    if (!AnyStrictCollision(&world->nearRods, candidate))
+    {
+      SetTopLeft(rod, (Vector2){candidate.x, candidate.y});
+      break;
+    }
+    if (pair.iy == 0 && pair.ix + 1 < lefts->nbValues)
+    {
+      PushPair(world, &heapSize, (CandidatePair){lefts->dists[pair.ix + 1] + tops->dists[0], pair.ix + 1, 0});
+    }
+    if (pair.iy + 1 < tops->nbValues)
+    {
+      PushPair(world, &heapSize, (CandidatePair){lefts->dists[pair.ix] + tops->dists[pair.iy + 1], pair.ix, pair.iy + 1});
+    }
+  }
+  UpdateRodIndices(world, rodIndex);
+  return true;
+}
+
+// Times at which the moving interval [min, max) starts and stops overlapping
+// [otherMin, otherMax) while moving by delta. Returns false if it never does.
+bool SweepInterval(float min, float max, float otherMin, float otherMax, float delta, float *entry, float *exit)
+{
+  if (delta > 0)
+  {
+    *entry = (otherMin - max) / delta;
+    *exit = (otherMax - min) / delta;
+  }
+  else if (delta < 0)
+  {
+    *entry = (otherMax - min) / delta;
+    *exit = (otherMin - max) / delta;
+  }
+  else
+  {
+    *entry = -INFINITY;
+    *exit = INFINITY;
+    return max > otherMin && min < otherMax;
+  }
+  return true;
+}
+
+// Moves the rod along one axis up to the destination, stopping against the
+// nearest rod in the way. Rods it already overlaps are never the nearest.
+bool SlideRod(CollisionWorld *world, int rodIndex, Vector2 destination)
+{
+  Rod *rod = &world->rodGroup->rods[rodIndex];
+  Rod *rods = world->rodGroup->rods;
+  int nearest;
+  if (destination.x > GetLeft(*rod))
+  {
+    nearest = NearestRight(world->bands, rod->rect, rodIndex);
+    if (nearest != -1 && GetLeft(rods[nearest]) < destination.x + rod->rect.width)
+    {
+      SetRight(rod, GetLeft(rods[nearest]));
+      return true;
+    }
+  }
+  else if (destination.x < GetLeft(*rod))
+  {
+    nearest = NearestLeft(world->bands, rod->rect, rodIndex);
+    if (nearest != -1 && GetRight(rods[nearest]) > destination.x)
+    {
+      SetLeft(rod, GetRight(rods[nearest]));
+      return true;
+    }
+  }
+  else if (destination.y > GetTop(*rod))
+  {
+    nearest = NearestBelow(world->bands, rod->rect, rodIndex);
+    if (nearest != -1 && GetTop(rods[nearest]) < destination.y + rod->rect.height)
+    {
+      SetBottom(rod, GetTop(rods[nearest]));
+      return true;
+    }
+  }
+  else
+  {
+    nearest = NearestAbove(world->bands, rod->rect, rodIndex);
+    if (nearest != -1 && GetBottom(rods[nearest]) > destination.y)
+    {
+      SetTop(rod, GetBottom(rods[nearest]));
+      return true;
+    }
+  }
+  SetTopLeft(rod, destination);
+  return false;
+}
+
+// Moves the rod along the displacement to the target. On the first contact,
+// it is put flush against the face it hit, and the rest of the displacement
+// continues along that face. Rods it already overlaps don't block it, so that
+// overlapping rods can always be pulled apart. Returns whether it hit a rod.
+bool ResolveBySweeping(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  RodGroup *rodGroup = world->rodGroup;
+  Rod *rod = &rodGroup->rods[rodIndex];
+  // Kept apart from the displacement so that a free move lands exactly on it.
+  Vector2 destination = GetTopLeft(targetRod);
+  bool collided = false;
+
+  for (int pass = 0; pass < MAX_SWEEP_PASSES; pass++)
+  {
+    Vector2 remaining = Vector2Subtract(destination, GetTopLeft(*rod));
+    if (remaining.x == 0 && remaining.y == 0)
+    {
+      break;
+    }
+    // Along a single axis the first contact is simply the nearest rod that way.
+    if (remaining.x == 0 || remaining.y == 0)
+    {
+      collided = SlideRod(world, rodIndex, destination) || collided;
+      break;
+    }
+
+    Rectangle start = rod->rect;
+    Rectangle swept = {fminf(start.x, start.x + remaining.x), fminf(start.y, start.y + remaining.y),
+                       start.width + fabsf(remaining.x), start.height + fabsf(remaining.y)};
+    const int *cellRods;
+    int nbCellRods = QueryRodGrid(world->grid, swept, &cellRods);
+    if (world->sweptRodsCapacity < nbCellRods)
+    {
+      world->sweptRodsCapacity = 2 * nbCellRods;
+      world->sweptRods = realloc(world->sweptRods, world->sweptRodsCapacity * sizeof(int));
+    }
+
+    float firstHit = 1;
+    bool hitOnX = false;
+    int hitRod = -1;
+    int nbSwept = 0;
+    for (int k = 0; k < nbCellRods; k++)
+    {
+      int i = cellRods[k];
+      if (i == rodIndex || StrictlyCollide(*rod, rodGroup->rods[i]))
+      {
+        continue;
+      }
+      world->sweptRods[nbSwept] = i;
+      nbSwept += 1;
+
+      Rod otherRod = rodGroup->rods[i];
+      float entryX, exitX, entryY, exitY;
+      if (!SweepInterval(GetLeft(*rod), GetRight(*rod), GetLeft(otherRod), GetRight(otherRod), remaining.x, &entryX, &exitX) ||
+          !SweepInterval(GetTop(*rod), GetBottom(*rod), GetTop(otherRod), GetBottom(otherRod), remaining.y, &entryY, &exitY))
+      {
+        continue;
+      }
+      float entry = fmaxf(entryX, entryY);
+      float exit = fminf(exitX, exitY);
+      if (entry < exit && exit > 0 && entry < firstHit)
+      {
+        firstHit = fmaxf(entry, 0);
+        hitRod = i;
+        // On a corner, the smaller component is blocked and the larger one slides.
+        hitOnX = entryX > entryY || (entryX == entryY && fabsf(remaining.x) < fabsf(remaining.y));
+      }
+    }
+
+    if (hitRod == -1)
+    {
+      SetTopLeft(rod, destination);
+      break;
+    }
+    collided = true;
+
+    Rod otherRod = rodGroup->rods[hitRod];
+    if (hitOnX)
+    {
+      if (remaining.x > 0)
+      {
+        SetRight(rod, GetLeft(otherRod));
+      }
+      else
+      {
+        SetLeft(rod, GetRight(otherRod));
+      }
+      SetTop(rod, GetTop(*rod) + remaining.y * firstHit);
+      destination.x = GetLeft(*rod);
+    }
+    else
+    {
+      if (remaining.y > 0)
+      {
+        SetBottom(rod, GetTop(otherRod));
+      }
+      else
+      {
+        SetTop(rod, GetBottom(otherRod));
+      }
+      SetLeft(rod, GetLeft(*rod) + remaining.x * firstHit);
+      destination.y = GetTop(*rod);
+    }
+
+    // Rounding may push the free coordinate a hair into a rod that was hit at
+    // the same time; the rod then stays where this pass started.
+    FillRodSoA(&world->nearRods, rodGroup, world->sweptRods, nbSwept, rodIndex);
+    world->nearRod = -1;
+    if (AnyStrictCollision(&world->nearRods, rod->rect))
+    {
+      rod->rect = start;
+      break;
+    }
+  }
+  UpdateRodIndices(world, rodIndex);
+  return collided;
+}
+
+// Rounds the target to whole pixels and tests it with word-wide ANDs on the
+// bitboard. When it is taken, the closest free pixel strictly closer than the
+// current position wins, so the rod may jump over obstacles like with the
+// corner resolver. Returns whether the target collided.
+bool ResolveOnBitboard(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  Rod *rod = &world->rodGroup->rods[rodIndex];
+  RoundRod(&targetRod);
+  int x = GetLeft(targetRod);
+  int y = GetTop(targetRod);
+  int width = rod->rect.width;
+  int height = rod->rect.height;
+
+  ErasePaintedRod(world, rodIndex);
+  bool collided = !IsBitboardRectFree(world->board, x, y, width, height);
+  if (collided)
+  {
+    int dx = GetLeft(*rod) - x;
+    int dy = GetTop(*rod) - y;
+    if (!NearestFreePosition(world->board, x, y, width, height, dx * dx + dy * dy, &x, &y))
+    {
+      x = GetLeft(*rod);
+      y = GetTop(*rod);
+    }
+  }
+  SetTopLeft(rod, (Vector2){x, y});
+  PaintRod(world, rodIndex);
+  UpdateRodQueries(world, rodIndex);
+  return collided;
+}
+
+// Like the bitboard resolver, but the configuration space already tells
+// where the rod fits, so a position is one bit and each row of the search one
+// word read per 64 positions. The map is rebuilt when another rod is dragged.
+bool ResolveInCSpace(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  Rod *rod = &world->rodGroup->rods[rodIndex];
+  if (world->cspace->rodIndex != rodIndex)
+  {
+    PickUpInCSpace(world->cspace, rodIndex);
+  }
+  RoundRod(&targetRod);
+  int x = GetLeft(targetRod);
+  int y = GetTop(targetRod);
+
+  bool collided = !IsCSpaceFree(world->cspace, x, y);
+  if (collided)
+  {
+    int dx = GetLeft(*rod) - x;
+    int dy = GetTop(*rod) - y;
+    if (!NearestFreeInCSpace(world->cspace, x, y, dx * dx + dy * dy, &x, &y))
+    {
+      x = GetLeft(*rod);
+      y = GetTop(*rod);
+    }
+  }
+  SetTopLeft(rod, (Vector2){x, y});
+  UpdateRodIndices(world, rodIndex);
+  return collided;
+}
+
+bool MoveRod(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  switch (world->resolver)
+  {
+  case SWEPT_RESOLVER:
+    return ResolveBySweeping(world, rodIndex, targetRod);
+  case BITBOARD_RESOLVER:
+    return ResolveOnBitboard(world, rodIndex, targetRod);
+  case CSPACE_RESOLVER:
+    return ResolveInCSpace(world, rodIndex, targetRod);
+  default:
+    return ResolveFromCorners(world, rodIndex, targetRod);
+  }
+}
+
+// Puts a dropped rod flush against its nearest neighbour when it is closer
+// than the snap distance, horizontally then vertically. Nothing lies between
+// a rod and its nearest neighbour, so the snapped position is always free.
+bool DropRod(CollisionWorld *world, int rodIndex)
+{
+  if (world->snapDistance <= 0)
+  {
+    return false;
+  }
+  Rod *rod = &world->rodGroup->rods[rodIndex];
+  Rod *rods = world->rodGroup->rods;
+  bool snapped = false;
+
+  int left = NearestLeft(world->bands, rod->rect, rodIndex);
+  int right = NearestRight(world->bands, rod->rect, rodIndex);
+  float leftGap = left == -1 ? INFINITY : GetLeft(*rod) - GetRight(rods[left]);
+  float rightGap = right == -1 ? INFINITY : GetLeft(rods[right]) - GetRight(*rod);
+  if (leftGap <= rightGap && leftGap > 0 && leftGap <= world->snapDistance)
+  {
+    SetLeft(rod, GetRight(rods[left]));
+    snapped = true;
+  }
+  else if (rightGap > 0 && rightGap <= world->snapDistance)
+  {
+    SetRight(rod, GetLeft(rods[right]));
+    snapped = true;
+  }
+
+  int above = NearestAbove(world->bands, rod->rect, rodIndex);
+  int below = NearestBelow(world->bands, rod->rect, rodIndex);
+  float aboveGap = above == -1 ? INFINITY : GetTop(*rod) - GetBottom(rods[above]);
+  float belowGap = below == -1 ? INFINITY : GetTop(rods[below]) - GetBottom(*rod);
+  if (aboveGap <= belowGap && aboveGap > 0 && aboveGap <= world->snapDistance)
+  {
+    SetTop(rod, GetBottom(rods[above]));
+    snapped = true;
+  }
+  else if (belowGap > 0 && belowGap <= world->snapDistance)
+  {
+    SetBottom(rod, GetTop(rods[below]));
+    snapped = true;
+  }
+
+  if (snapped)
+  {
+    UpdateRodIndices(world, rodIndex);
+  }
+  return snapped;
+}
+
+typedef struct TrainJob
+{
+  CollisionWorld *world;
+  Vector2 delta;
+  bool onX;
+} TrainJob;
+
+void AddTrainRod(CollisionWorld *world, int rodIndex)
+{
+  if (world->nbTrainRods == world->trainCapacity)
+  {
+    world->trainCapacity = world->trainCapacity == 0 ? 8 : 2 * world->trainCapacity;
+    world->trainRods = realloc(world->trainRods, world->trainCapacity * sizeof(int));
+    world->trainStarts = realloc(world->trainStarts, (world->trainCapacity + 1) * sizeof(int));
+  }
+  world->trainRods[world->nbTrainRods] = rodIndex;
+  world->nbTrainRods += 1;
+  world->trainMarks[rodIndex] = world->trainMark;
+}
+
+// Gathers the rods connected to the picked one through their contacts, which
+// are then dragged with it by MoveTrain. Walking the contacts only visits the
+// train. Returns the number of rods in it, the picked one included.
+int PickUpTrain(CollisionWorld *world, int rodIndex)
+{
+  world->trainMark += 1;
+  world->nbTrainRods = 0;
+  AddTrainRod(world, rodIndex);
+  for (int k = 0; k < world->nbTrainRods; k++)
+  {
+    const int *rods;
+    int nbContacts = GetContacts(world->contacts, world->trainRods[k], &rods);
+    for (int i = 0; i < nbContacts; i++)
+    {
+      if (world->trainMarks[rods[i]] != world->trainMark)
+      {
+        AddTrainRod(world, rods[i]);
+      }
+    }
+  }
+  int nbTiles = (world->nbTrainRods + TRAIN_TILE_RODS - 1) / TRAIN_TILE_RODS;
+  if (nbTiles > world->trainTileCapacity)
+  {
+    world->trainTiles = realloc(world->trainTiles, nbTiles * sizeof(RodList));
+    world->tileAllowed = realloc(world->tileAllowed, nbTiles * sizeof(float));
+    for (int tile = world->trainTileCapacity; tile < nbTiles; tile++)
+    {
+      world->trainTiles[tile] = (RodList){0, 0, NULL};
+    }
+    world->trainTileCapacity = nbTiles;
+  }
+  world->nbTrainTiles = nbTiles;
+  return world->nbTrainRods;
+}
+
+// Gathers the other rods around the move of the rods of one tile of the
+// train, in the list of the tile, with trainStarts relative to it.
+void GatherTileNeighbours(void *context, int tile, int worker)
+{
+  (void)worker;
+  TrainJob *job = context;
+  CollisionWorld *world = job->world;
+  Rod *rods = world->rodGroup->rods;
+  RodList *list = &world->trainTiles[tile];
+  list->nbRods = 0;
+  int lastMember = (tile + 1) * TRAIN_TILE_RODS < world->nbTrainRods ? (tile + 1) * TRAIN_TILE_RODS : world->nbTrainRods;
+  for (int k = tile * TRAIN_TILE_RODS; k < lastMember; k++)
+  {
+    world->trainStarts[k] = list->nbRods;
+    Rectangle rect = rods[world->trainRods[k]].rect;
+    Rectangle swept = {fminf(rect.x, rect.x + job->delta.x), fminf(rect.y, rect.y + job->delta.y),
+                       rect.width + fabsf(job->delta.x), rect.height + fabsf(job->delta.y)};
+    int first = list->nbRods;
+    AppendRodsInArea(world->grid, swept, list);
+    int nbKept = first;
+    for (int i = first; i < list->nbRods; i++)
+    {
+      if (world->trainMarks[list->rods[i]] != world->trainMark)
+      {
+        list->rods[nbKept] = list->rods[i];
+        nbKept += 1;
+      }
+    }
+    list->nbRods = nbKept;
+  }
+}
+
+// Gathers, for each rod of the train, the other rods around its move, in
+// sweptRods from trainStarts[k] to trainStarts[k + 1]. The tiles are
+// gathered in parallel, then put one after the other in order.
+void GatherTrainNeighbours(CollisionWorld *world, Vector2 delta)
+{
+  TrainJob job = {world, delta, false};
+  RunTiles(world->pool, world->nbTrainTiles, GatherTileNeighbours, &job);
+  int nbGathered = 0;
+  for (int tile = 0; tile < world->nbTrainTiles; tile++)
+  {
+    nbGathered += world->trainTiles[tile].nbRods;
+  }
+  if (world->sweptRodsCapacity < nbGathered)
+  {
+    world->sweptRodsCapacity = 2 * nbGathered;
+    world->sweptRods = realloc(world->sweptRods, world->sweptRodsCapacity * sizeof(int));
+  }
+  nbGathered = 0;
+  for (int tile = 0; tile < world->nbTrainTiles; tile++)
+  {
+    RodList *list = &world->trainTiles[tile];
+    int lastMember = (tile + 1) * TRAIN_TILE_RODS < world->nbTrainRods ? (tile + 1) * TRAIN_TILE_RODS : world->nbTrainRods;
+    for (int k = tile * TRAIN_TILE_RODS; k < lastMember; k++)
+    {
+      world->trainStarts[k] += nbGathered;
+    }
+    if (list->nbRods > 0)
+    {
+      memcpy(world->sweptRods + nbGathered, list->rods, list->nbRods * sizeof(int));
+    }
+    nbGathered += list->nbRods;
+  }
+  world->trainStarts[world->nbTrainRods] = nbGathered;
+}
+
+// How far the rods of one tile of the train may move along one axis before
+// one of them hits one of the others. Rods a member already overlaps don't
+// block it.
+void ClampTileMove(void *context, int tile, int worker)
+{
+  (void)worker;
+  TrainJob *job = context;
+  CollisionWorld *world = job->world;
+  Rod *rods = world->rodGroup->rods;
+  bool onX = job->onX;
+  float delta = onX ? job->delta.x : job->delta.y;
+  float allowed = delta;
+  int lastMember = (tile + 1) * TRAIN_TILE_RODS < world->nbTrainRods ? (tile + 1) * TRAIN_TILE_RODS : world->nbTrainRods;
+  for (int k = tile * TRAIN_TILE_RODS; k < lastMember; k++)
+  {
+    Rectangle rect = rods[world->trainRods[k]].rect;
+    float min = onX ? rect.x : rect.y;
+    float max = onX ? rect.x + rect.width : rect.y + rect.height;
+    float crossMin = onX ? rect.y : rect.x;
+    float crossMax = onX ? rect.y + rect.height : rect.x + rect.width;
+    for (int j = world->trainStarts[k]; j < world->trainStarts[k + 1]; j++)
+    {
+      Rectangle other = rods[world->sweptRods[j]].rect;
+      float otherMin = onX ? other.x : other.y;
+      float otherMax = onX ? other.x + other.width : other.y + other.height;
+      float otherCrossMin = onX ? other.y : other.x;
+      float otherCrossMax = onX ? other.y + other.height : other.x + other.width;
+      if (otherCrossMax <= crossMin || otherCrossMin >= crossMax)
+      {
+        continue;
+      }
+      if (delta > 0 && otherMin >= max)
+      {
+        allowed = fminf(allowed, otherMin - max);
+      }
+      else if (delta < 0 && otherMax <= min)
+      {
+        allowed = fmaxf(allowed, otherMax - min);
+      }
+    }
+  }
+  world->tileAllowed[tile] = allowed;
+}
+
+// How far the train may move along one axis towards delta before one of its
+// rods hits one of the others.
+float ClampTrainMove(CollisionWorld *world, float delta, bool onX)
+{
+  TrainJob job = {world, onX ? (Vector2){delta, 0} : (Vector2){0, delta}, onX};
+  RunTiles(world->pool, world->nbTrainTiles, ClampTileMove, &job);
+  float allowed = delta;
+  for (int tile = 0; tile < world->nbTrainTiles; tile++)
+  {
+    allowed = delta > 0 ? fminf(allowed, world->tileAllowed[tile]) : fmaxf(allowed, world->tileAllowed[tile]);
+  }
+  return allowed;
+}
+
+// Moves every rod of the train by the same amount, unless rounding pushed one
+// a hair into another rod, in which case the train stays where it was.
+// Returns whether it did.
+bool ShiftTrain(CollisionWorld *world, Vector2 shift)
+{
+  Rod *rods = world->rodGroup->rods;
+  for (int k = 0; k < world->nbTrainRods; k++)
+  {
+    Rod *rod = &rods[world->trainRods[k]];
+    SetTopLeft(rod, Vector2Add(GetTopLeft(*rod), shift));
+  }
+  for (int k = 0; k < world->nbTrainRods; k++)
+  {
+    Rod rod = rods[world->trainRods[k]];
+    Rod before = rod;
+    SetTopLeft(&before, Vector2Subtract(GetTopLeft(rod), shift));
+    for (int j = world->trainStarts[k]; j < world->trainStarts[k + 1]; j++)
+    {
+      Rod other = rods[world->sweptRods[j]];
+      if (StrictlyCollide(rod, other) && !StrictlyCollide(before, other))
+      {
+        for (int i = 0; i < world->nbTrainRods; i++)
+        {
+          Rod *member = &rods[world->trainRods[i]];
+          SetTopLeft(member, Vector2Subtract(GetTopLeft(*member), shift));
+        }
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Whether no other rod lies within the bounding box of the whole train and
+// its move, in which case the train moves freely.
+bool IsTrainPathClear(CollisionWorld *world, Vector2 delta)
+{
+  Rod *rods = world->rodGroup->rods;
+  Rectangle box = rods[world->trainRods[0]].rect;
+  for (int k = 1; k < world->nbTrainRods; k++)
+  {
+    Rectangle rect = rods[world->trainRods[k]].rect;
+    float right = fmaxf(box.x + box.width, rect.x + rect.width);
+    float bottom = fmaxf(box.y + box.height, rect.y + rect.height);
+    box.x = fminf(box.x, rect.x);
+    box.y = fminf(box.y, rect.y);
+    box.width = right - box.x;
+    box.height = bottom - box.y;
+  }
+  Rectangle swept = {fminf(box.x, box.x + delta.x), fminf(box.y, box.y + delta.y),
+                     box.width + fabsf(delta.x), box.height + fabsf(delta.y)};
+  const int *cellRods;
+  int nbCellRods = QueryRodGrid(world->grid, swept, &cellRods);
+  for (int i = 0; i < nbCellRods; i++)
+  {
+    if (world->trainMarks[cellRods[i]] != world->trainMark)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Moves the train picked up with PickUpTrain so that the picked rod goes
+// towards the target, as one body: horizontally, then vertically, each time
+// up to the first contact of any of its rods, so it slides along what it
+// hits. Small trains first check the bounding box of the whole train; when
+// other rods are around, each rod of the train is tested against the rods
+// around its own move only, so the cost follows the size of the train rather
+// than the layout. Works the same with every resolver. Returns whether the
+// train hit a rod, or couldn't move for rounding.
+bool MoveTrain(CollisionWorld *world, int rodIndex, Rod targetRod)
+{
+  Rod *rods = world->rodGroup->rods;
+  if (world->board != NULL || world->cspace != NULL)
+  {
+    RoundRod(&targetRod);
+  }
+  Vector2 delta = Vector2Subtract(GetTopLeft(targetRod), GetTopLeft(rods[rodIndex]));
+  if (delta.x == 0 && delta.y == 0)
+  {
+    return false;
+  }
+
+  float dx = delta.x;
+  float dy = delta.y;
+  bool blocked;
+  if (world->nbTrainRods <= MAX_BOXED_TRAIN && IsTrainPathClear(world, delta))
+  {
+    world->trainStarts[0] = 0;
+    for (int k = 0; k < world->nbTrainRods; k++)
+    {
+      world->trainStarts[k + 1] = 0;
+    }
+    blocked = ShiftTrain(world, delta);
+  }
+  else
+  {
+    GatherTrainNeighbours(world, delta);
+    dx = ClampTrainMove(world, delta.x, true);
+    blocked = ShiftTrain(world, (Vector2){dx, 0});
+    dy = ClampTrainMove(world, delta.y, false);
+    blocked = ShiftTrain(world, (Vector2){0, dy}) || blocked;
+  }
+
+  // The whole train moves in the grid before the contacts are updated, so
+  // the contacts within the train never break on the way.
+  world->nearRod = -1;
+  if (world->cspace != NULL)
+  {
+    world->cspace->rodIndex = -1;
+  }
+  for (int k = 0; k < world->nbTrainRods; k++)
+  {
+    if (world->board != NULL)
+    {
+      ErasePaintedRod(world, world->trainRods[k]);
+      PaintRod(world, world->trainRods[k]);
+    }
+    MoveRodInGrid(world->grid, world->rodGroup, world->trainRods[k]);
+    MoveRodInBands(world->bands, world->trainRods[k]);
+  }
+  for (int k = 0; k < world->nbTrainRods; k++)
+  {
+    MoveRodInContacts(world->contacts, world->trainRods[k]);
+  }
+  return blocked || dx != delta.x || dy != delta.y;
+}
@@ -0,0 +1,122 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "rods.h"
+#include "grid.h"
+#include "bands.h"
+#include "soa.h"
+#include "bitboard.h"
+#include "contacts.h"
+#include "cspace.h"
+#include "pool.h"
+
+// Candidate positions validated per frame at most. When none of them is free,
+// the rod simply stays where it was, which is always a valid position.
+#define MAX_CANDIDATES_TESTED 256
+
+typedef enum Resolver
+{
+  // Jumps to the closest free position among the corners made by the bounds.
+  CORNER_RESOLVER,
+  // Moves along the mouse displacement, stopping and sliding on contact.
+  SWEPT_RESOLVER,
+  // Rods on whole pixels, jumping to the closest free pixel of the bitboard.
+  BITBOARD_RESOLVER,
+  // Same positions, looked up in the configuration space built at pickup.
+  CSPACE_RESOLVER,
+  NB_RESOLVERS,
+} Resolver;
+
+// Added around an area before gathering the rods in it, so that the areas
+// queried in the next frames of a drag still fall inside.
+#define WARM_MARGIN (2 * UNIT_ROD_LENGTH)
+
+// Rods of a train per tile when gathering their neighbours.
+#define TRAIN_TILE_RODS 128
+
+// Larger trains spread over too much of the layout for their bounding box to
+// be worth testing as a whole.
+#define MAX_BOXED_TRAIN 16
+
+// Passes of the swept resolver: the move, then sliding along up to two faces.
+#define MAX_SWEEP_PASSES 3
+
+typedef struct CandidatePair
+{
+  float dist;
+  int ix;
+  int iy;
+} CandidatePair;
+
+// Lefts (or tops) the selected rod may take, with their squared distance to the target.
+typedef struct CandidateAxis
+{
+  int nbValues;
+  int capacity;
+  float *values;
+  float *dists;
+} CandidateAxis;
+
+typedef struct CollisionWorld
+{
+  Resolver resolver;
+  // A dropped rod closer than this to a neighbour is put flush against it.
+  float snapDistance;
+  RodGroup *rodGroup;
+  RodGrid *grid;
+  BandIndex *bands;
+  ContactGraph *contacts;
+  // Rods around the moving rod, kept from frame to frame while the queried
+  // areas stay within nearArea and no other rod moves.
+  RodSoA nearRods;
+  Rectangle nearArea;
+  int nearRod;
+  long nbNearQueries;
+  long nbNearHits;
+  CandidateAxis lefts;
+  CandidateAxis tops;
+  CandidatePair *heap;
+  int heapCapacity;
+  int *sweptRods;
+  int sweptRodsCapacity;
+  float width;
+  float height;
+  // Only with the bitboard resolver, along with the area painted for each rod.
+  Bitboard *board;
+  Rectangle *boardRects;
+  // Only with the configuration space resolver.
+  CSpaceMap *cspace;
+  // Rods dragged together as one body, found at pickup, and a stamp per rod
+  // telling whether it belongs to them.
+  int nbTrainRods;
+  int trainCapacity;
+  int *trainRods;
+  // Where the rods around each rod of the train start in sweptRods.
+  int *trainStarts;
+  int *trainMarks;
+  int trainMark;
+  // The neighbours of each tile of the train, and how far each tile may move.
+  int nbTrainTiles;
+  int trainTileCapacity;
+  RodList *trainTiles;
+  float *tileAllowed;
+  WorkerPool *pool;
+} CollisionWorld;
+
+CollisionWorld *NewCollisionWorld(RodGroup *rodGroup, float width, float height, WorkerPool *pool);
+void FreeCollisionWorld(CollisionWorld *world);
+void SetResolver(CollisionWorld *world, Resolver resolver);
+void ResizeCollisionWorld(CollisionWorld *world, RodGroup *rodGroup);
+int AddRodToWorld(CollisionWorld *world, Rod rod);
+void RemoveRodFromWorld(CollisionWorld *world, int rodIndex);
+int PickRod(CollisionWorld *world, Vector2 point);
+void PickUpRod(CollisionWorld *world, int rodIndex);
+bool MoveRod(CollisionWorld *world, int rodIndex, Rod targetRod);
+bool DropRod(CollisionWorld *world, int rodIndex);
+int PickUpTrain(CollisionWorld *world, int rodIndex);
+bool MoveTrain(CollisionWorld *world, int rodIndex, Rod targetRod);
+float GetWarmHitRate(CollisionWorld *world);
+const char *GetResolverName(Resolver resolver);
+int FindResolver(const char *name);
+
+#endif
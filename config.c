@@ -7,6 +7,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <dirent.h>
 
 const double PARAMETER_NOT_SET = -10;
 
@@ -64,9 +65,11 @@ void SetSignalKind(config_t *cfg, SignalType *signalKind)
 }
 
 
+// An expression out of its domain (e.g. ln of a negative length ratio)
+// gives NaN, which is clamped to min.
 double ClampDouble(double d, double min, double max)
 {
-  const double t = d < min ? min : d;
+  const double t = d < min || d != d ? min : d;
   return t > max ? max : t;
 }
 
@@ -88,17 +91,6 @@ config_t LoadConfig(bool *err, const char *config_name)
   return cfg;
 }
 
-te_expr *GetConfigExpr(config_t *cfg, char *expr_name, te_variable *vars)
-{
-  const char *string_expr;
-  int err = 0;
-  if (config_lookup_string(cfg, expr_name, &string_expr))
-  {
-    return te_compile(string_expr, vars, 1, &err);
-  }
-  return 0;
-}
-
 double ReadParameterFromSetting(config_setting_t *setting, char *exprName)
 {
   const char *string_expr;
@@ -113,125 +105,218 @@ double ReadParameterFromSetting(config_setting_t *setting, char *exprName)
   }
 }
 
-void SetExpr16ParameterOfSignal(config_t *cfg, uint16_t *parameter, double l,
-                                char *exprName, double mask)
+// InitSignals silently leaves a parameter to 0 when its expression doesn't
+// compile, which is fine at startup but not when reloading a config on the fly.
+bool CheckConfigExprs(config_t *cfg)
 {
-  double my_l = l;
-  te_variable vars[] = {{"l", &my_l}};
-  te_expr *expr = GetConfigExpr(cfg, exprName, vars);
-  if ((void *)expr != 0)
+  char *exprNames[] = {"period_expr", "amplitude_expr", "duty_expr", "offset_expr"};
+  double l = 1;
+  te_variable vars[] = {{"l", &l}};
+  bool ok = true;
+  for (int i = 0; i < 4; i++)
   {
-    *parameter = (uint16_t)ClampDouble(te_eval(expr), 0, mask);
+    const char *string_expr;
+    if (config_lookup_string(cfg, exprNames[i], &string_expr))
+    {
+      int err = 0;
+      te_expr *expr = te_compile(string_expr, vars, 1, &err);
+      if (expr == NULL)
+      {
+        fprintf(stderr, "%s : erreur de syntaxe au caractère %d.\n", exprNames[i], err);
+        ok = false;
+      }
+      te_free(expr);
+    }
   }
+  return ok;
 }
 
-void SetExpr8ParameterOfSignal(config_t *cfg, uint8_t *parameter, double l,
-                               char *exprName, double mask)
+// Distance to the other rods under which the selected rod signal builds up,
+// 0 (no proximity feedback) when the key is absent.
+double ReadProximityRange(config_t cfg)
 {
-  double my_l = l;
-  te_variable vars[] = {{"l", &my_l}};
-  te_expr *expr = GetConfigExpr(cfg, exprName, vars);
-  if ((void *)expr != 0)
+  double range = 0;
+  int intRange;
+  if (config_lookup_int(&cfg, "proximity_range", &intRange))
+  {
+    range = intRange;
+  }
+  else
   {
-    *parameter = (uint8_t)ClampDouble(te_eval(expr), 0, mask);
+    config_lookup_float(&cfg, "proximity_range", &range);
   }
+  return ClampDouble(range, 0, 1000);
 }
 
+// Number of rod lengths the signal tables and colours are built for, 10
+// (the classic rods) when the key is absent.
+int ReadNbLengths(config_t cfg)
+{
+  int nbLengths = 10;
+  config_lookup_int(&cfg, "nb_lengths", &nbLengths);
+  return ClampDouble(nbLengths, 1, MAX_NB_LENGTHS);
+}
 
+// Evaluates the expression for every length in one go: it is compiled once,
+// then only the bound l changes between evaluations.
+bool EvalLengthExpr(config_t *cfg, char *exprName, double *values, int nbLengths)
+{
+  const char *string_expr;
+  if (!config_lookup_string(cfg, exprName, &string_expr))
+  {
+    return false;
+  }
+  double l = 1;
+  te_variable vars[] = {{"l", &l}};
+  int err = 0;
+  te_expr *expr = te_compile(string_expr, vars, 1, &err);
+  if (expr == NULL)
+  {
+    return false;
+  }
+  for (int i = 0; i < nbLengths; i++)
+  {
+    l = i + 1;
+    values[i] = te_eval(expr);
+  }
+  te_free(expr);
+  return true;
+}
 
-Signal *InitSignals(config_t cfg)
+// Overrides the parameters of the signal that the setting sets.
+void ReadSignalSetting(config_setting_t *setting, Signal *signal)
 {
+  double period = ReadParameterFromSetting(setting, "period");
+  if (period != PARAMETER_NOT_SET)
+  {
+    signal->period = ClampDouble(period, 0, 0xFFFF);
+  }
 
-  Signal *signals = malloc(10*sizeof(Signal));
-  char *signal_parameter_name = "signal_type";
+  double amplitude = ReadParameterFromSetting(setting, "amplitude");
+  if (amplitude != PARAMETER_NOT_SET)
+  {
+    signal->amplitude = ClampDouble(amplitude, 0, 0xFF);
+  }
+
+  double offset = ReadParameterFromSetting(setting, "offset");
+  if (offset != PARAMETER_NOT_SET)
+  {
+    signal->offset = ClampDouble(offset, 0, 0xFF);
+  }
+
+  double duty = ReadParameterFromSetting(setting, "duty");
+  if (duty != PARAMETER_NOT_SET)
+  {
+    signal->duty = ClampDouble(duty, 0, 0xFF);
+  }
+  const char *signal_name;
+  int signal_type = SINE;
+  if (config_setting_lookup_string(setting, "signal_type", &signal_name))
+  {
+    if (strcmp(signal_name, "sine") == 0)
+    {
+      signal_type = SINE;
+    }
+    else if (strcmp(signal_name, "steady") == 0)
+    {
+      signal_type = STEADY;
+    }
+    else if (strcmp(signal_name, "triangle") == 0)
+    {
+      signal_type = TRIANGLE;
+    }
+    else if (strcmp(signal_name, "front teeth") == 0)
+    {
+      signal_type = FRONT_TEETH;
+    }
+    else if (strcmp(signal_name, "back teeth") == 0)
+    {
+      signal_type = BACK_TEETH;
+    }
+    signal->signal_type = signal_type;
+  }
+}
+
+// A group setting is named after its lengths, e.g. g2-4-8. Lengths outside
+// the table are ignored.
+void ReadGroupSetting(config_setting_t *setting, Signal *signals, int nbLengths)
+{
+  const char *name = config_setting_name(setting);
+  if (name == NULL || name[0] != 'g')
+  {
+    return;
+  }
+  const char *c = name + 1;
+  while (*c != '\0')
+  {
+    char *end;
+    long l = strtol(c, &end, 10);
+    if (end == c || (*end != '-' && *end != '\0'))
+    {
+      return;
+    }
+    if (l >= 1 && l <= nbLengths)
+    {
+      ReadSignalSetting(setting, &signals[l - 1]);
+    }
+    c = *end == '-' ? end + 1 : end;
+  }
+}
+
+// The table holds one signal per length, signals[l - 1] for length l.
+Signal *InitSignals(config_t cfg, int nbLengths)
+{
+  Signal *signals = malloc(nbLengths * sizeof(Signal));
   SignalType signal = SINE;
   SetSignalKind(&cfg, &signal);
-
-  int i;
-  for (i = 0; i < 10; i++)
+  for (int i = 0; i < nbLengths; i++)
   {
-    int l = i+1;
     signals[i] = signal_new(signal, 0, 0, 0, 0, 0);
-    SetExpr16ParameterOfSignal(
-        &cfg, &signals[i].period, l,
-        "period_expr", 0xFFFF);
-    SetExpr8ParameterOfSignal(
-        &cfg, &signals[i].amplitude,
-        l, "amplitude_expr", 0xFF);
-    SetExpr8ParameterOfSignal(
-        &cfg, &signals[i].duty, l,
-        "duty_expr", 0xFF);
-    SetExpr8ParameterOfSignal(
-        &cfg, &signals[i].offset, l,
-        "offset_expr", 0xFF);
   }
 
+  double *values = malloc(nbLengths * sizeof(double));
+  if (EvalLengthExpr(&cfg, "period_expr", values, nbLengths))
+  {
+    for (int i = 0; i < nbLengths; i++)
+    {
+      signals[i].period = ClampDouble(values[i], 0, 0xFFFF);
+    }
+  }
+  if (EvalLengthExpr(&cfg, "amplitude_expr", values, nbLengths))
+  {
+    for (int i = 0; i < nbLengths; i++)
+    {
+      signals[i].amplitude = ClampDouble(values[i], 0, 0xFF);
+    }
+  }
+  if (EvalLengthExpr(&cfg, "duty_expr", values, nbLengths))
+  {
+    for (int i = 0; i < nbLengths; i++)
+    {
+      signals[i].duty = ClampDouble(values[i], 0, 0xFF);
+    }
+  }
+  if (EvalLengthExpr(&cfg, "offset_expr", values, nbLengths))
+  {
+    for (int i = 0; i < nbLengths; i++)
+    {
+      signals[i].offset = ClampDouble(values[i], 0, 0xFF);
+    }
+  }
+  free(values);
+
   int per_rod = 0;
   config_lookup_bool(&cfg, "per_rod", &per_rod);
-
   if (per_rod)
   {
-    char *rod_names[] = {"r1", "r2", "r3", "r4", "r5",
-                         "r6", "r7", "r8", "r9", "r10"};
-    int i;
-    for (i = 0; i < 10; i++)
+    for (int i = 0; i < nbLengths; i++)
     {
-      config_setting_t *setting = config_lookup(&cfg, rod_names[i]);
-
+      char rod_name[16];
+      snprintf(rod_name, sizeof(rod_name), "r%d", i + 1);
+      config_setting_t *setting = config_lookup(&cfg, rod_name);
       if (setting != NULL)
       {
-
-        double period = ReadParameterFromSetting(setting, "period");
-        if (period != PARAMETER_NOT_SET)
-        {
-          signals[i].period = ClampDouble(period, 0, 0xFFFF);
-        }
-
-        double amplitude = ReadParameterFromSetting(setting, "amplitude");
-        if (amplitude != PARAMETER_NOT_SET)
-        {
-          signals[i].amplitude = ClampDouble(amplitude, 0, 0xFF);
-        }
-
-        double offset = ReadParameterFromSetting(setting, "offset");
-        if (offset != PARAMETER_NOT_SET)
-        {
-          signals[i].offset = ClampDouble(offset, 0, 0xFF);
-        }
-
-        double duty = ReadParameterFromSetting(setting, "duty");
-        if (duty != PARAMETER_NOT_SET)
-        {
-          signals[i].duty = ClampDouble(duty, 0, 0xFF);
-        }
-        const char *signal_name;
-        int signal = SINE;
-        if (config_setting_lookup_string(setting, signal_parameter_name,
-                                         &signal_name))
-        {
-
-          if (strcmp(signal_name, "sine") == 0)
-          {
-            signal = SINE;
-          }
-          else if (strcmp(signal_name, "steady") == 0)
-          {
-            signal = STEADY;
-          }
-          else if (strcmp(signal_name, "triangle") == 0)
-          {
-            signal = TRIANGLE;
-          }
-          else if (strcmp(signal_name, "front teeth") == 0)
-          {
-            signal = FRONT_TEETH;
-          }
-          else if (strcmp(signal_name, "back teeth") == 0)
-          {
-            signal = BACK_TEETH;
-          }
-          signals[i].signal_type = signal;
-        }
+        ReadSignalSetting(setting, &signals[i]);
       }
     }
   }
@@ -240,68 +325,116 @@ Signal *InitSignals(config_t cfg)
   config_lookup_bool(&cfg, "per_group", &per_group);
   if (per_group)
   {
-    char *groups[] = {"g1-7", "g2-4-8", "g3-6-9", "g2-4-8", "g5-10",
-                      "g3-6-9", "g1-7", "g2-4-8", "g3-6-9", "g5-10"};
-    int i;
-    for (i = 0; i < 10; i++)
+    config_setting_t *root = config_root_setting(&cfg);
+    for (int i = 0; i < config_setting_length(root); i++)
     {
-      config_setting_t *setting = config_lookup(&cfg, groups[i]);
-
-      if (setting != NULL)
+      config_setting_t *setting = config_setting_get_elem(root, i);
+      if (config_setting_is_group(setting))
       {
-        double period = ReadParameterFromSetting(setting, "period");
-        if (period != PARAMETER_NOT_SET)
-        {
-          signals[i].period = ClampDouble(period, 0, 0xFFFF);
-        }
-
-        double amplitude = ReadParameterFromSetting(setting, "amplitude");
-        if (amplitude != PARAMETER_NOT_SET)
-        {
-          signals[i].amplitude = ClampDouble(amplitude, 0, 0xFF);
-        }
-
-        double offset = ReadParameterFromSetting(setting, "offset");
-        if (offset != PARAMETER_NOT_SET)
-        {
-          signals[i].offset = ClampDouble(offset, 0, 0xFF);
-        }
-
-        double duty = ReadParameterFromSetting(setting, "duty");
-        if (duty != PARAMETER_NOT_SET)
-        {
-          signals[i].duty = ClampDouble(duty, 0, 0xFF);
-        }
-        const char *signal_name;
-        int signal = SINE;
-        if (config_setting_lookup_string(setting, signal_parameter_name,
-                                         &signal_name))
-        {
-          if (strcmp(signal_name, "sine") == 0)
-          {
-            signal = SINE;
-          }
-          else if (strcmp(signal_name, "steady") == 0)
-          {
-            signal = STEADY;
-          }
-          else if (strcmp(signal_name, "triangle") == 0)
-          {
-            signal = TRIANGLE;
-          }
-          else if (strcmp(signal_name, "front teeth") == 0)
-          {
-            signal = FRONT_TEETH;
-          }
-          else if (strcmp(signal_name, "back teeth") == 0)
-          {
-            signal = BACK_TEETH;
-          }
-          signals[i].signal_type = signal;
-        }
+        ReadGroupSetting(setting, signals, nbLengths);
       }
     }
   }
 
   return signals;
 }
+
+
+int CompareNames(const void *a, const void *b)
+{
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+bool HasConfigExtension(const char *name)
+{
+  size_t len = strlen(name);
+  return len > 4 && strcmp(name + len - 4, ".cfg") == 0;
+}
+
+// Every config of the directory is parsed and resolved into its signal table
+// once, so that switching between them later never touches libconfig or tinyexpr.
+ConfigBank *LoadConfigBank(const char *dir_name, int nbLengths)
+{
+  DIR *dir = opendir(dir_name);
+  if (dir == NULL)
+  {
+    perror("Couldn't open the config bank");
+    return NULL;
+  }
+
+  int capacity = 8;
+  int nbNames = 0;
+  char **names = malloc(capacity * sizeof(char *));
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if (!HasConfigExtension(entry->d_name))
+    {
+      continue;
+    }
+    if (nbNames == capacity)
+    {
+      capacity *= 2;
+      names = realloc(names, capacity * sizeof(char *));
+    }
+    names[nbNames] = strdup(entry->d_name);
+    nbNames += 1;
+  }
+  closedir(dir);
+  // Sorted so that the indices sent over the websocket don't depend on readdir's order.
+  qsort(names, nbNames, sizeof(char *), CompareNames);
+
+  ConfigBank *bank = malloc(sizeof(ConfigBank));
+  bank->nbConfigs = 0;
+  bank->names = malloc(nbNames * sizeof(char *));
+  bank->signalTables = malloc(nbNames * sizeof(Signal *));
+
+  for (int i = 0; i < nbNames; i++)
+  {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir_name, names[i]);
+    bool err = false;
+    config_t cfg = LoadConfig(&err, path);
+    if (err)
+    {
+      fprintf(stderr, "Config %s skipped.\n", path);
+      free(names[i]);
+      continue;
+    }
+    bank->names[bank->nbConfigs] = names[i];
+    bank->signalTables[bank->nbConfigs] = InitSignals(cfg, nbLengths);
+    config_destroy(&cfg);
+    printf("CONFIG BANK [%d] : %s\n", bank->nbConfigs, names[i]);
+    bank->nbConfigs += 1;
+  }
+  free(names);
+  return bank;
+}
+
+int FindBankConfig(ConfigBank *bank, const char *name)
+{
+  for (int i = 0; i < bank->nbConfigs; i++)
+  {
+    if (strcmp(bank->names[i], name) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void FreeConfigBank(ConfigBank *bank)
+{
+  if (bank == NULL)
+  {
+    return;
+  }
+  for (int i = 0; i < bank->nbConfigs; i++)
+  {
+    free(bank->names[i]);
+    free(bank->signalTables[i]);
+  }
+  free(bank->names);
+  free(bank->signalTables);
+  free(bank);
+}
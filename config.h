@@ -5,7 +5,26 @@
 #include "signals.h"
 #include <stdbool.h>
 
+// Upper bound on nb_lengths, a few hundred lengths being the largest experiments.
+// The free play palette, 20 swatches of 30 px per column, then takes at most
+// 16 columns: half of the tablet.
+#define MAX_NB_LENGTHS 320
+
+typedef struct ConfigBank
+{
+  int nbConfigs;
+  char **names;
+  Signal **signalTables;
+} ConfigBank;
+
 config_t LoadConfig(bool *err, const char *config_name);
-Signal *InitSignals(config_t cfg);
+int ReadNbLengths(config_t cfg);
+Signal *InitSignals(config_t cfg, int nbLengths);
+bool CheckConfigExprs(config_t *cfg);
+double ReadProximityRange(config_t cfg);
+
+ConfigBank *LoadConfigBank(const char *dir_name, int nbLengths);
+int FindBankConfig(ConfigBank *bank, const char *name);
+void FreeConfigBank(ConfigBank *bank);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,492 @@
+#include "contacts.h"
+#include <stdlib.h>
+
+void AddContact(ContactList *list, int rodIndex)
+{
+  if (list->nbRods == list->capacity)
+  {
+    list->capacity = list->capacity == 0 ? 4 : 2 * list->capacity;
+    list->rods = realloc(list->rods, list->capacity * sizeof(int));
+  }
+  list->rods[list->nbRods] = rodIndex;
+  list->nbRods += 1;
+}
+
+void RemoveContact(ContactList *list, int rodIndex)
+{
+  for (int i = 0; i < list->nbRods; i++)
+  {
+    if (list->rods[i] == rodIndex)
+    {
+      list->rods[i] = list->rods[list->nbRods - 1];
+      list->nbRods -= 1;
+      return;
+    }
+  }
+}
+
+int FindRoot(int *parents, int node)
+{
+  while (parents[node] != node)
+  {
+    parents[node] = parents[parents[node]];
+    node = parents[node];
+  }
+  return node;
+}
+
+void JoinComponents(ContactGraph *graph, int rod1, int rod2)
+{
+  int root1 = FindRoot(graph->parents, graph->nodeOfRod[rod1]);
+  int root2 = FindRoot(graph->parents, graph->nodeOfRod[rod2]);
+  if (root1 == root2)
+  {
+    return;
+  }
+  if (graph->sizes[root1] < graph->sizes[root2])
+  {
+    int root = root1;
+    root1 = root2;
+    root2 = root;
+  }
+  graph->parents[root2] = root1;
+  graph->sizes[root1] += graph->sizes[root2];
+  graph->lengths[root1] += graph->lengths[root2];
+}
+
+// Gives the rod a node of its own, alone in its component.
+void NewNode(ContactGraph *graph, int rodIndex)
+{
+  if (graph->nbNodes == graph->nodeCapacity)
+  {
+    graph->nodeCapacity *= 2;
+    graph->parents = realloc(graph->parents, graph->nodeCapacity * sizeof(int));
+    graph->sizes = realloc(graph->sizes, graph->nodeCapacity * sizeof(int));
+    graph->lengths = realloc(graph->lengths, graph->nodeCapacity * sizeof(int));
+  }
+  int node = graph->nbNodes;
+  graph->nbNodes += 1;
+  graph->nodeOfRod[rodIndex] = node;
+  graph->parents[node] = node;
+  graph->sizes[node] = 1;
+  graph->lengths[node] = graph->rodGroup->rods[rodIndex].numericLength;
+}
+
+// Drops the ghosts: one node per rod, joined again along every contact.
+void RebuildComponents(ContactGraph *graph)
+{
+  graph->nbNodes = 0;
+  for (int i = 0; i < graph->rodGroup->nbRods; i++)
+  {
+    NewNode(graph, i);
+  }
+  for (int i = 0; i < graph->rodGroup->nbRods; i++)
+  {
+    for (int j = 0; j < graph->contacts[i].nbRods; j++)
+    {
+      JoinComponents(graph, i, graph->contacts[i].rods[j]);
+    }
+  }
+}
+
+int NextMark(ContactGraph *graph)
+{
+  graph->mark += 1;
+  if (graph->mark == 0)
+  {
+    for (int i = 0; i < graph->rodCapacity; i++)
+    {
+      graph->marks[i] = 0;
+    }
+    graph->mark = 1;
+  }
+  return graph->mark;
+}
+
+// Rods touching the rod where it is now, taken from the grid around it.
+int QueryTouchingRods(ContactGraph *graph, int rodIndex, const int **rods)
+{
+  Rod rod = graph->rodGroup->rods[rodIndex];
+  Rectangle around = {rod.rect.x - 1, rod.rect.y - 1, rod.rect.width + 2, rod.rect.height + 2};
+  int nbFound = QueryRodGrid(graph->grid, around, rods);
+  int *found = (int *)*rods;
+  int nbTouching = 0;
+  for (int i = 0; i < nbFound; i++)
+  {
+    if (found[i] != rodIndex && SoftlyCollide(rod, graph->rodGroup->rods[found[i]]))
+    {
+      found[nbTouching] = found[i];
+      nbTouching += 1;
+    }
+  }
+  return nbTouching;
+}
+
+// Rods per tile when finding the first contacts. The rods are stored in
+// Z-order, so a run of them makes a spatial tile.
+#define CONTACT_TILE_RODS 256
+
+typedef struct ContactTiles
+{
+  ContactGraph *graph;
+  // One per thread.
+  RodList *found;
+} ContactTiles;
+
+// Each rod's contacts are written by the tile of the rod only, in the order
+// QueryTouchingRods finds them.
+void FindTileContacts(void *context, int tile, int worker)
+{
+  ContactTiles *tiles = context;
+  ContactGraph *graph = tiles->graph;
+  RodList *found = &tiles->found[worker];
+  int firstRod = tile * CONTACT_TILE_RODS;
+  int lastRod = firstRod + CONTACT_TILE_RODS < graph->rodGroup->nbRods ? firstRod + CONTACT_TILE_RODS : graph->rodGroup->nbRods;
+  for (int i = firstRod; i < lastRod; i++)
+  {
+    Rod rod = graph->rodGroup->rods[i];
+    Rectangle around = {rod.rect.x - 1, rod.rect.y - 1, rod.rect.width + 2, rod.rect.height + 2};
+    found->nbRods = 0;
+    AppendRodsInArea(graph->grid, around, found);
+    for (int j = 0; j < found->nbRods; j++)
+    {
+      if (found->rods[j] != i && SoftlyCollide(rod, graph->rodGroup->rods[found->rods[j]]))
+      {
+        AddContact(&graph->contacts[i], found->rods[j]);
+      }
+    }
+  }
+}
+
+// The contacts of the rods are found in parallel tiles when a pool is given.
+ContactGraph *NewContactGraph(RodGroup *rodGroup, RodGrid *grid, WorkerPool *pool)
+{
+  int n = rodGroup->nbRods;
+  ContactGraph *graph = malloc(sizeof(ContactGraph));
+  graph->rodGroup = rodGroup;
+  graph->grid = grid;
+  graph->rodCapacity = rodGroup->capacity;
+  graph->contacts = calloc(rodGroup->capacity, sizeof(ContactList));
+  graph->nodeOfRod = malloc(rodGroup->capacity * sizeof(int));
+  graph->nbNodes = 0;
+  graph->nodeCapacity = n > 0 ? 2 * n : 1;
+  graph->parents = malloc(graph->nodeCapacity * sizeof(int));
+  graph->sizes = malloc(graph->nodeCapacity * sizeof(int));
+  graph->lengths = malloc(graph->nodeCapacity * sizeof(int));
+  graph->nbChanges = 0;
+  graph->nbSearches = 0;
+  graph->searches = NULL;
+  graph->heads = NULL;
+  graph->searchGroups = NULL;
+  graph->labels = malloc(rodGroup->capacity * sizeof(int));
+  graph->marks = calloc(rodGroup->capacity, sizeof(int));
+  graph->mark = 0;
+  int nbThreads = GetPoolThreadCount(pool);
+  ContactTiles tiles = {graph, calloc(nbThreads, sizeof(RodList))};
+  RunTiles(pool, (n + CONTACT_TILE_RODS - 1) / CONTACT_TILE_RODS, FindTileContacts, &tiles);
+  for (int i = 0; i < nbThreads; i++)
+  {
+    free(tiles.found[i].rods);
+  }
+  free(tiles.found);
+  RebuildComponents(graph);
+  return graph;
+}
+
+void FreeContactGraph(ContactGraph *graph)
+{
+  if (graph == NULL)
+  {
+    return;
+  }
+  for (int i = 0; i < graph->rodCapacity; i++)
+  {
+    free(graph->contacts[i].rods);
+  }
+  for (int i = 0; i < graph->nbSearches; i++)
+  {
+    free(graph->searches[i].rods);
+  }
+  free(graph->contacts);
+  free(graph->nodeOfRod);
+  free(graph->parents);
+  free(graph->sizes);
+  free(graph->lengths);
+  free(graph->searches);
+  free(graph->heads);
+  free(graph->searchGroups);
+  free(graph->labels);
+  free(graph->marks);
+  free(graph);
+}
+
+void StartSearches(ContactGraph *graph, const int *rods, int nbRods)
+{
+  if (graph->searchGroups == NULL || nbRods > graph->nbSearches)
+  {
+    graph->searches = realloc(graph->searches, nbRods * sizeof(ContactList));
+    graph->heads = realloc(graph->heads, nbRods * sizeof(int));
+    graph->searchGroups = realloc(graph->searchGroups, (nbRods + 1) * sizeof(int));
+    for (int s = graph->nbSearches; s < nbRods; s++)
+    {
+      graph->searches[s] = (ContactList){0, 0, NULL};
+    }
+    graph->nbSearches = nbRods;
+  }
+  int mark = NextMark(graph);
+  for (int s = 0; s < nbRods; s++)
+  {
+    graph->searches[s].nbRods = 0;
+    AddContact(&graph->searches[s], rods[s]);
+    graph->heads[s] = 0;
+    graph->searchGroups[s] = s;
+    graph->marks[rods[s]] = mark;
+    graph->labels[rods[s]] = s;
+  }
+  graph->searchGroups[nbRods] = nbRods;
+}
+
+// Visits the next rod of the group's searches. Returns false when they are
+// all done, meaning the group holds a whole component.
+bool StepSearchGroup(ContactGraph *graph, int group, int nbSearches)
+{
+  for (int s = 0; s < nbSearches; s++)
+  {
+    ContactList *search = &graph->searches[s];
+    if (FindRoot(graph->searchGroups, s) != group || graph->heads[s] == search->nbRods)
+    {
+      continue;
+    }
+    ContactList *list = &graph->contacts[search->rods[graph->heads[s]]];
+    graph->heads[s] += 1;
+    for (int j = 0; j < list->nbRods; j++)
+    {
+      int rodIndex = list->rods[j];
+      if (graph->marks[rodIndex] != graph->mark)
+      {
+        graph->marks[rodIndex] = graph->mark;
+        graph->labels[rodIndex] = s;
+        AddContact(search, rodIndex);
+      }
+      else
+      {
+        int other = FindRoot(graph->searchGroups, graph->labels[rodIndex]);
+        if (other != group)
+        {
+          graph->searchGroups[other] = group;
+        }
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Takes the rods found by the group's searches out of their old component
+// into a new one.
+void SplitSearchGroup(ContactGraph *graph, int group, int nbSearches, int oldRoot)
+{
+  for (int s = 0; s < nbSearches; s++)
+  {
+    if (FindRoot(graph->searchGroups, s) != group)
+    {
+      continue;
+    }
+    for (int i = 0; i < graph->searches[s].nbRods; i++)
+    {
+      int rodIndex = graph->searches[s].rods[i];
+      graph->sizes[oldRoot] -= 1;
+      graph->lengths[oldRoot] -= graph->rodGroup->rods[rodIndex].numericLength;
+      NewNode(graph, rodIndex);
+    }
+  }
+  for (int s = 0; s < nbSearches; s++)
+  {
+    if (FindRoot(graph->searchGroups, s) != group)
+    {
+      continue;
+    }
+    for (int i = 0; i < graph->searches[s].nbRods; i++)
+    {
+      int rodIndex = graph->searches[s].rods[i];
+      for (int j = 0; j < graph->contacts[rodIndex].nbRods; j++)
+      {
+        JoinComponents(graph, rodIndex, graph->contacts[rodIndex].rods[j]);
+      }
+    }
+  }
+}
+
+// Removes the rod's contacts. Its former neighbours may now lie in several
+// components: one search is started from each, interleaved, searches meeting
+// each other being merged. A group of searches running out of rods has found
+// a whole component, which is split off. The last group still running keeps
+// the old component, so the work is bounded by the smaller side of the split.
+void DetachRod(ContactGraph *graph, int rodIndex)
+{
+  ContactList *list = &graph->contacts[rodIndex];
+  for (int j = 0; j < list->nbRods; j++)
+  {
+    RemoveContact(&graph->contacts[list->rods[j]], rodIndex);
+  }
+
+  // Compacted once there are more ghosts than rods.
+  if (graph->nbNodes > 2 * graph->rodGroup->nbRods)
+  {
+    RebuildComponents(graph);
+  }
+  int oldRoot = FindRoot(graph->parents, graph->nodeOfRod[rodIndex]);
+  graph->sizes[oldRoot] -= 1;
+  graph->lengths[oldRoot] -= graph->rodGroup->rods[rodIndex].numericLength;
+  NewNode(graph, rodIndex);
+
+  int nbSearches = list->nbRods;
+  StartSearches(graph, list->rods, nbSearches);
+  list->nbRods = 0;
+  int nbGroups = nbSearches;
+  while (nbGroups > 1)
+  {
+    for (int s = 0; s < nbSearches; s++)
+    {
+      if (FindRoot(graph->searchGroups, s) == s && !StepSearchGroup(graph, s, nbSearches))
+      {
+        SplitSearchGroup(graph, s, nbSearches, oldRoot);
+        // Parked under the extra entry, it won't be stepped again.
+        graph->searchGroups[s] = nbSearches;
+      }
+    }
+    nbGroups = 0;
+    for (int s = 0; s < nbSearches; s++)
+    {
+      nbGroups += FindRoot(graph->searchGroups, s) == s;
+    }
+  }
+}
+
+// To call once the grid knows the rod's new place. Only the rod's contacts
+// are looked at, unless they changed and its old component may split.
+// Returns whether they changed.
+bool MoveRodInContacts(ContactGraph *graph, int rodIndex)
+{
+  const int *rods;
+  int nbTouching = QueryTouchingRods(graph, rodIndex, &rods);
+  ContactList *list = &graph->contacts[rodIndex];
+
+  bool same = nbTouching == list->nbRods;
+  if (same)
+  {
+    int mark = NextMark(graph);
+    for (int j = 0; j < list->nbRods; j++)
+    {
+      graph->marks[list->rods[j]] = mark;
+    }
+    for (int j = 0; j < nbTouching && same; j++)
+    {
+      same = graph->marks[rods[j]] == mark;
+    }
+  }
+  if (same)
+  {
+    return false;
+  }
+
+  // rods stays valid, the split doesn't query the grid.
+  DetachRod(graph, rodIndex);
+  for (int j = 0; j < nbTouching; j++)
+  {
+    AddContact(list, rods[j]);
+    AddContact(&graph->contacts[rods[j]], rodIndex);
+    JoinComponents(graph, rodIndex, rods[j]);
+  }
+  graph->nbChanges += 1;
+  return true;
+}
+
+// To call when the group was reallocated, to follow it and make room for
+// its new rods.
+void ResizeContactGraph(ContactGraph *graph, RodGroup *rodGroup)
+{
+  graph->rodGroup = rodGroup;
+  graph->contacts = realloc(graph->contacts, rodGroup->capacity * sizeof(ContactList));
+  graph->nodeOfRod = realloc(graph->nodeOfRod, rodGroup->capacity * sizeof(int));
+  graph->labels = realloc(graph->labels, rodGroup->capacity * sizeof(int));
+  graph->marks = realloc(graph->marks, rodGroup->capacity * sizeof(int));
+  for (int i = graph->rodCapacity; i < rodGroup->capacity; i++)
+  {
+    graph->contacts[i] = (ContactList){0, 0, NULL};
+    graph->marks[i] = 0;
+  }
+  graph->rodCapacity = rodGroup->capacity;
+}
+
+// For the rod appended to the group, once the grid knows it.
+void AddRodToContacts(ContactGraph *graph, int rodIndex)
+{
+  graph->contacts[rodIndex].nbRods = 0;
+  if (graph->nbNodes > 2 * graph->rodGroup->nbRods)
+  {
+    RebuildComponents(graph);
+  }
+  else
+  {
+    NewNode(graph, rodIndex);
+  }
+  MoveRodInContacts(graph, rodIndex);
+}
+
+// To call before the rod is removed from the group: its neighbours lose it,
+// which may split its component, and the last rod takes its index.
+void RemoveRodFromContacts(ContactGraph *graph, int rodIndex)
+{
+  if (graph->contacts[rodIndex].nbRods > 0)
+  {
+    DetachRod(graph, rodIndex);
+    graph->nbChanges += 1;
+  }
+  int lastRod = graph->rodGroup->nbRods - 1;
+  if (rodIndex == lastRod)
+  {
+    return;
+  }
+  ContactList *list = &graph->contacts[lastRod];
+  for (int j = 0; j < list->nbRods; j++)
+  {
+    ContactList *other = &graph->contacts[list->rods[j]];
+    for (int k = 0; k < other->nbRods; k++)
+    {
+      if (other->rods[k] == lastRod)
+      {
+        other->rods[k] = rodIndex;
+        break;
+      }
+    }
+  }
+  // Swapped, so that the removed rod's list is kept for the next rod.
+  ContactList removed = graph->contacts[rodIndex];
+  graph->contacts[rodIndex] = *list;
+  *list = removed;
+  graph->nodeOfRod[rodIndex] = graph->nodeOfRod[lastRod];
+}
+
+// Returns the number of rods touching the rod, their indices in rods.
+int GetContacts(ContactGraph *graph, int rodIndex, const int **rods)
+{
+  *rods = graph->contacts[rodIndex].rods;
+  return graph->contacts[rodIndex].nbRods;
+}
+
+int FindComponent(ContactGraph *graph, int rodIndex)
+{
+  return FindRoot(graph->parents, graph->nodeOfRod[rodIndex]);
+}
+
+int GetComponentSize(ContactGraph *graph, int rodIndex)
+{
+  return graph->sizes[FindComponent(graph, rodIndex)];
+}
+
+// Sum of the numeric lengths of the rods connected to this one, itself included.
+int GetComponentLength(ContactGraph *graph, int rodIndex)
+{
+  return graph->lengths[FindComponent(graph, rodIndex)];
+}
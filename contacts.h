@@ -0,0 +1,59 @@
+#ifndef CONTACTS_H
+#define CONTACTS_H
+
+#include "rods.h"
+#include "grid.h"
+#include "pool.h"
+
+typedef struct ContactList
+{
+  int nbRods;
+  int capacity;
+  int *rods;
+} ContactList;
+
+// Which rods touch (SoftlyCollide), kept up to date one moved rod at a time.
+// Components are held in a union-find, with the size and the total length
+// of each component stored at its root. Union-find can't split, so a rod
+// leaving its component takes a fresh node and its old one stays behind as a
+// ghost, still linking the others; nodes are compacted when they run out.
+typedef struct ContactGraph
+{
+  RodGroup *rodGroup;
+  RodGrid *grid;
+  // Rods the arrays below have room for. The lists past the last rod keep
+  // their memory for the next rods.
+  int rodCapacity;
+  ContactList *contacts;
+  int *nodeOfRod;
+  int nbNodes;
+  int nodeCapacity;
+  int *parents;
+  int *sizes;
+  int *lengths;
+  // Incremented each time a rod gains or loses a contact.
+  int nbChanges;
+  // Scratch for the splits: one search per former neighbour of the moved
+  // rod, the search each rod was reached by, and a union-find over searches
+  // with an extra entry holding the finished ones.
+  int nbSearches;
+  ContactList *searches;
+  int *heads;
+  int *searchGroups;
+  int *labels;
+  int *marks;
+  int mark;
+} ContactGraph;
+
+ContactGraph *NewContactGraph(RodGroup *rodGroup, RodGrid *grid, WorkerPool *pool);
+void FreeContactGraph(ContactGraph *graph);
+void ResizeContactGraph(ContactGraph *graph, RodGroup *rodGroup);
+bool MoveRodInContacts(ContactGraph *graph, int rodIndex);
+void AddRodToContacts(ContactGraph *graph, int rodIndex);
+void RemoveRodFromContacts(ContactGraph *graph, int rodIndex);
+int GetContacts(ContactGraph *graph, int rodIndex, const int **rods);
+int FindComponent(ContactGraph *graph, int rodIndex);
+int GetComponentSize(ContactGraph *graph, int rodIndex);
+int GetComponentLength(ContactGraph *graph, int rodIndex);
+
+#endif
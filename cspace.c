@@ -0,0 +1,173 @@
+#include "cspace.h"
+#include "bitboard.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+CSpaceMap *NewCSpaceMap(RodGroup *rodGroup, RodGrid *grid, int originX, int originY, int width, int height)
+{
+  CSpaceMap *map = malloc(sizeof(CSpaceMap));
+  map->rodGroup = rodGroup;
+  map->grid = grid;
+  map->originX = originX;
+  map->originY = originY;
+  map->width = width;
+  map->height = height;
+  map->wordsPerRow = (width + 63) / 64;
+  map->rows = malloc((size_t)map->wordsPerRow * height * sizeof(uint64_t));
+  map->nbTileRows = (height + CSPACE_TILE - 1) / CSPACE_TILE;
+  map->tileStamps = calloc((size_t)map->wordsPerRow * map->nbTileRows, sizeof(int));
+  map->stamp = 0;
+  map->rodIndex = -1;
+  map->scratch = malloc(map->wordsPerRow * sizeof(uint64_t));
+  return map;
+}
+
+void FreeCSpaceMap(CSpaceMap *map)
+{
+  if (map == NULL)
+  {
+    return;
+  }
+  free(map->rows);
+  free(map->tileStamps);
+  free(map->scratch);
+  free(map);
+}
+
+// Forgets every tile: the map now stands for this rod among the others as
+// they are now.
+void PickUpInCSpace(CSpaceMap *map, int rodIndex)
+{
+  map->rodIndex = rodIndex;
+  map->stamp += 1;
+  if (map->stamp == 0)
+  {
+    memset(map->tileStamps, 0, (size_t)map->wordsPerRow * map->nbTileRows * sizeof(int));
+    map->stamp = 1;
+  }
+}
+
+// Sets the bits of the positions [first, last) x [firstRow, lastRow) lying in
+// the tile whose first word and row are given.
+void BlockInTile(CSpaceMap *map, int w, int tileRow, int first, int last, int firstRow, int lastRow)
+{
+  firstRow = firstRow < tileRow ? tileRow : firstRow;
+  lastRow = lastRow > tileRow + CSPACE_TILE ? tileRow + CSPACE_TILE : lastRow;
+  lastRow = lastRow > map->height ? map->height : lastRow;
+  if (first >= last || first >= (w + 1) * 64 || last <= w * 64)
+  {
+    return;
+  }
+  uint64_t mask = SpanMask(w, first, last);
+  for (int row = firstRow; row < lastRow; row++)
+  {
+    map->rows[(size_t)row * map->wordsPerRow + w] |= mask;
+  }
+}
+
+void BuildTile(CSpaceMap *map, int w, int tileRow)
+{
+  Rod rod = map->rodGroup->rods[map->rodIndex];
+  int rodWidth = rod.rect.width;
+  int rodHeight = rod.rect.height;
+  int lastRow = tileRow + CSPACE_TILE > map->height ? map->height : tileRow + CSPACE_TILE;
+  for (int row = tileRow; row < lastRow; row++)
+  {
+    map->rows[(size_t)row * map->wordsPerRow + w] = 0;
+  }
+
+  // The rod leaving the map.
+  BlockInTile(map, w, tileRow, map->width - rodWidth + 1, map->width, 0, map->height);
+  BlockInTile(map, w, tileRow, 0, map->width, map->height - rodHeight + 1, map->height);
+
+  // Rods the dragged rod may hit from a position of the tile: the blocked
+  // positions x are other left - rodWidth < x < other right, alike on y.
+  Rectangle area = {map->originX + w * 64, map->originY + tileRow, 64 + rodWidth - 1, CSPACE_TILE + rodHeight - 1};
+  const int *rods;
+  int nbRods = QueryRodGrid(map->grid, area, &rods);
+  for (int i = 0; i < nbRods; i++)
+  {
+    if (rods[i] == map->rodIndex)
+    {
+      continue;
+    }
+    Rectangle other = map->rodGroup->rods[rods[i]].rect;
+    int first = (int)other.x - rodWidth + 1 - map->originX;
+    int last = (int)(other.x + other.width) - map->originX;
+    int firstRow = (int)other.y - rodHeight + 1 - map->originY;
+    int lastRow = (int)(other.y + other.height) - map->originY;
+    BlockInTile(map, w, tileRow, first < 0 ? 0 : first, last > map->width ? map->width : last, firstRow < 0 ? 0 : firstRow, lastRow);
+  }
+  map->tileStamps[(tileRow / CSPACE_TILE) * map->wordsPerRow + w] = map->stamp;
+}
+
+uint64_t GetCSpaceWord(CSpaceMap *map, int w, int row)
+{
+  int tileRow = row - row % CSPACE_TILE;
+  if (map->tileStamps[(tileRow / CSPACE_TILE) * map->wordsPerRow + w] != map->stamp)
+  {
+    BuildTile(map, w, tileRow);
+  }
+  return map->rows[(size_t)row * map->wordsPerRow + w];
+}
+
+// Positions are those of the rod's top left corner, in tablet pixels.
+bool IsCSpaceFree(CSpaceMap *map, int x, int y)
+{
+  int bx = x - map->originX;
+  int by = y - map->originY;
+  if (bx < 0 || bx >= map->width || by < 0 || by >= map->height)
+  {
+    return false;
+  }
+  return !(GetCSpaceWord(map, bx / 64, by) & (1ull << (bx % 64)));
+}
+
+// Same search as NearestFreePosition on a bitboard, but each row of the map
+// already tells where the rod fits: one word read and one bit scan per row.
+bool NearestFreeInCSpace(CSpaceMap *map, int targetX, int targetY, int maxDistSqr, int *x, int *y)
+{
+  int bx = targetX - map->originX;
+  int by = targetY - map->originY;
+  int bestDistSqr = maxDistSqr;
+  bool found = false;
+
+  for (int dy = 0; dy * dy < bestDistSqr; dy = dy > 0 ? -dy : -dy + 1)
+  {
+    int row = by + dy;
+    if (row < 0 || row >= map->height)
+    {
+      continue;
+    }
+    int reach = ceil(sqrt(bestDistSqr - dy * dy));
+    int firstX = bx - reach < 0 ? 0 : bx - reach;
+    int lastX = bx + reach + 1 > map->width ? map->width : bx + reach + 1;
+    if (firstX >= lastX)
+    {
+      continue;
+    }
+    int firstWord = firstX / 64;
+    int lastWord = (lastX - 1) / 64;
+    for (int w = firstWord; w <= lastWord; w++)
+    {
+      map->scratch[w] = ~GetCSpaceWord(map, w, row) & SpanMask(w, firstX, lastX);
+    }
+
+    int clampedX = bx < firstX ? firstX : (bx >= lastX ? lastX - 1 : bx);
+    int freeX = NearestSetBit(map->scratch, firstWord, lastWord, clampedX);
+    if (freeX == -1)
+    {
+      continue;
+    }
+    int distSqr = (freeX - bx) * (freeX - bx) + dy * dy;
+    if (distSqr < bestDistSqr)
+    {
+      bestDistSqr = distSqr;
+      *x = freeX + map->originX;
+      *y = row + map->originY;
+      found = true;
+    }
+  }
+  return found;
+}
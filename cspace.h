@@ -0,0 +1,41 @@
+#ifndef CSPACE_H
+#define CSPACE_H
+
+#include <stdint.h>
+#include "rods.h"
+#include "grid.h"
+
+// Tiles of the map are CSPACE_TILE rows of one 64 bit word.
+#define CSPACE_TILE 64
+
+// Configuration space of one dragged rod: bit x of row y is set when putting
+// the rod's top left corner on pixel (originX + x, originY + y) would make it
+// collide, that is when the pixel lies in the Minkowski sum of another rod
+// and the dragged rod's extent, or when the rod would leave the map. The
+// other rods don't move during a drag, so the map holds until the next
+// pickup; its tiles are filled the first time a query reaches them.
+typedef struct CSpaceMap
+{
+  RodGroup *rodGroup;
+  RodGrid *grid;
+  int originX;
+  int originY;
+  int width;
+  int height;
+  int wordsPerRow;
+  uint64_t *rows;
+  int nbTileRows;
+  int *tileStamps;
+  int stamp;
+  // The rod the map was built for, -1 when out of date.
+  int rodIndex;
+  uint64_t *scratch;
+} CSpaceMap;
+
+CSpaceMap *NewCSpaceMap(RodGroup *rodGroup, RodGrid *grid, int originX, int originY, int width, int height);
+void FreeCSpaceMap(CSpaceMap *map);
+void PickUpInCSpace(CSpaceMap *map, int rodIndex);
+bool IsCSpaceFree(CSpaceMap *map, int x, int y);
+bool NearestFreeInCSpace(CSpaceMap *map, int targetX, int targetY, int maxDistSqr, int *x, int *y);
+
+#endif
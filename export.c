@@ -0,0 +1,327 @@
+#include "export.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CURSOR_RADIUS 5
+
+size_t GetRgbSize(FrameExporter *exporter)
+{
+  return (size_t)exporter->width * exporter->height * 3;
+}
+
+size_t GetImageSize(FrameExporter *exporter)
+{
+  if (exporter->format == Y4M_STREAM)
+  {
+    size_t chromaSize = (size_t)((exporter->width + 1) / 2) * ((exporter->height + 1) / 2);
+    return (size_t)exporter->width * exporter->height + 2 * chromaSize;
+  }
+  return GetRgbSize(exporter);
+}
+
+ExportFormat GetExportFormat(const char *fileName)
+{
+  size_t len = strlen(fileName);
+  if (len >= 4 && strcmp(fileName + len - 4, ".y4m") == 0)
+  {
+    return Y4M_STREAM;
+  }
+  return strchr(fileName, '%') != NULL ? PPM_FILES : PPM_STREAM;
+}
+
+FrameExporter *NewFrameExporter(const char *fileName, int width, int height, int frameRate, WorkerPool *pool)
+{
+  FrameExporter *exporter = calloc(1, sizeof(FrameExporter));
+  exporter->format = GetExportFormat(fileName);
+  exporter->fileName = strdup(fileName);
+  exporter->width = width;
+  exporter->height = height;
+  exporter->frameRate = frameRate;
+  exporter->pool = pool;
+  if (exporter->format != PPM_FILES)
+  {
+    exporter->file = fopen(fileName, "wb");
+    if (exporter->file == NULL)
+    {
+      fprintf(stderr, "Couldn't write the frames to %s.\n", fileName);
+      free(exporter->fileName);
+      free(exporter);
+      return NULL;
+    }
+  }
+  if (exporter->format == Y4M_STREAM)
+  {
+    fprintf(exporter->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, frameRate);
+    exporter->nbScratches = GetPoolThreadCount(pool);
+    exporter->scratches = malloc(exporter->nbScratches * sizeof(unsigned char *));
+    for (int i = 0; i < exporter->nbScratches; i++)
+    {
+      exporter->scratches[i] = malloc(GetRgbSize(exporter));
+    }
+  }
+  return exporter;
+}
+
+// Rectangles cover the pixels whose centre they contain, as raylib draws them.
+void FillPixels(FrameExporter *exporter, unsigned char *pixels, float left, float top, float right, float bottom,
+                Color color)
+{
+  int x0 = fmaxf(lroundf(left), 0);
+  int y0 = fmaxf(lroundf(top), 0);
+  int x1 = fminf(lroundf(right), exporter->width);
+  int y1 = fminf(lroundf(bottom), exporter->height);
+  for (int y = y0; y < y1; y++)
+  {
+    unsigned char *pixel = pixels + ((size_t)y * exporter->width + x0) * 3;
+    for (int x = x0; x < x1; x++)
+    {
+      pixel[0] = color.r;
+      pixel[1] = color.g;
+      pixel[2] = color.b;
+      pixel += 3;
+    }
+  }
+}
+
+// A rod as the app draws it: filled with its colour, with a black outline
+// one pixel wide on the inside.
+void RasterizeRod(FrameExporter *exporter, unsigned char *pixels, Rod rod)
+{
+  Rectangle r = rod.rect;
+  FillPixels(exporter, pixels, r.x, r.y, r.x + r.width, r.y + r.height, BLACK);
+  FillPixels(exporter, pixels, r.x + 1, r.y + 1, r.x + r.width - 1, r.y + r.height - 1, GetRodColor(rod));
+}
+
+void RasterizeCursor(FrameExporter *exporter, unsigned char *pixels, Vector2 cursor)
+{
+  int y0 = fmaxf(floorf(cursor.y - CURSOR_RADIUS), 0);
+  int y1 = fminf(ceilf(cursor.y + CURSOR_RADIUS), exporter->height);
+  int x0 = fmaxf(floorf(cursor.x - CURSOR_RADIUS), 0);
+  int x1 = fminf(ceilf(cursor.x + CURSOR_RADIUS), exporter->width);
+  for (int y = y0; y < y1; y++)
+  {
+    for (int x = x0; x < x1; x++)
+    {
+      float dx = x + 0.5 - cursor.x;
+      float dy = y + 0.5 - cursor.y;
+      if (dx * dx + dy * dy <= CURSOR_RADIUS * CURSOR_RADIUS)
+      {
+        unsigned char *pixel = pixels + ((size_t)y * exporter->width + x) * 3;
+        pixel[0] = RED.r;
+        pixel[1] = RED.g;
+        pixel[2] = RED.b;
+      }
+    }
+  }
+}
+
+void RasterizeSnapshot(FrameExporter *exporter, FrameSnapshot *snapshot, unsigned char *pixels)
+{
+  FillPixels(exporter, pixels, 0, 0, exporter->width, exporter->height, RAYWHITE);
+  for (int i = 0; i < snapshot->nbRods; i++)
+  {
+    RasterizeRod(exporter, pixels, snapshot->rods[i]);
+  }
+  if (snapshot->showCursor)
+  {
+    RasterizeCursor(exporter, pixels, snapshot->cursor);
+  }
+}
+
+unsigned char ClampToByte(int value)
+{
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+// Full range BT.601, as in JPEG, in 16 bit fixed point, the chroma averaged
+// over 2x2 pixels.
+void ConvertToYuv420(FrameExporter *exporter, const unsigned char *rgb, unsigned char *yuv)
+{
+  int width = exporter->width;
+  int height = exporter->height;
+  int chromaWidth = (width + 1) / 2;
+  int chromaHeight = (height + 1) / 2;
+  unsigned char *luma = yuv;
+  unsigned char *cb = luma + (size_t)width * height;
+  unsigned char *cr = cb + (size_t)chromaWidth * chromaHeight;
+  for (size_t i = 0; i < (size_t)width * height; i++)
+  {
+    const unsigned char *p = rgb + i * 3;
+    luma[i] = (19595 * p[0] + 38470 * p[1] + 7471 * p[2] + 32768) >> 16;
+  }
+  for (int cy = 0; cy < chromaHeight; cy++)
+  {
+    for (int cx = 0; cx < chromaWidth; cx++)
+    {
+      int r = 0, g = 0, b = 0;
+      int nbPixels = 0;
+      for (int y = 2 * cy; y < 2 * cy + 2 && y < height; y++)
+      {
+        for (int x = 2 * cx; x < 2 * cx + 2 && x < width; x++)
+        {
+          const unsigned char *p = rgb + ((size_t)y * width + x) * 3;
+          r += p[0];
+          g += p[1];
+          b += p[2];
+          nbPixels += 1;
+        }
+      }
+      r = (r + nbPixels / 2) / nbPixels;
+      g = (g + nbPixels / 2) / nbPixels;
+      b = (b + nbPixels / 2) / nbPixels;
+      cb[cy * chromaWidth + cx] = ClampToByte(128 + ((-11059 * r - 21709 * g + 32768 * b + 32768) >> 16));
+      cr[cy * chromaWidth + cx] = ClampToByte(128 + ((32768 * r - 27439 * g - 5329 * b + 32768) >> 16));
+    }
+  }
+}
+
+void RenderSnapshot(void *context, int tile, int worker)
+{
+  FrameExporter *exporter = context;
+  FrameSnapshot *snapshot = &exporter->snapshots[tile];
+  if (snapshot->image == NULL)
+  {
+    snapshot->image = malloc(GetImageSize(exporter));
+  }
+  if (exporter->format == Y4M_STREAM)
+  {
+    RasterizeSnapshot(exporter, snapshot, exporter->scratches[worker]);
+    ConvertToYuv420(exporter, exporter->scratches[worker], snapshot->image);
+  }
+  else
+  {
+    RasterizeSnapshot(exporter, snapshot, snapshot->image);
+  }
+}
+
+void WriteFrame(FrameExporter *exporter, const unsigned char *image)
+{
+  switch (exporter->format)
+  {
+  case PPM_STREAM:
+    fprintf(exporter->file, "P6\n%d %d\n255\n", exporter->width, exporter->height);
+    fwrite(image, 1, GetImageSize(exporter), exporter->file);
+    break;
+  case PPM_FILES:
+  {
+    char fileName[FILENAME_MAX];
+    snprintf(fileName, FILENAME_MAX, exporter->fileName, (int)exporter->nbFramesWritten);
+    FILE *file = fopen(fileName, "wb");
+    if (file == NULL)
+    {
+      fprintf(stderr, "Couldn't write the frame %s.\n", fileName);
+      break;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", exporter->width, exporter->height);
+    fwrite(image, 1, GetImageSize(exporter), file);
+    fclose(file);
+    break;
+  }
+  case Y4M_STREAM:
+    fputs("FRAME\n", exporter->file);
+    fwrite(image, 1, GetImageSize(exporter), exporter->file);
+    break;
+  }
+  exporter->nbFramesWritten += 1;
+}
+
+// Renders every snapshot of the batch, each once however many frames show it.
+void FlushFrames(FrameExporter *exporter)
+{
+  RunTiles(exporter->pool, exporter->nbSnapshots, RenderSnapshot, exporter);
+  for (int i = 0; i < exporter->nbFrames; i++)
+  {
+    WriteFrame(exporter, exporter->snapshots[exporter->frames[i]].image);
+  }
+  exporter->nbSnapshots = 0;
+  exporter->nbFrames = 0;
+}
+
+void AddFrame(FrameExporter *exporter, int snapshotId)
+{
+  if (exporter->nbFrames == exporter->framesCapacity)
+  {
+    exporter->framesCapacity = exporter->framesCapacity == 0 ? 256 : 2 * exporter->framesCapacity;
+    exporter->frames = realloc(exporter->frames, exporter->framesCapacity * sizeof(int));
+  }
+  exporter->frames[exporter->nbFrames] = snapshotId;
+  exporter->nbFrames += 1;
+}
+
+bool IsSnapshotShown(FrameExporter *exporter, int snapshotId)
+{
+  return exporter->nbFrames > 0 && exporter->frames[exporter->nbFrames - 1] == snapshotId;
+}
+
+void TakeSnapshot(FrameSnapshot *snapshot, const RodGroup *rodGroup, bool showCursor, Vector2 cursor)
+{
+  if (snapshot->capacity < rodGroup->nbRods)
+  {
+    snapshot->capacity = rodGroup->nbRods;
+    snapshot->rods = realloc(snapshot->rods, snapshot->capacity * sizeof(Rod));
+  }
+  memcpy(snapshot->rods, rodGroup->rods, rodGroup->nbRods * sizeof(Rod));
+  snapshot->nbRods = rodGroup->nbRods;
+  snapshot->showCursor = showCursor;
+  snapshot->cursor = cursor;
+}
+
+// The current snapshot is shown by the frames due before time, then the
+// state at time becomes the current snapshot. A snapshot that no frame showed
+// is simply replaced.
+void ExportFrames(FrameExporter *exporter, double time, const RodGroup *rodGroup, bool showCursor, Vector2 cursor)
+{
+  if (!exporter->started)
+  {
+    exporter->started = true;
+    exporter->startTime = time;
+  }
+  else
+  {
+    int current = exporter->nbSnapshots - 1;
+    while (exporter->startTime + (double)(exporter->nbFramesWritten + exporter->nbFrames) / exporter->frameRate < time)
+    {
+      AddFrame(exporter, current);
+    }
+  }
+  if (exporter->nbSnapshots == 0 || IsSnapshotShown(exporter, exporter->nbSnapshots - 1))
+  {
+    if (exporter->nbSnapshots == EXPORT_BATCH)
+    {
+      FlushFrames(exporter);
+    }
+    exporter->nbSnapshots += 1;
+  }
+  TakeSnapshot(&exporter->snapshots[exporter->nbSnapshots - 1], rodGroup, showCursor, cursor);
+}
+
+// The last snapshot gets a frame of its own, so that the video ends on it.
+// Returns the number of frames written.
+long CloseFrameExporter(FrameExporter *exporter)
+{
+  if (exporter->nbSnapshots > 0 && !IsSnapshotShown(exporter, exporter->nbSnapshots - 1))
+  {
+    AddFrame(exporter, exporter->nbSnapshots - 1);
+  }
+  FlushFrames(exporter);
+  if (exporter->file != NULL)
+  {
+    fclose(exporter->file);
+  }
+  for (int i = 0; i < EXPORT_BATCH; i++)
+  {
+    free(exporter->snapshots[i].rods);
+    free(exporter->snapshots[i].image);
+  }
+  for (int i = 0; i < exporter->nbScratches; i++)
+  {
+    free(exporter->scratches[i]);
+  }
+  free(exporter->scratches);
+  free(exporter->frames);
+  free(exporter->fileName);
+  long nbFramesWritten = exporter->nbFramesWritten;
+  free(exporter);
+  return nbFramesWritten;
+}
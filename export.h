@@ -0,0 +1,68 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "rods.h"
+#include "pool.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// Snapshots rendered together, across the threads of the pool. Each one
+// keeps its image, a couple of megabytes at the size of the tablet.
+#define EXPORT_BATCH 32
+
+typedef enum ExportFormat
+{
+  // PPM images one after the other, as ffmpeg's image2pipe reads them.
+  PPM_STREAM,
+  // One PPM file per frame, the file name being a printf pattern of the frame
+  // number, e.g. frames/%05d.ppm.
+  PPM_FILES,
+  // Uncompressed 4:2:0 video.
+  Y4M_STREAM,
+} ExportFormat;
+
+// The rods and the cursor dot at some point of the replay.
+typedef struct FrameSnapshot
+{
+  int nbRods;
+  int capacity;
+  Rod *rods;
+  bool showCursor;
+  Vector2 cursor;
+  // The snapshot rasterized, in the format's pixel layout.
+  unsigned char *image;
+} FrameSnapshot;
+
+// Writes the frames of a replay at a steady frame rate, each snapshot lasting
+// until the next one. The snapshots are rasterized in software by batches,
+// across the threads of the pool, and the frames written in order.
+typedef struct FrameExporter
+{
+  ExportFormat format;
+  char *fileName;
+  FILE *file;
+  int width;
+  int height;
+  int frameRate;
+  WorkerPool *pool;
+  bool started;
+  // Time of the first frame, frame k being shown at startTime + k / frameRate.
+  double startTime;
+  // The last snapshot is the current one, which may not have frames yet.
+  int nbSnapshots;
+  FrameSnapshot snapshots[EXPORT_BATCH];
+  // The snapshot shown by each frame of the batch.
+  int nbFrames;
+  int framesCapacity;
+  int *frames;
+  long nbFramesWritten;
+  // An RGB image per thread, for the formats that aren't RGB.
+  int nbScratches;
+  unsigned char **scratches;
+} FrameExporter;
+
+FrameExporter *NewFrameExporter(const char *fileName, int width, int height, int frameRate, WorkerPool *pool);
+void ExportFrames(FrameExporter *exporter, double time, const RodGroup *rodGroup, bool showCursor, Vector2 cursor);
+long CloseFrameExporter(FrameExporter *exporter);
+
+#endif
@@ -0,0 +1,255 @@
+#include "grid.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+int ClampCell(int cell, int nbCells)
+{
+  const int t = cell < 0 ? 0 : cell;
+  return t >= nbCells ? nbCells - 1 : t;
+}
+
+CellRange GetCellRange(RodGrid *grid, Rectangle area)
+{
+  return (CellRange){
+      .firstColumn = ClampCell(floorf(area.x / grid->cellWidth), grid->nbColumns),
+      .lastColumn = ClampCell(floorf((area.x + area.width) / grid->cellWidth), grid->nbColumns),
+      .firstRow = ClampCell(floorf(area.y / grid->cellHeight), grid->nbRows),
+      .lastRow = ClampCell(floorf((area.y + area.height) / grid->cellHeight), grid->nbRows)};
+}
+
+RodCell *GetCell(RodGrid *grid, int column, int row)
+{
+  return &grid->cells[row * grid->nbColumns + column];
+}
+
+void AddToCell(RodCell *cell, int rodIndex)
+{
+  if (cell->nbRods == cell->capacity)
+  {
+    cell->capacity = cell->capacity == 0 ? 4 : 2 * cell->capacity;
+    cell->rods = realloc(cell->rods, cell->capacity * sizeof(int));
+  }
+  cell->rods[cell->nbRods] = rodIndex;
+  cell->nbRods += 1;
+}
+
+void RemoveFromCell(RodCell *cell, int rodIndex)
+{
+  for (int i = 0; i < cell->nbRods; i++)
+  {
+    if (cell->rods[i] == rodIndex)
+    {
+      cell->nbRods -= 1;
+      cell->rods[i] = cell->rods[cell->nbRods];
+      return;
+    }
+  }
+}
+
+void AddToCells(RodGrid *grid, CellRange range, int rodIndex)
+{
+  for (int row = range.firstRow; row <= range.lastRow; row++)
+  {
+    for (int column = range.firstColumn; column <= range.lastColumn; column++)
+    {
+      AddToCell(GetCell(grid, column, row), rodIndex);
+    }
+  }
+}
+
+void RemoveFromCells(RodGrid *grid, CellRange range, int rodIndex)
+{
+  for (int row = range.firstRow; row <= range.lastRow; row++)
+  {
+    for (int column = range.firstColumn; column <= range.lastColumn; column++)
+    {
+      RemoveFromCell(GetCell(grid, column, row), rodIndex);
+    }
+  }
+}
+
+RodGrid *NewRodGrid(RodGroup *rodGroup, float width, float height, float cellWidth, float cellHeight)
+{
+  RodGrid *grid = malloc(sizeof(RodGrid));
+  grid->cellWidth = cellWidth;
+  grid->cellHeight = cellHeight;
+  grid->nbColumns = ceilf(width / cellWidth);
+  grid->nbRows = ceilf(height / cellHeight);
+  grid->cells = calloc(grid->nbColumns * grid->nbRows, sizeof(RodCell));
+  grid->nbRods = rodGroup->nbRods;
+  grid->rodCapacity = rodGroup->capacity;
+  grid->ranges = malloc(rodGroup->capacity * sizeof(CellRange));
+  grid->marks = calloc(rodGroup->capacity, sizeof(int));
+  grid->mark = 0;
+  grid->found = malloc(rodGroup->capacity * sizeof(int));
+
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    grid->ranges[i] = GetCellRange(grid, rodGroup->rods[i].rect);
+    AddToCells(grid, grid->ranges[i], i);
+  }
+  return grid;
+}
+
+void FreeRodGrid(RodGrid *grid)
+{
+  if (grid == NULL)
+  {
+    return;
+  }
+  for (int i = 0; i < grid->nbColumns * grid->nbRows; i++)
+  {
+    free(grid->cells[i].rods);
+  }
+  free(grid->cells);
+  free(grid->ranges);
+  free(grid->marks);
+  free(grid->found);
+  free(grid);
+}
+
+// Makes room for more rods, once the group has grown.
+void ResizeRodGrid(RodGrid *grid, int rodCapacity)
+{
+  grid->ranges = realloc(grid->ranges, rodCapacity * sizeof(CellRange));
+  grid->marks = realloc(grid->marks, rodCapacity * sizeof(int));
+  memset(&grid->marks[grid->rodCapacity], 0, (rodCapacity - grid->rodCapacity) * sizeof(int));
+  grid->found = realloc(grid->found, rodCapacity * sizeof(int));
+  grid->rodCapacity = rodCapacity;
+}
+
+void MoveRodInGrid(RodGrid *grid, RodGroup *rodGroup, int rodIndex)
+{
+  CellRange oldRange = grid->ranges[rodIndex];
+  CellRange newRange = GetCellRange(grid, rodGroup->rods[rodIndex].rect);
+  if (memcmp(&oldRange, &newRange, sizeof(CellRange)) == 0)
+  {
+    return;
+  }
+  RemoveFromCells(grid, oldRange, rodIndex);
+  AddToCells(grid, newRange, rodIndex);
+  grid->ranges[rodIndex] = newRange;
+}
+
+// For the rod appended to the group.
+void AddRodToGrid(RodGrid *grid, RodGroup *rodGroup, int rodIndex)
+{
+  grid->ranges[rodIndex] = GetCellRange(grid, rodGroup->rods[rodIndex].rect);
+  AddToCells(grid, grid->ranges[rodIndex], rodIndex);
+  grid->nbRods += 1;
+}
+
+// The last rod takes the index of the removed one, as in the group.
+void RemoveRodFromGrid(RodGrid *grid, int rodIndex)
+{
+  RemoveFromCells(grid, grid->ranges[rodIndex], rodIndex);
+  grid->nbRods -= 1;
+  int lastRod = grid->nbRods;
+  if (rodIndex == lastRod)
+  {
+    return;
+  }
+  CellRange range = grid->ranges[lastRod];
+  for (int row = range.firstRow; row <= range.lastRow; row++)
+  {
+    for (int column = range.firstColumn; column <= range.lastColumn; column++)
+    {
+      RodCell *cell = GetCell(grid, column, row);
+      for (int i = 0; i < cell->nbRods; i++)
+      {
+        if (cell->rods[i] == lastRod)
+        {
+          cell->rods[i] = rodIndex;
+          break;
+        }
+      }
+    }
+  }
+  grid->ranges[rodIndex] = range;
+}
+
+// Returns the number of rods whose cells overlap the area. The indices are
+// written in a buffer owned by the grid, valid until the next query.
+int QueryRodGrid(RodGrid *grid, Rectangle area, const int **rods)
+{
+  grid->mark += 1;
+  if (grid->mark == 0)
+  {
+    memset(grid->marks, 0, grid->rodCapacity * sizeof(int));
+    grid->mark = 1;
+  }
+
+  int nbFound = 0;
+  CellRange range = GetCellRange(grid, area);
+  for (int row = range.firstRow; row <= range.lastRow; row++)
+  {
+    for (int column = range.firstColumn; column <= range.lastColumn; column++)
+    {
+      RodCell *cell = GetCell(grid, column, row);
+      for (int i = 0; i < cell->nbRods; i++)
+      {
+        int rodIndex = cell->rods[i];
+        if (grid->marks[rodIndex] != grid->mark)
+        {
+          grid->marks[rodIndex] = grid->mark;
+          grid->found[nbFound] = rodIndex;
+          nbFound += 1;
+        }
+      }
+    }
+  }
+  *rods = grid->found;
+  return nbFound;
+}
+
+// Same rods as QueryRodGrid, in the same order, appended to a list of the
+// caller. Instead of being marked, each rod is reported in the first cell
+// shared by the area and the rod, so threads may query the grid at the same
+// time as long as no rod moves.
+void AppendRodsInArea(RodGrid *grid, Rectangle area, RodList *list)
+{
+  CellRange range = GetCellRange(grid, area);
+  for (int row = range.firstRow; row <= range.lastRow; row++)
+  {
+    for (int column = range.firstColumn; column <= range.lastColumn; column++)
+    {
+      RodCell *cell = GetCell(grid, column, row);
+      for (int i = 0; i < cell->nbRods; i++)
+      {
+        int rodIndex = cell->rods[i];
+        CellRange rodRange = grid->ranges[rodIndex];
+        int firstRow = rodRange.firstRow > range.firstRow ? rodRange.firstRow : range.firstRow;
+        int firstColumn = rodRange.firstColumn > range.firstColumn ? rodRange.firstColumn : range.firstColumn;
+        if (row != firstRow || column != firstColumn)
+        {
+          continue;
+        }
+        if (list->nbRods == list->capacity)
+        {
+          list->capacity = list->capacity == 0 ? 16 : 2 * list->capacity;
+          list->rods = realloc(list->rods, list->capacity * sizeof(int));
+        }
+        list->rods[list->nbRods] = rodIndex;
+        list->nbRods += 1;
+      }
+    }
+  }
+}
+
+// Same rod as a linear scan would pick: the first one in the group under the point.
+int PickRodInGrid(RodGrid *grid, RodGroup *rodGroup, Vector2 point)
+{
+  CellRange range = GetCellRange(grid, (Rectangle){point.x, point.y, 0, 0});
+  RodCell *cell = GetCell(grid, range.firstColumn, range.firstRow);
+  int picked = -1;
+  for (int i = 0; i < cell->nbRods; i++)
+  {
+    int rodIndex = cell->rods[i];
+    if ((picked == -1 || rodIndex < picked) && CheckCollisionPointRec(point, rodGroup->rods[rodIndex].rect))
+    {
+      picked = rodIndex;
+    }
+  }
+  return picked;
+}
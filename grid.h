@@ -0,0 +1,58 @@
+#ifndef GRID_H
+#define GRID_H
+
+#include "rods.h"
+
+typedef struct RodCell
+{
+  int nbRods;
+  int capacity;
+  int *rods;
+} RodCell;
+
+typedef struct RodList
+{
+  int nbRods;
+  int capacity;
+  int *rods;
+} RodList;
+
+typedef struct CellRange
+{
+  int firstColumn;
+  int lastColumn;
+  int firstRow;
+  int lastRow;
+} CellRange;
+
+// Uniform grid over the tablet. Each cell lists the indices of the rods
+// overlapping it; rods lying outside the tablet are kept in the border cells.
+typedef struct RodGrid
+{
+  int nbColumns;
+  int nbRows;
+  float cellWidth;
+  float cellHeight;
+  RodCell *cells;
+  int nbRods;
+  // Rods the arrays below have room for.
+  int rodCapacity;
+  // Cells currently covered by each rod, so that moving it only touches those.
+  CellRange *ranges;
+  // Used to report each rod once per query even when it spans several cells.
+  int *marks;
+  int mark;
+  int *found;
+} RodGrid;
+
+RodGrid *NewRodGrid(RodGroup *rodGroup, float width, float height, float cellWidth, float cellHeight);
+void FreeRodGrid(RodGrid *grid);
+void ResizeRodGrid(RodGrid *grid, int rodCapacity);
+void MoveRodInGrid(RodGrid *grid, RodGroup *rodGroup, int rodIndex);
+void AddRodToGrid(RodGrid *grid, RodGroup *rodGroup, int rodIndex);
+void RemoveRodFromGrid(RodGrid *grid, int rodIndex);
+int QueryRodGrid(RodGrid *grid, Rectangle area, const int **rods);
+void AppendRodsInArea(RodGrid *grid, Rectangle area, RodList *list);
+int PickRodInGrid(RodGrid *grid, RodGroup *rodGroup, Vector2 point);
+
+#endif
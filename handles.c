@@ -0,0 +1,163 @@
+#include "handles.h"
+#include <stdlib.h>
+
+RodHandleTable *NewRodHandleTable(void)
+{
+  RodHandleTable *table = malloc(sizeof(RodHandleTable));
+  table->nbIds = 0;
+  table->idCapacity = 0;
+  table->rodOfId = NULL;
+  table->generations = NULL;
+  table->nbFreeIds = 0;
+  table->freeIds = NULL;
+  table->nbRods = 0;
+  table->rodCapacity = 0;
+  table->idOfRod = NULL;
+  return table;
+}
+
+void FreeRodHandleTable(RodHandleTable *table)
+{
+  if (table == NULL)
+  {
+    return;
+  }
+  free(table->rodOfId);
+  free(table->generations);
+  free(table->freeIds);
+  free(table->idOfRod);
+  free(table);
+}
+
+void ReserveRods(RodHandleTable *table, int nbRods)
+{
+  if (table->rodCapacity < nbRods)
+  {
+    table->rodCapacity = 2 * nbRods;
+    table->idOfRod = realloc(table->idOfRod, table->rodCapacity * sizeof(int));
+  }
+}
+
+// The handles of the id taken so far no longer resolve.
+void ReleaseId(RodHandleTable *table, int id)
+{
+  table->rodOfId[id] = -1;
+  table->generations[id] += 1;
+  table->freeIds[table->nbFreeIds] = id;
+  table->nbFreeIds += 1;
+}
+
+int TakeId(RodHandleTable *table, int rodIndex)
+{
+  int id;
+  if (table->nbFreeIds > 0)
+  {
+    table->nbFreeIds -= 1;
+    id = table->freeIds[table->nbFreeIds];
+  }
+  else
+  {
+    if (table->nbIds == table->idCapacity)
+    {
+      table->idCapacity = table->idCapacity == 0 ? 64 : 2 * table->idCapacity;
+      table->rodOfId = realloc(table->rodOfId, table->idCapacity * sizeof(int));
+      table->generations = realloc(table->generations, table->idCapacity * sizeof(int));
+      table->freeIds = realloc(table->freeIds, table->idCapacity * sizeof(int));
+    }
+    id = table->nbIds;
+    table->generations[id] = 0;
+    table->nbIds += 1;
+  }
+  table->rodOfId[id] = rodIndex;
+  table->idOfRod[rodIndex] = id;
+  return id;
+}
+
+// For a new group of rods: the handles of the previous one no longer
+// resolve, the rods get new ones.
+void ResetRodHandles(RodHandleTable *table, int nbRods)
+{
+  for (int i = 0; i < table->nbRods; i++)
+  {
+    ReleaseId(table, table->idOfRod[i]);
+  }
+  ReserveRods(table, nbRods);
+  table->nbRods = nbRods;
+  for (int i = 0; i < nbRods; i++)
+  {
+    TakeId(table, i);
+  }
+}
+
+RodHandle GetRodHandle(RodHandleTable *table, int rodIndex)
+{
+  int id = table->idOfRod[rodIndex];
+  return (RodHandle){id, table->generations[id]};
+}
+
+// Current index of the rod, or -1 when it is gone.
+int ResolveRodHandle(RodHandleTable *table, RodHandle handle)
+{
+  if (handle.id < 0 || handle.id >= table->nbIds || table->generations[handle.id] != handle.generation)
+  {
+    return -1;
+  }
+  return table->rodOfId[handle.id];
+}
+
+// After the rods were reordered or compacted: order[i] is the former index of
+// the rod now at i, or -1 for a new rod. The rods left out lose their handles.
+void ReorderRodHandles(RodHandleTable *table, const int *order, int nbRods)
+{
+  // Without former rods, every rod is new and formerIds is never read.
+  int *formerIds = malloc(table->nbRods * sizeof(int));
+  for (int i = 0; i < table->nbRods; i++)
+  {
+    formerIds[i] = table->idOfRod[i];
+    table->rodOfId[formerIds[i]] = -1;
+  }
+  int nbFormerRods = table->nbRods;
+  ReserveRods(table, nbRods);
+  table->nbRods = nbRods;
+  for (int i = 0; i < nbRods; i++)
+  {
+    if (order[i] == -1)
+    {
+      TakeId(table, i);
+      continue;
+    }
+    int id = formerIds[order[i]];
+    table->rodOfId[id] = i;
+    table->idOfRod[i] = id;
+  }
+  for (int i = 0; i < nbFormerRods; i++)
+  {
+    if (table->rodOfId[formerIds[i]] == -1)
+    {
+      ReleaseId(table, formerIds[i]);
+    }
+  }
+  free(formerIds);
+}
+
+// For a rod appended to the group.
+RodHandle AddRodHandle(RodHandleTable *table)
+{
+  ReserveRods(table, table->nbRods + 1);
+  TakeId(table, table->nbRods);
+  table->nbRods += 1;
+  return GetRodHandle(table, table->nbRods - 1);
+}
+
+// For a rod removed from the group, whose index the last rod takes.
+void RemoveRodHandle(RodHandleTable *table, int rodIndex)
+{
+  ReleaseId(table, table->idOfRod[rodIndex]);
+  table->nbRods -= 1;
+  if (rodIndex != table->nbRods)
+  {
+    int id = table->idOfRod[table->nbRods];
+    table->idOfRod[rodIndex] = id;
+    table->rodOfId[id] = rodIndex;
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef HANDLES_H
+#define HANDLES_H
+
+#include <stdbool.h>
+
+// Names a rod whatever its index in the RodGroup, which may be reordered or
+// compacted. The generation tells a handle apart from the later handles
+// reusing its id once its rod is gone.
+typedef struct RodHandle
+{
+  int id;
+  int generation;
+} RodHandle;
+
+#define NO_ROD_HANDLE ((RodHandle){-1, 0})
+
+typedef struct RodHandleTable
+{
+  int nbIds;
+  int idCapacity;
+  // Index of the rod of each id, -1 when the id is free.
+  int *rodOfId;
+  int *generations;
+  int nbFreeIds;
+  int *freeIds;
+  int nbRods;
+  int rodCapacity;
+  int *idOfRod;
+} RodHandleTable;
+
+RodHandleTable *NewRodHandleTable(void);
+void FreeRodHandleTable(RodHandleTable *table);
+void ResetRodHandles(RodHandleTable *table, int nbRods);
+RodHandle GetRodHandle(RodHandleTable *table, int rodIndex);
+int ResolveRodHandle(RodHandleTable *table, RodHandle handle);
+void ReorderRodHandles(RodHandleTable *table, const int *order, int nbRods);
+RodHandle AddRodHandle(RodHandleTable *table);
+void RemoveRodHandle(RodHandleTable *table, int rodIndex);
+
+#endif
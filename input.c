@@ -0,0 +1,180 @@
+#include "input.h"
+#include "raymath.h"
+#include <stdlib.h>
+
+#define SCRIPT_LINE_LEN 256
+
+InputSource *NewLiveInput(void)
+{
+  InputSource *source = calloc(1, sizeof(InputSource));
+  source->kind = LIVE_INPUT;
+  return source;
+}
+
+InputSource *NewScriptedInput(const char *scriptName, int frameRate)
+{
+  FILE *script = NULL;
+  if (scriptName != NULL)
+  {
+    script = fopen(scriptName, "r");
+    if (script == NULL)
+    {
+      fprintf(stderr, "Couldn't open the input script %s.\n", scriptName);
+      return NULL;
+    }
+  }
+  InputSource *source = calloc(1, sizeof(InputSource));
+  source->kind = SCRIPTED_INPUT;
+  source->script = script;
+  source->frameRate = frameRate;
+  return source;
+}
+
+InputFrame ReadLiveFrame(void)
+{
+  return (InputFrame){.mousePosition = GetMousePosition(),
+                      .mouseDelta = GetMouseDelta(),
+                      .wheel = GetMouseWheelMove(),
+                      .time = GetTime(),
+                      .deltaTime = GetFrameTime(),
+                      .leftPressed = IsMouseButtonPressed(MOUSE_BUTTON_LEFT),
+                      .leftReleased = IsMouseButtonReleased(MOUSE_BUTTON_LEFT),
+                      .leftDown = IsMouseButtonDown(MOUSE_BUTTON_LEFT),
+                      .rightDown = IsMouseButtonDown(MOUSE_BUTTON_RIGHT),
+                      .shiftDown = IsKeyDown(KEY_LEFT_SHIFT) || IsKeyDown(KEY_RIGHT_SHIFT),
+                      .homePressed = IsKeyPressed(KEY_HOME),
+                      .nextPressed = IsKeyPressed(KEY_N),
+                      .newUserPressed = IsKeyPressed(KEY_U),
+                      .closed = WindowShouldClose()};
+}
+
+void GlideMouse(InputSource *source)
+{
+  Vector2 *mouse = &source->state.mousePosition;
+  *mouse = Vector2Add(*mouse, Vector2Scale(Vector2Subtract(source->glideTarget, *mouse), 1. / source->glideFrames));
+  source->glideFrames -= 1;
+}
+
+// Runs the commands of the script up to the end of the frame.
+void RunScriptCommands(InputSource *source)
+{
+  InputFrame *state = &source->state;
+  char line[SCRIPT_LINE_LEN];
+  while (fgets(line, SCRIPT_LINE_LEN, source->script) != NULL)
+  {
+    source->lineNumber += 1;
+    float x, y;
+    int n = 1;
+    char key = 0;
+    switch (line[0])
+    {
+    case 'm':
+      if (sscanf(line, "m %f %f %d", &x, &y, &n) < 2)
+      {
+        break;
+      }
+      if (n > 1)
+      {
+        source->glideTarget = (Vector2){x, y};
+        source->glideFrames = n;
+        GlideMouse(source);
+        return;
+      }
+      state->mousePosition = (Vector2){x, y};
+      break;
+    case 'w':
+      sscanf(line, "w %d", &n);
+      source->waitFrames = n - 1;
+      return;
+    case 'p':
+      state->leftPressed = true;
+      state->leftDown = true;
+      break;
+    case 'r':
+      state->leftReleased = true;
+      state->leftDown = false;
+      break;
+    case 'P':
+      state->rightDown = true;
+      break;
+    case 'R':
+      state->rightDown = false;
+      break;
+    case 's':
+      sscanf(line, "s %d", &n);
+      state->shiftDown = n != 0;
+      break;
+    case 'z':
+      sscanf(line, "z %f", &x);
+      state->wheel += x;
+      break;
+    case 'k':
+      sscanf(line, "k %c", &key);
+      state->nextPressed |= key == 'n';
+      state->newUserPressed |= key == 'u';
+      state->homePressed |= key == 'h';
+      break;
+    case '#':
+    case '\n':
+      break;
+    default:
+      fprintf(stderr, "Input script, line %d : unknown command '%c'.\n", source->lineNumber, line[0]);
+    }
+  }
+  state->closed = true;
+}
+
+// The clock of a script ticks once per frame, however long the frame took,
+// so that a script runs as fast as possible and always the same way.
+InputFrame ReadScriptedFrame(InputSource *source)
+{
+  InputFrame *state = &source->state;
+  Vector2 formerMouse = state->mousePosition;
+  // Presses, releases and the wheel only last a frame.
+  state->leftPressed = false;
+  state->leftReleased = false;
+  state->wheel = 0;
+  state->homePressed = false;
+  state->nextPressed = false;
+  state->newUserPressed = false;
+  state->deltaTime = 1. / source->frameRate;
+  state->time = (double)source->nbFrames / source->frameRate;
+  source->nbFrames += 1;
+
+  if (source->glideFrames > 0)
+  {
+    GlideMouse(source);
+  }
+  else if (source->waitFrames > 0)
+  {
+    source->waitFrames -= 1;
+  }
+  else if (source->script != NULL && !state->closed)
+  {
+    RunScriptCommands(source);
+  }
+  state->mouseDelta = Vector2Subtract(state->mousePosition, formerMouse);
+  return *state;
+}
+
+InputFrame ReadInput(InputSource *source)
+{
+  if (source->kind == LIVE_INPUT)
+  {
+    return ReadLiveFrame();
+  }
+  return ReadScriptedFrame(source);
+}
+
+void FreeInputSource(InputSource *source)
+{
+  if (source == NULL)
+  {
+    return;
+  }
+  if (source->script != NULL)
+  {
+    fclose(source->script);
+  }
+  free(source);
+}
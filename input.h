@@ -0,0 +1,65 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "raylib.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// The input of one frame, the mouse in screen coordinates.
+typedef struct InputFrame
+{
+  Vector2 mousePosition;
+  Vector2 mouseDelta;
+  float wheel;
+  double time;
+  float deltaTime;
+  bool leftPressed;
+  bool leftReleased;
+  bool leftDown;
+  bool rightDown;
+  bool shiftDown;
+  bool homePressed;
+  bool nextPressed;
+  bool newUserPressed;
+  // The window was closed, or the script is over.
+  bool closed;
+} InputFrame;
+
+typedef enum InputKind
+{
+  // Read from raylib, which needs a window.
+  LIVE_INPUT,
+  // Read from a script, on a clock that ticks once per frame.
+  SCRIPTED_INPUT,
+} InputKind;
+
+// A script has one command per line, the frame ending at each wait:
+//   m <x> <y> [n]  moves the mouse there, gliding over n frames if given
+//   p / r          presses / releases the left button
+//   P / R          presses / releases the right button, which pans the view
+//   s <0|1>        lets go / holds shift
+//   z <notches>    turns the wheel
+//   k <n|u|h>      presses the next problem, new user or home key
+//   w [n]          waits n frames, 1 by default
+// Blank lines and lines starting with '#' are skipped.
+typedef struct InputSource
+{
+  InputKind kind;
+  // NULL for a source without any event, e.g. when replaying a tap.
+  FILE *script;
+  int lineNumber;
+  int frameRate;
+  long nbFrames;
+  // State of the scripted mouse and keys, kept from frame to frame.
+  InputFrame state;
+  Vector2 glideTarget;
+  int glideFrames;
+  int waitFrames;
+} InputSource;
+
+InputSource *NewLiveInput(void);
+InputSource *NewScriptedInput(const char *scriptName, int frameRate);
+InputFrame ReadInput(InputSource *source);
+void FreeInputSource(InputSource *source);
+
+#endif
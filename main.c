@@ -5,6 +5,15 @@
 #include "config.h"
 #include "signals.h"
 #include "rods.h"
+#include "collision.h"
+#include "watcher.h"
+#include "proximity.h"
+#include "handles.h"
+#include "render.h"
+#include "input.h"
+#include "export.h"
+#include "replay.h"
+#include "tap.h"
 #include <fcntl.h>
 #include <libconfig.h>
 #include <stddef.h>
@@ -24,6 +33,7 @@
 #include <string.h> 
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <time.h>
 
 #define NB_RODS_MENU 10
 
@@ -33,8 +43,10 @@ struct timeval tv;
 
 const int FPS = 40;
 
-const int TABLET_LENGTH = 1000;
-const int TABLED_HEIGHT = 600;
+// Each notch of the wheel zooms the view by ZOOM_STEP.
+const float ZOOM_STEP = 1.25;
+const float MIN_ZOOM = 0.05;
+const float MAX_ZOOM = 4;
 
 static const char DEFAULT_CONFIG[] = "config.cfg";
 static const char DEFAULT_SPEC[] = "problem_set/problem0.rods";
@@ -42,6 +54,14 @@ static const char DEFAULT_SPEC[] = "problem_set/problem0.rods";
 const int SIGNAL_MUST_PLAY_PERIOD = 0;
 const int IMPULSE_DURATION = 2;
 
+// A few rods out of Z-order cost little: the rods are sorted again once more
+// than one in MORTON_SLACK has left its place.
+const int MORTON_SLACK = 32;
+
+// Steps between the rod signal amplitude and full amplitude as the selected
+// rod gets closer to the others, so that the signal isn't sent every frame.
+const int PROXIMITY_LEVELS = 8;
+
 const Signal IMPULSE_SIGNAL = (Signal){
     STEADY,
     255,
@@ -63,33 +83,73 @@ int ComputeAngleV(Vector2 deltaPos)
   return Vector2Angle((Vector2){1, 0}, deltaPos);
 }
 
-void DrawRod(Rod rod)
-{
-  DrawRectangleRec(rod.rect, GetRodColor(rod));
-  DrawRectangleLinesEx(rod.rect, 1., BLACK);
-}
-
-void DrawRodGroup(RodGroup rodGroup[])
+void ShowPalette(RenderCache *render)
 {
-  for (int i = 0; i < rodGroup->nbRods; i++)
+  Swatch *swatches = malloc(nbRodLengths * sizeof(Swatch));
+  for (int l = 1; l <= nbRodLengths; l++)
   {
-    DrawRod(rodGroup->rods[i]);
+    swatches[l - 1] = (Swatch){GetSwatchRect(l), GetLengthColor(l)};
   }
+  SetRenderSwatches(render, swatches, nbRodLengths);
+  free(swatches);
 }
 
+// The selected rod is known by its handle. selectedRod is resolved from it at
+// the start of each frame and must not be kept across frames, since the rods
+// may be reordered or freed in between.
 typedef struct SelectionState
 {
+  RodHandle selectedHandle;
   Rod *selectedRod;
   int selectionTimer;
   Vector2 offset;
+  // The rods touching the selected one, directly or not, are dragged with it.
+  bool dragsTrain;
 } SelectionState;
 
 SelectionState InitSelectionState()
 {
-  return (SelectionState){.selectedRod =  NULL, .selectionTimer =  0, .offset =  (Vector2){0, 0}};
+  return (SelectionState){.selectedHandle = NO_ROD_HANDLE, .selectedRod =  NULL, .selectionTimer =  0, .offset =  (Vector2){0, 0}, .dragsTrain = false};
 }
 
-#define MAX_ROD_COLLIDING 22
+// The dragged rods, and outlines on the rods touching the selected one.
+// Returns the number of dragged rods, movingRods pointing either to them or
+// to selectedRod.
+int AddSelectionOverlays(RenderCache *render, SelectionState s, RodGroup *rodGroup, CollisionWorld *collisionWorld,
+                         int *selectedRod, const int **movingRods)
+{
+  *movingRods = selectedRod;
+  if (s.selectedRod == NULL)
+  {
+    return 0;
+  }
+  *selectedRod = s.selectedRod - rodGroup->rods;
+  int nbMovingRods = 1;
+  if (s.dragsTrain)
+  {
+    *movingRods = collisionWorld->trainRods;
+    nbMovingRods = collisionWorld->nbTrainRods;
+  }
+  for (int i = 0; i < nbMovingRods; i++)
+  {
+    Rod rod = rodGroup->rods[(*movingRods)[i]];
+    AddOverlay(render, OVERLAY_ROD, rod.rect, GetRodColor(rod));
+  }
+  const int *rods;
+  int nbContacts = GetContacts(collisionWorld->contacts, *selectedRod, &rods);
+  for (int i = 0; i < nbContacts; i++)
+  {
+    AddOverlay(render, OVERLAY_OUTLINE, rodGroup->rods[rods[i]].rect, GOLD);
+  }
+  if (s.dragsTrain)
+  {
+    for (int i = 0; i < nbMovingRods; i++)
+    {
+      AddOverlay(render, OVERLAY_OUTLINE, rodGroup->rods[(*movingRods)[i]].rect, ORANGE);
+    }
+  }
+  return nbMovingRods;
+}
 
 typedef struct CollisionState
 {
@@ -167,6 +227,10 @@ typedef struct TimeAndPlace
   bool MouseButtonPressed;
   bool MouseButtonReleased;
   bool MouseButtonDown;
+  // Held when the drag starts to move the whole train of rods.
+  bool TrainModifierDown;
+  // Length of the rod spawned by the press, 0 when it picks a rod.
+  int SpawnLength;
   uint16_t speed;
   uint8_t angle;
 } TimeAndPlace;
@@ -182,13 +246,23 @@ typedef struct SignalState
 {
   enum SignalPlaying signalPlaying;
   Signal *signals;
+  // False when the table belongs to someone else (e.g. the config bank).
+  bool ownsSignals;
   int fd;
+  // 0 when the proximity feedback is disabled.
+  float proximityRange;
+  int proximityLevel;
+  // Replays write the commands there, with the time of the frame.
+  FILE *commandLog;
+  float time;
 } SignalState;
 
 SignalState InitSignalState(config_t cfg)
 {
-  Signal *signals = InitSignals(cfg);
-  SignalState signalState = (SignalState){.signalPlaying =  NO_SIGNAL, .signals =  signals, .fd =  connect_to_tty()};
+  Signal *signals = InitSignals(cfg, nbRodLengths);
+  SignalState signalState = (SignalState){.signalPlaying =  NO_SIGNAL, .signals =  signals, .ownsSignals = true, .fd =  connect_to_tty(),
+                                            .proximityRange = ReadProximityRange(cfg), .proximityLevel = 0,
+                                            .commandLog = NULL, .time = 0};
   if (signalState.fd != -1)
   {
     // The haptic signal won't play if no direction is set, so we set it to an arbitrary value at the start.
@@ -197,44 +271,114 @@ SignalState InitSignalState(config_t cfg)
   return signalState;
 }
 
-void ClearSignal(SignalState *sigs)
+// The commands go to the haptic device, if any, and to the command log.
+void SendClearSignal(SignalState *sigs)
 {
-  sigs->signalPlaying = NO_SIGNAL;
   if (sigs->fd != -1)
   {
     clear_signal(sigs->fd);
     play_signal(sigs->fd, 0);
   }
+  if (sigs->commandLog != NULL)
+  {
+    fprintf(sigs->commandLog, "h %f clear\n", sigs->time);
+  }
+}
+
+void SendSignal(SignalState *sigs, Signal signal)
+{
+  if (sigs->fd != -1)
+  {
+    set_signal(sigs->fd, -1, -1, signal);
+  }
+  if (sigs->commandLog != NULL)
+  {
+    fprintf(sigs->commandLog, "h %f signal %d %d %d %d %d %d\n", sigs->time, signal.signal_type, signal.amplitude,
+            signal.offset, signal.duty, signal.period, signal.phase);
+  }
+}
+
+void SendDirection(SignalState *sigs, uint8_t angle, uint16_t speed)
+{
+  if (sigs->fd != -1)
+  {
+    set_direction(sigs->fd, angle, speed);
+  }
+  if (sigs->commandLog != NULL)
+  {
+    fprintf(sigs->commandLog, "h %f direction %d %d\n", sigs->time, angle, speed);
+  }
+}
+
+void ClearSignal(SignalState *sigs)
+{
+  sigs->signalPlaying = NO_SIGNAL;
+  sigs->proximityLevel = 0;
+  SendClearSignal(sigs);
   printf("Now playing : no signal.\n");
 }
 
 Signal GetRodSignal(SignalState sigs, Rod rod)
 {
-  return sigs.signals[rod.numericLength - 1];
+  return sigs.signals[GetLengthIndex(rod.numericLength)];
 }
 
-void SetSelectedRodSignal(SignalState *sigs, SelectionState secs, TimeAndPlace tap)
+// The rod signal, louder as the rod gets closer to the others.
+Signal GetSelectedRodSignal(SignalState sigs, Rod rod)
 {
-  sigs->signalPlaying = SELECTED_ROD_SIGNAL;
-  if (sigs->fd != -1)
+  Signal signal = GetRodSignal(sigs, rod);
+  signal.amplitude += (255 - signal.amplitude) * sigs.proximityLevel / PROXIMITY_LEVELS;
+  return signal;
+}
+
+int ComputeProximityLevel(SignalState sigs, float clearance)
+{
+  if (sigs.proximityRange <= 0 || clearance >= sigs.proximityRange)
   {
-    set_signal(sigs->fd, -1, -1, GetRodSignal(*sigs, *secs.selectedRod));
+    return 0;
   }
-  printf("Now playing : the selected rod signal.\n");
-  PrintSignal(GetRodSignal(*sigs, *secs.selectedRod));
+  int level = ceilf((1 - clearance / sigs.proximityRange) * PROXIMITY_LEVELS);
+  return level > PROXIMITY_LEVELS ? PROXIMITY_LEVELS : level;
+}
+
+void SetSelectedRodSignal(SignalState *sigs, SelectionState secs)
+{
+  Signal signal = GetSelectedRodSignal(*sigs, *secs.selectedRod);
+  SendSignal(sigs, signal);
+  // A new proximity level only changes the amplitude of the signal playing.
+  if (sigs->signalPlaying != SELECTED_ROD_SIGNAL)
+  {
+    printf("Now playing : the selected rod signal.\n");
+    PrintSignal(signal);
+  }
+  sigs->signalPlaying = SELECTED_ROD_SIGNAL;
 }
 
 void PlayImpulse(SignalState *sigs)
 {
   sigs->signalPlaying = IMPULSE;
-  if (sigs->fd != -1)
+  SendSignal(sigs, IMPULSE_SIGNAL);
+  printf("Now playing : the impulse signal.\n");
+}
+
+void SwapSignals(SignalState *sigs, SelectionState secs, Signal *signals, bool owned)
+{
+  if (sigs->ownsSignals)
   {
-    set_signal(sigs->fd, -1, -1, IMPULSE_SIGNAL);
+    free(sigs->signals);
+  }
+  sigs->signals = signals;
+  sigs->ownsSignals = owned;
+  // The rod signal being played comes from the old table, so it is sent again.
+  if (sigs->signalPlaying == SELECTED_ROD_SIGNAL && secs.selectedRod != NULL)
+  {
+    SetSelectedRodSignal(sigs, secs);
   }
-  printf("Now playing : the impulse signal.\n");
 }
 
-void UpdateSignalState(SignalState *sigs, SelectionState secs, CollisionState cols, TimeAndPlace tap)
+// clearance is the distance between the selected rod and the others, as read
+// from the distance field.
+void UpdateSignalState(SignalState *sigs, SelectionState secs, CollisionState cols, TimeAndPlace tap, float clearance)
 {
   if (secs.selectedRod == NULL)
   {
@@ -246,9 +390,13 @@ void UpdateSignalState(SignalState *sigs, SelectionState secs, CollisionState co
   }
   else
   {
-    if (!cols.collided && sigs->signalPlaying != SELECTED_ROD_SIGNAL)
+    int proximityLevel = ComputeProximityLevel(*sigs, clearance);
+    bool proximityChanged = proximityLevel != sigs->proximityLevel;
+    sigs->proximityLevel = proximityLevel;
+
+    if (!cols.collided && (sigs->signalPlaying != SELECTED_ROD_SIGNAL || proximityChanged))
     {
-      SetSelectedRodSignal(sigs, secs, tap);
+      SetSelectedRodSignal(sigs, secs);
     }
     else if (cols.collided)
     {
@@ -256,7 +404,7 @@ void UpdateSignalState(SignalState *sigs, SelectionState secs, CollisionState co
       {
         if (secs.selectionTimer <= SIGNAL_MUST_PLAY_PERIOD)
         {
-          SetSelectedRodSignal(sigs, secs, tap);
+          SetSelectedRodSignal(sigs, secs);
         }
       }
       else if (sigs->signalPlaying == IMPULSE && cols.collisionTimer > SIGNAL_MUST_PLAY_PERIOD + IMPULSE_DURATION)
@@ -268,42 +416,83 @@ void UpdateSignalState(SignalState *sigs, SelectionState secs, CollisionState co
         PlayImpulse(sigs);
       }
     }
-    if (sigs->fd != -1)
-    {
-      set_direction(sigs->fd, tap.angle, tap.speed);
-    }
+    SendDirection(sigs, tap.angle, tap.speed);
   }
 }
 
 
-void UpdateTimeAndPlace(TimeAndPlace *tap)
+Camera2D InitViewCamera(void)
+{
+  return (Camera2D){.offset = {0, 0}, .target = {0, 0}, .rotation = 0, .zoom = 1};
+}
+
+// The wheel zooms the view around the mouse, the right button pans it and
+// the home key puts it back.
+void UpdateViewCamera(Camera2D *camera, InputFrame input)
 {
-  tap->mousePosition = GetMousePosition();
-  tap->mouseDelta = GetMouseDelta();
-  tap->time = GetTime();
-  tap->deltaTime = GetFrameTime();
+  if (input.wheel != 0)
+  {
+    camera->target = GetScreenToWorld2D(input.mousePosition, *camera);
+    camera->offset = input.mousePosition;
+    camera->zoom = Clamp(camera->zoom * powf(ZOOM_STEP, input.wheel), MIN_ZOOM, MAX_ZOOM);
+  }
+  if (input.rightDown)
+  {
+    camera->target = Vector2Subtract(camera->target, Vector2Scale(input.mouseDelta, 1 / camera->zoom));
+  }
+  if (input.homePressed)
+  {
+    *camera = InitViewCamera();
+  }
+}
+
+// The mouse is in world coordinates, so that the taps don't depend on the view.
+void UpdateTimeAndPlace(TimeAndPlace *tap, InputFrame input, Camera2D camera)
+{
+  tap->mousePosition = GetScreenToWorld2D(input.mousePosition, camera);
+  tap->mouseDelta = Vector2Scale(input.mouseDelta, 1 / camera.zoom);
+  tap->time = input.time;
+  tap->deltaTime = input.deltaTime;
   tap->angle = ComputeAngleV(tap->mouseDelta);
   if (tap->deltaTime > 0)
   {
     tap->speed = ComputeSpeedV(tap->mouseDelta, tap->deltaTime);
   }
-  tap->MouseButtonDown = IsMouseButtonDown(MOUSE_BUTTON_LEFT);
-  tap->MouseButtonPressed = IsMouseButtonPressed(MOUSE_BUTTON_LEFT);
-  tap->MouseButtonReleased = IsMouseButtonReleased(MOUSE_BUTTON_LEFT);
+  tap->MouseButtonDown = input.leftDown;
+  tap->MouseButtonPressed = input.leftPressed;
+  tap->MouseButtonReleased = input.leftReleased;
+  tap->TrainModifierDown = input.shiftDown;
+  tap->SpawnLength = 0;
 }
 
+// The input is read from the first frame on, which may be without a window.
 TimeAndPlace InitTimeAndPlace()
 {
-  TimeAndPlace tap;
-  UpdateTimeAndPlace(&tap);
-  return tap;
+  return (TimeAndPlace){.mousePosition = {0, 0}, .mouseDelta = {0, 0}, .time = 0, .deltaTime = 0,
+                        .MouseButtonPressed = false, .MouseButtonReleased = false, .MouseButtonDown = false,
+                        .TrainModifierDown = false, .SpawnLength = 0, .speed = 0, .angle = 0};
 }
 
 
 typedef struct AppState
 {
   TimeAndPlace timeAndPlace;
+  // Live or scripted, and the input of the current frame.
+  InputSource *inputSource;
+  InputFrame input;
   RodGroup *rodGroup;
+  // Handles to the rods, which are stored in Z-order, save for a few.
+  RodHandleTable *rodHandles;
+  int nbRodsOutOfOrder;
+  // Rods are spawned from the palette, and deleted when dropped off the tablet.
+  bool freePlay;
+  RenderCache render;
+  Camera2D camera;
+  CollisionWorld *collisionWorld;
+  // Shares the work on large layouts with the other cores.
+  WorkerPool *workerPool;
+  Resolver resolver;
+  float snapDistance;
   SelectionState selectionState;
   CollisionState collisionState;
   SignalState signalState;
@@ -311,10 +500,26 @@ typedef struct AppState
   bool next;
   int userId;
   bool newUser;
-  FILE *currentSave;
+  TapWriter *tapWriter;
+  // Taps are written in the text format rather than the binary one.
+  bool textTaps;
   bool isReplay;
   char *saveName;
+  Replay *replay;
+  // Where a replay reports its collisions, haptic commands and final rods.
+  FILE *replayLog;
   bool shouldEnd;
+  ConfigBank *configBank;
+  // Written by the websocket thread, consumed at the start of the next frame.
+  int requestedConfig;
+  ConfigWatcher *configWatcher;
+  // Contact changes of the collision world already logged.
+  int contactChangesSeen;
+  // NULL when the proximity feedback is disabled.
+  FieldBuilder *fieldBuilder;
+  DistanceField *distanceField;
+  // Bumped whenever the rods change index, which outdates the distance fields.
+  int rodIndexGeneration;
 } AppState;
 
 static AppState appState;
@@ -335,22 +540,160 @@ void onmessage(ws_cli_conn_t client,
   case 'e': // Close the app
     appState.shouldEnd = true;
     break;
+  case 'c': // Switch to another config of the bank, by index or by name
+    if (appState.configBank != NULL)
+    {
+      int configId = isdigit(msg[1]) ? strtol((const char*)&(msg[1]), NULL, 10)
+                                     : FindBankConfig(appState.configBank, (const char*)&(msg[1]));
+      if (configId >= 0 && configId < appState.configBank->nbConfigs)
+      {
+        __atomic_store_n(&appState.requestedConfig, configId, __ATOMIC_RELEASE);
+      }
+    }
+    break;
   default:
     break;
   }
   ws_sendframe_txt(client, "GOT IT");
 }
 
+// The collision world indexes the rods, so it is rebuilt whenever they are
+// stored in another order.
+void RebuildCollisionWorld(AppState *s)
+{
+  FreeCollisionWorld(s->collisionWorld);
+  // The grid covers the whole layout, which may be larger than the tablet,
+  // so that the view culls the rods through it.
+  float width = TABLET_LENGTH;
+  float height = TABLED_HEIGHT;
+  for (int i = 0; i < s->rodGroup->nbRods; i++)
+  {
+    width = fmaxf(width, GetRight(s->rodGroup->rods[i]));
+    height = fmaxf(height, GetBottom(s->rodGroup->rods[i]));
+  }
+  s->collisionWorld = NewCollisionWorld(s->rodGroup, width, height, s->workerPool);
+  SetResolver(s->collisionWorld, s->resolver);
+  s->collisionWorld->snapDistance = s->snapDistance;
+  s->contactChangesSeen = s->collisionWorld->contacts->nbChanges;
+  // The field refers to the rods by index too.
+  FreeDistanceField(s->distanceField);
+  s->distanceField = NULL;
+  s->rodIndexGeneration += 1;
+}
+
+void SetUpRodGroup(AppState *s)
+{
+  int *order = malloc(s->rodGroup->nbRods * sizeof(int));
+  SortRodGroupByMorton(s->rodGroup, order);
+  free(order);
+  ResetRodHandles(s->rodHandles, s->rodGroup->nbRods);
+  s->nbRodsOutOfOrder = 0;
+  RebuildCollisionWorld(s);
+  RequestDistanceField(s->fieldBuilder, s->rodGroup, s->rodIndexGeneration);
+  InvalidateRenderCache(&s->render);
+}
+
+// Counts the dropped rods that left the place of their neighbours, which is
+// rare for short moves, and puts the rods back in Z-order once there are too
+// many of them.
+void KeepRodsInMortonOrder(AppState *s, const int *rods, int nbRods)
+{
+  for (int i = 0; i < nbRods; i++)
+  {
+    s->nbRodsOutOfOrder += !IsInMortonOrder(s->rodGroup, rods[i]);
+  }
+  if (s->nbRodsOutOfOrder * MORTON_SLACK <= s->rodGroup->nbRods)
+  {
+    return;
+  }
+  int *order = malloc(s->rodGroup->nbRods * sizeof(int));
+  SortRodGroupByMorton(s->rodGroup, order);
+  ReorderRodHandles(s->rodHandles, order, s->rodGroup->nbRods);
+  free(order);
+  s->nbRodsOutOfOrder = 0;
+  RebuildCollisionWorld(s);
+}
+
+// Deletes the dropped rods lying wholly off the tablet in free play, then
+// keeps the others in Z-order. A deleted rod gives its index to the last
+// rod, so the rods are followed by handle.
+void SettleDroppedRods(AppState *s, const int *rods, int nbRods)
+{
+  if (!s->freePlay)
+  {
+    KeepRodsInMortonOrder(s, rods, nbRods);
+    return;
+  }
+  // Each deletion may move one more rod out of Z-order.
+  RodHandle *handles = malloc(2 * nbRods * sizeof(RodHandle));
+  for (int i = 0; i < nbRods; i++)
+  {
+    handles[i] = GetRodHandle(s->rodHandles, rods[i]);
+  }
+  int nbHandles = nbRods;
+  Rectangle tablet = {0, 0, TABLET_LENGTH, TABLED_HEIGHT};
+  for (int i = 0; i < nbRods; i++)
+  {
+    int rodIndex = ResolveRodHandle(s->rodHandles, handles[i]);
+    Rod rod = s->rodGroup->rods[rodIndex];
+    if (CheckCollisionRecs(rod.rect, tablet))
+    {
+      continue;
+    }
+    RemoveRodFromWorld(s->collisionWorld, rodIndex);
+    RemoveRodHandle(s->rodHandles, rodIndex);
+    printf("FREE PLAY : rod of length %d deleted\n", rod.numericLength);
+    if (rodIndex < s->rodGroup->nbRods)
+    {
+      handles[nbHandles] = GetRodHandle(s->rodHandles, rodIndex);
+      nbHandles += 1;
+    }
+    // The field refers to the rods by index.
+    FreeDistanceField(s->distanceField);
+    s->distanceField = NULL;
+    s->rodIndexGeneration += 1;
+  }
+  int *kept = malloc(nbHandles * sizeof(int));
+  int nbKept = 0;
+  for (int i = 0; i < nbHandles; i++)
+  {
+    int rodIndex = ResolveRodHandle(s->rodHandles, handles[i]);
+    if (rodIndex != -1)
+    {
+      kept[nbKept] = rodIndex;
+      nbKept += 1;
+    }
+  }
+  free(handles);
+  KeepRodsInMortonOrder(s, kept, nbKept);
+  free(kept);
+}
+
 void LoadAppSpec(AppState *s, char *specName)
 {
   free(s->rodGroup);
   s->rodGroup = NewRodGroup(specName);
+  SetUpRodGroup(s);
 }
 
-void LoadAppSpecFromTap(AppState *s, char *specName)
+// The rods the replayed session started with, whatever the tap's format.
+void LoadAppSpecFromReplay(AppState *s)
 {
+  if (s->replay == NULL)
+  {
+    s->replay = LoadReplay(s->saveName);
+  }
+  if (s->replay == NULL || s->replay->rodGroup == NULL)
+  {
+    fprintf(stderr, "No rods in the tap %s.\n", s->saveName);
+    abort();
+  }
+  RodGroup *rodGroup = s->replay->rodGroup;
+  size_t size = sizeof(RodGroup) + rodGroup->capacity * sizeof(Rod);
   free(s->rodGroup);
-  s->rodGroup = NewRodGroupFromTap(specName);
+  s->rodGroup = malloc(size);
+  memcpy(s->rodGroup, rodGroup, size);
+  SetUpRodGroup(s);
 }
 
 void CreateUserFolder(AppState *s)
@@ -367,33 +710,53 @@ void StartProblem(AppState *s)
     snprintf(specName, 50, "problem_set/problem%d.rods", s->problemId);
     LoadAppSpec(s, specName);
   } else {
-    LoadAppSpecFromTap(s, s->saveName);
+    LoadAppSpecFromReplay(s);
   }
 }
 
 void OpenSaveFile(AppState *s)
 {
   char saveName[50];
-  snprintf(saveName, 50, "user%d/rods_u%dp%d.tap", s->userId, s->userId, s->problemId);
-  free(s->currentSave);
+  snprintf(saveName, 50, "user%d/rods_u%dp%d%s", s->userId, s->userId, s->problemId,
+           s->textTaps ? ".tap" : TAP_BINARY_EXTENSION);
 
   if (!s->isReplay) {
-    s->currentSave = fopen(saveName, "w");
-    fprintf(s->currentSave, "s ");
-    SaveRodGroup(s->rodGroup, s->currentSave);
+    s->tapWriter = OpenTapWriter(saveName, !s->textTaps);
+    if (s->tapWriter == NULL)
+    {
+      abort();
+    }
+    WriteTapRods(s->tapWriter, s->rodGroup);
     gettimeofday(&tv, NULL);
-    fprintf(s->currentSave, "\nt %ld \n", tv.tv_sec);
-    fprintf(s->currentSave, "r %f \n", s->timeAndPlace.time);
+    WriteTapDate(s->tapWriter, tv.tv_sec);
+    WriteTapResolver(s->tapWriter, GetResolverName(s->resolver), s->snapDistance);
+    if (s->freePlay)
+    {
+      WriteTapMark(s->tapWriter, 'f');
+    }
+    WriteTapRelease(s->tapWriter, s->timeAndPlace.time);
 
   } else {
-    s->currentSave = fopen(s->saveName, "r");
+    RewindReplay(s->replay);
   }
 }
 
-AppState InitAppState(config_t cfg, int firstUserId, int firstProblemId, bool isReplay, char *saveName)
+AppState InitAppState(config_t cfg, int firstUserId, int firstProblemId, bool isReplay, char *saveName, Resolver resolver, float snapDistance,
+                      bool freePlay, bool retainedRender, bool textTaps)
 {
   AppState res = (AppState){InitTimeAndPlace(),
+                            .inputSource = NULL,
+                            .input = {0},
                             .rodGroup = NULL,
+                            .rodHandles = NewRodHandleTable(),
+                            .nbRodsOutOfOrder = 0,
+                            .freePlay = freePlay,
+                            .render = NewRenderCache(TABLET_LENGTH, TABLED_HEIGHT, retainedRender),
+                            .camera = InitViewCamera(),
+                            .workerPool = NewWorkerPool(GetCoreCount() - 1),
+                            .collisionWorld = NULL,
+                            .resolver = resolver,
+                            .snapDistance = snapDistance,
                             InitSelectionState(),
                             InitCollisionState(),
                             InitSignalState(cfg),
@@ -401,36 +764,104 @@ AppState InitAppState(config_t cfg, int firstUserId, int firstProblemId, bool is
                             .next = false,
                             .userId =  firstUserId,
                             .newUser =  false,
-                            .currentSave =  NULL,
+                            .tapWriter =  NULL,
+                            .textTaps = textTaps,
                             .isReplay = isReplay,
                             .saveName = saveName,
-                            .shouldEnd = false};
+                            .replay = NULL,
+                            .replayLog = NULL,
+                            .shouldEnd = false,
+                            .configBank = NULL,
+                            .requestedConfig = -1,
+                            .configWatcher = NULL,
+                            .contactChangesSeen = 0,
+                            .fieldBuilder = NULL,
+                            .distanceField = NULL,
+                            .rodIndexGeneration = 0};
+  if (res.signalState.proximityRange > 0)
+  {
+    res.fieldBuilder = StartFieldBuilder(TABLET_LENGTH, TABLED_HEIGHT, res.signalState.proximityRange);
+  }
+  if (freePlay)
+  {
+    ShowPalette(&res.render);
+  }
   CreateUserFolder(&res);
   StartProblem(&res);
   OpenSaveFile(&res);
   return res;
 }
 
-void SelectRodUnderMouse(SelectionState *s, RodGroup *rodGroup, Vector2 mousePosition)
+void SelectRod(SelectionState *s, RodGroup *rodGroup, RodHandleTable *rodHandles, CollisionWorld *collisionWorld, int rodIndex,
+               Vector2 mousePosition, bool train)
 {
-  for (int i = 0; i < rodGroup->nbRods; i++)
+  Rod *rod = &(rodGroup->rods[rodIndex]);
+  // A train of a single rod is dragged like any rod.
+  s->dragsTrain = train && PickUpTrain(collisionWorld, rodIndex) > 1;
+  if (!s->dragsTrain)
   {
-    Rod *rod = &(rodGroup->rods[i]);
-    // If a rod is under the mouse, mark it as selected.
-    if (CheckCollisionPointRec(mousePosition, rod->rect))
-    {
-      s->selectedRod = rod;
-      s->selectionTimer = 0;
-      s->offset = Vector2Subtract(GetTopLeft(*rod), mousePosition);
-      break;
-    }
+    PickUpRod(collisionWorld, rodIndex);
+  }
+  s->selectedHandle = GetRodHandle(rodHandles, rodIndex);
+  s->selectedRod = rod;
+  s->selectionTimer = 0;
+  s->offset = Vector2Subtract(GetTopLeft(*rod), mousePosition);
+}
+
+void SelectRodUnderMouse(SelectionState *s, RodGroup *rodGroup, RodHandleTable *rodHandles, CollisionWorld *collisionWorld,
+                         Vector2 mousePosition, bool train)
+{
+  int rodIndex = PickRod(collisionWorld, mousePosition);
+  // If a rod is under the mouse, mark it as selected.
+  if (rodIndex != -1)
+  {
+    SelectRod(s, rodGroup, rodHandles, collisionWorld, rodIndex, mousePosition, train);
   }
 }
 
+// Spawns a rod of the swatch's length under the mouse, flush with the right
+// edge of the tablet, and starts dragging it. The group only grows here,
+// before the drag. The distance field stays valid: it just doesn't know the
+// new rod yet.
+void SpawnRod(AppState *s, int numericLength)
+{
+  if (s->rodGroup->nbRods == s->rodGroup->capacity)
+  {
+    s->rodGroup = GrowRodGroup(s->rodGroup);
+    ResizeCollisionWorld(s->collisionWorld, s->rodGroup);
+  }
+  Rod rod = NewSpawnedRod(numericLength);
+  int rodIndex = AddRodToWorld(s->collisionWorld, rod);
+  AddRodHandle(s->rodHandles);
+  printf("FREE PLAY : rod of length %d spawned\n", numericLength);
+  SelectRod(&s->selectionState, s->rodGroup, s->rodHandles, s->collisionWorld, rodIndex, s->timeAndPlace.mousePosition, false);
+  // Another rod may have been in the way: the rod still follows the mouse
+  // from where it should have been.
+  s->selectionState.offset = Vector2Subtract(GetTopLeft(rod), s->timeAndPlace.mousePosition);
+}
+
 void ClearSelection(SelectionState *s)
 {
+  s->selectedHandle = NO_ROD_HANDLE;
   s->selectedRod = NULL;
   s->selectionTimer = 0;
+  s->dragsTrain = false;
+}
+
+// Resolves the selected rod for this frame. A rod gone since the last frame
+// is simply no longer selected.
+void ResolveSelection(SelectionState *s, RodGroup *rodGroup, RodHandleTable *rodHandles)
+{
+  int rodIndex = ResolveRodHandle(rodHandles, s->selectedHandle);
+  if (rodIndex == -1)
+  {
+    if (s->selectedRod != NULL)
+    {
+      ClearSelection(s);
+    }
+    return;
+  }
+  s->selectedRod = &rodGroup->rods[rodIndex];
 }
 
 void UpdateSelectionTimer(SelectionState *s)
@@ -474,40 +905,7 @@ int compareCorners(const void *a, const void *b)
     return 0;
 }
 
-typedef struct Bound
-{
-  float value;
-  enum StrictCollisionType collisionType;
-} Bound;
-
-Bound newBound(Rod boundingRod, enum StrictCollisionType collisionType)
-{
-  float value;
-  switch (collisionType)
-  {
-  case FROM_ABOVE:
-    value = GetTop(boundingRod);
-    break;
-  case FROM_BELOW:
-    value = GetBottom(boundingRod);
-    break;
-
-  case FROM_RIGHT:
-    value = GetRight(boundingRod);
-    break;
-
-  case FROM_LEFT:
-    value = GetLeft(boundingRod);
-    break;
-
-  default:
-    fprintf(stderr, "SHOULDN'T HAPPEN!!\n ONLY CALL THIS FUNCTION WHEN THERE IS A COLLISION !\n");
-    abort();
-  }
-  return (Bound){value, collisionType};
-}
-
-void UpdateSelectedRodPosition2(SelectionState *ss, CollisionState *cs, RodGroup *rodGroup, TimeAndPlace tap)
+void UpdateSelectedRodPosition2(SelectionState *ss, CollisionState *cs, RodGroup *rodGroup, CollisionWorld *collisionWorld, TimeAndPlace tap)
 {
   if (ss->selectedRod == NULL)
   {
@@ -515,104 +913,12 @@ void UpdateSelectedRodPosition2(SelectionState *ss, CollisionState *cs, RodGroup
   }
 
   Rod targetRod = RodAfterSpeculativeMove(*ss, tap.mousePosition);
-
-  Bound yBounds[22];
-  int nbYBounds = 0;
-
-  yBounds[0] = newBound(*(ss->selectedRod), FROM_RIGHT);
-  Bound xBounds[22];
-  int nbXBounds = 0;
-
-  for (int i = 0; i < rodGroup->nbRods; i++)
-  {
-    Rod *otherRod = &rodGroup->rods[i];
-    if (ss->selectedRod != otherRod)
-    {
-      StrictCollisionType collisionType = CheckStrictCollision(*(ss->selectedRod), targetRod, *otherRod);
-      if (collisionType != NO_STRICT_COLLISION)
-      {
-        RegisterCollision(cs);
-
-        if (collisionType == FROM_ABOVE || collisionType == FROM_BELOW)
-        {
-          yBounds[nbYBounds] = newBound(*otherRod, collisionType);
-          nbYBounds += 1;
-        }
-        else
-        {
-
-          xBounds[nbXBounds] = newBound(*otherRod, collisionType);
-          nbXBounds += 1;
-        }
-      }
-    }
-  }
-
-  if (!cs->collided)
+  bool collided = ss->dragsTrain ? MoveTrain(collisionWorld, ss->selectedRod - rodGroup->rods, targetRod)
+                                 : MoveRod(collisionWorld, ss->selectedRod - rodGroup->rods, targetRod);
+  if (collided)
   {
-    *ss->selectedRod = targetRod;
-    return;
-  }
-
-  yBounds[nbYBounds] = (Bound){.value =  GetBottom(targetRod), FROM_ABOVE};
-  nbYBounds += 1;
-
-  xBounds[nbXBounds] = (Bound){.value =  GetRight(targetRod), FROM_LEFT};
-  nbXBounds += 1;
-
-  yBounds[nbYBounds] = (Bound){.value =  GetBottom(*(ss->selectedRod)), FROM_ABOVE};
-  nbYBounds += 1;
-
-  xBounds[nbXBounds] = (Bound){.value =  GetRight(*(ss->selectedRod)), FROM_LEFT};
-  nbXBounds += 1;
-
-  Rod candidateRod = *(ss->selectedRod);
-  Rod bestRod = *(ss->selectedRod);
-  float bestDist = Vector2DistanceSqr(GetTopLeft(targetRod), GetTopLeft(candidateRod));
-  for (int ix = 0; ix < nbXBounds; ix++)
-  {
-    for (int iy = 0; iy < nbYBounds; iy++)
-    {
-      if (yBounds[iy].collisionType == FROM_ABOVE)
-      {
-        SetBottom(&candidateRod, yBounds[iy].value);
-      }
-      else
-      {
-        SetTop(&candidateRod, yBounds[iy].value);
-      }
-
-      if (xBounds[ix].collisionType == FROM_LEFT)
-      {
-        SetRight(&candidateRod, xBounds[ix].value);
-      }
-      else
-      {
-        SetLeft(&candidateRod, xBounds[ix].value);
-      }
-
-      float candidateDist = Vector2DistanceSqr(GetTopLeft(targetRod), GetTopLeft(candidateRod));
-
-      if (candidateDist < bestDist)
-      {
-        bool noCollision = true;
-        for (int i = 0; i < rodGroup->nbRods; i++)
-        {
-          if (&rodGroup->rods[i] != ss->selectedRod && StrictlyCollide(rodGroup->rods[i], candidateRod))
-          {
-            noCollision = false;
-            break;
-          }
-        }
-        if (noCollision)
-        {
-          bestDist = candidateDist;
-          bestRod = candidateRod;
-        }
-      }
-    }
+    RegisterCollision(cs);
   }
-  SetTopLeft(ss->selectedRod, GetTopLeft(bestRod));
 }
 
 void ClearAppState(AppState *s)
@@ -620,11 +926,11 @@ void ClearAppState(AppState *s)
   ClearCollisionState(&s->collisionState);
   ClearSelection(&s->selectionState);
   ClearSignal(&s->signalState);
-  if (s->currentSave != NULL && !s->isReplay) { 
+  if (s->tapWriter != NULL && !s->isReplay) { 
     gettimeofday(&tv, NULL);
-    fprintf(s->currentSave, "t %ld \n", tv.tv_sec);
-    fclose(s->currentSave);
-    s->currentSave = NULL;
+    WriteTapDate(s->tapWriter, tv.tv_sec);
+    CloseTapWriter(s->tapWriter);
+    s->tapWriter = NULL;
   }
   s->next = false;
   s->newUser = false;
@@ -639,82 +945,220 @@ typedef enum MouseState
 
 void SaveTap(AppState *s)
 {
+  // Marks the drag that follows as a train drag, or as the drag of a new rod.
+  if (s->timeAndPlace.MouseButtonPressed && s->selectionState.dragsTrain)
+  {
+    WriteTapMark(s->tapWriter, 'g');
+  }
+  if (s->timeAndPlace.MouseButtonPressed && s->timeAndPlace.SpawnLength > 0)
+  {
+    WriteTapSpawn(s->tapWriter, s->timeAndPlace.SpawnLength);
+  }
   if (s->timeAndPlace.MouseButtonReleased)
   {
-    fprintf(s->currentSave, "r %f \n\n", s->timeAndPlace.time);
+    WriteTapRelease(s->tapWriter, s->timeAndPlace.time);
   }
   else
   {
-    fprintf(s->currentSave,
-            "m %f %f %f \n",
-            s->timeAndPlace.time,
-            s->timeAndPlace.mousePosition.x,
-            s->timeAndPlace.mousePosition.y);
+    WriteTapMove(s->tapWriter, s->timeAndPlace.time, s->timeAndPlace.mousePosition.x,
+                 s->timeAndPlace.mousePosition.y);
   }
 }
 
+// Feeds the events of the replay up to the next move or release, the mouse
+// delta being worked out from the recorded positions as the haptic direction
+// needs it.
 void UpdateTapFromSave(AppState *s)
 {
-  char *line;
-  size_t len = 0;
-  ssize_t read;
-  while ((read = getline(&line, &len, s->currentSave)) != -1)
-  {
-    if (line[0] == 'm') {
-      float newTime;
-      float newMouseX;
-      float newMouseY;
-      sscanf(line, "m %f %f %f ", &newTime, &newMouseX, &newMouseY);
-      Vector2 newMousePos = (Vector2){newMouseX, newMouseY};
-
-      if (s->timeAndPlace.MouseButtonReleased) {
-        s->timeAndPlace.MouseButtonPressed = true;
-        s->timeAndPlace.MouseButtonReleased = false;
-        WaitTime(newTime - s->timeAndPlace.time - 1./FPS);
+  TimeAndPlace *tap = &s->timeAndPlace;
+  ReplayEvent event;
+  while (NextReplayEvent(s->replay, &event))
+  {
+    switch (event.kind)
+    {
+    case MOVE_EVENT:
+      if (tap->MouseButtonReleased) {
+        tap->MouseButtonPressed = true;
+        tap->MouseButtonReleased = false;
+        tap->mouseDelta = (Vector2){0, 0};
       } else {
-        s->timeAndPlace.MouseButtonPressed = false;
-        s->timeAndPlace.MouseButtonDown = true;
+        tap->MouseButtonPressed = false;
+        tap->MouseButtonDown = true;
+        tap->mouseDelta = Vector2Subtract(event.position, tap->mousePosition);
+      }
+      WaitReplayEvent(s->replay, event.time);
+      tap->deltaTime = event.time - tap->time;
+      tap->angle = ComputeAngleV(tap->mouseDelta);
+      if (tap->deltaTime > 0)
+      {
+        tap->speed = ComputeSpeedV(tap->mouseDelta, tap->deltaTime);
       }
-      s->timeAndPlace.time = newTime;
-      s->timeAndPlace.mousePosition = newMousePos;
+      tap->time = event.time;
+      tap->mousePosition = event.position;
       return;
-
-    } else if (line[0] == 'r')
-    {
-      s->timeAndPlace.MouseButtonReleased = true;
-      s->timeAndPlace.MouseButtonDown = false;
-      s->timeAndPlace.MouseButtonPressed = false;
-      float newTime;
-      sscanf(line, "r %f", &newTime);
-      s->timeAndPlace.time = newTime;
+    case RESOLVER_EVENT:
+      s->resolver = event.arg;
+      s->snapDistance = event.snapDistance;
+      SetResolver(s->collisionWorld, s->resolver);
+      s->collisionWorld->snapDistance = s->snapDistance;
+      break;
+    case FREE_PLAY_EVENT:
+      s->freePlay = true;
+      ShowPalette(&s->render);
+      break;
+    case TRAIN_EVENT:
+      tap->TrainModifierDown = true;
+      break;
+    case SPAWN_EVENT:
+      tap->SpawnLength = event.arg;
+      break;
+    case RELEASE_EVENT:
+      tap->TrainModifierDown = false;
+      tap->SpawnLength = 0;
+      tap->MouseButtonReleased = true;
+      tap->MouseButtonDown = false;
+      tap->MouseButtonPressed = false;
+      WaitReplayEvent(s->replay, event.time);
+      tap->time = event.time;
       return;
     }
   }
   s->shouldEnd = true;
 }
 
+// Logs the collisions of the dragged rod as they start.
+void LogCollision(AppState *s)
+{
+  if (s->replayLog == NULL || !s->collisionState.collided || s->collisionState.collidedPreviously)
+  {
+    return;
+  }
+  Rod *rod = s->selectionState.selectedRod;
+  fprintf(s->replayLog, "c %f %d %f %f\n", s->timeAndPlace.time, (int)(rod - s->rodGroup->rods), rod->rect.x,
+          rod->rect.y);
+}
+
+// The rods as the replay left them, in the format of the taps.
+void LogFinalRods(AppState *s)
+{
+  if (s->replayLog == NULL)
+  {
+    return;
+  }
+  fprintf(s->replayLog, "s ");
+  SaveRodGroup(s->rodGroup, s->replayLog);
+  fprintf(s->replayLog, "\n");
+}
+
+// Logs the contacts of the selected rod when they changed this frame.
+void LogContacts(AppState *s)
+{
+  ContactGraph *contacts = s->collisionWorld->contacts;
+  if (contacts->nbChanges == s->contactChangesSeen)
+  {
+    return;
+  }
+  s->contactChangesSeen = contacts->nbChanges;
+  if (s->selectionState.selectedRod == NULL)
+  {
+    return;
+  }
+  int rodIndex = s->selectionState.selectedRod - s->rodGroup->rods;
+  const int *rods;
+  printf("CONTACTS : rod %d touches %d rods, connected to %d rods of total length %d\n",
+         rodIndex, GetContacts(contacts, rodIndex, &rods),
+         GetComponentSize(contacts, rodIndex) - 1, GetComponentLength(contacts, rodIndex));
+}
+
+// Distance between the selected rod and the others, from the latest distance field.
+float GetSelectedRodClearance(AppState *s)
+{
+  DistanceField *field = TakeDistanceField(s->fieldBuilder, s->rodIndexGeneration);
+  if (field != NULL)
+  {
+    FreeDistanceField(s->distanceField);
+    s->distanceField = field;
+  }
+  // The rods of a train are too close to each other for the field to tell.
+  if (s->selectionState.selectedRod == NULL || s->selectionState.dragsTrain)
+  {
+    return INFINITY;
+  }
+  Rod *rod = s->selectionState.selectedRod;
+  return GetRodClearance(s->distanceField, rod->rect, rod - s->rodGroup->rods);
+}
+
+void ApplyRequestedConfig(AppState *s)
+{
+  int configId = __atomic_exchange_n(&s->requestedConfig, -1, __ATOMIC_ACQUIRE);
+  if (configId >= 0)
+  {
+    SwapSignals(&s->signalState, s->selectionState, s->configBank->signalTables[configId], false);
+    printf("CONFIG : %s\n", s->configBank->names[configId]);
+  }
+
+  Signal *reloaded = TakeReloadedSignals(s->configWatcher);
+  if (reloaded != NULL)
+  {
+    SwapSignals(&s->signalState, s->selectionState, reloaded, true);
+  }
+}
+
 bool UpdateAppState(AppState *s)
 {
+  ApplyRequestedConfig(s);
+  ResolveSelection(&s->selectionState, s->rodGroup, s->rodHandles);
+
   if (s->isReplay) {
     UpdateTapFromSave(s);
   } else {
-    UpdateTimeAndPlace(&s->timeAndPlace);
+    UpdateTimeAndPlace(&s->timeAndPlace, s->input, s->camera);
+    // A rod left over the palette is picked rather than covered by a new one.
+    if (s->freePlay && s->timeAndPlace.MouseButtonPressed &&
+        PickRod(s->collisionWorld, s->timeAndPlace.mousePosition) == -1)
+    {
+      s->timeAndPlace.SpawnLength = GetSwatchUnder(s->timeAndPlace.mousePosition);
+    }
   }
+  s->signalState.time = s->timeAndPlace.time;
 
   bool somethingGoingOn = true;
-  if (s->timeAndPlace.MouseButtonPressed)
+  if (s->timeAndPlace.MouseButtonPressed && s->timeAndPlace.SpawnLength > 0)
   {
-    SelectRodUnderMouse(&s->selectionState, s->rodGroup, s->timeAndPlace.mousePosition);
+    SpawnRod(s, s->timeAndPlace.SpawnLength);
+  }
+  else if (s->timeAndPlace.MouseButtonPressed)
+  {
+    SelectRodUnderMouse(&s->selectionState, s->rodGroup, s->rodHandles, s->collisionWorld, s->timeAndPlace.mousePosition,
+                        s->timeAndPlace.TrainModifierDown);
   }
   else if (s->timeAndPlace.MouseButtonReleased)
   {
+    if (s->selectionState.selectedRod != NULL)
+    {
+      int rodIndex = s->selectionState.selectedRod - s->rodGroup->rods;
+      // Snapping a single rod of a train would pull it out of the train.
+      if (s->selectionState.dragsTrain)
+      {
+        SettleDroppedRods(s, s->collisionWorld->trainRods, s->collisionWorld->nbTrainRods);
+      }
+      else
+      {
+        DropRod(s->collisionWorld, rodIndex);
+        LogContacts(s);
+        SettleDroppedRods(s, &rodIndex, 1);
+      }
+      RequestDistanceField(s->fieldBuilder, s->rodGroup, s->rodIndexGeneration);
+    }
     ClearSelection(&s->selectionState);
     ClearCollisionState(&s->collisionState);
     ClearSignal(&s->signalState);
   }
   else if (s->timeAndPlace.MouseButtonDown)
   {
-    UpdateSelectedRodPosition2(&s->selectionState, &s->collisionState, s->rodGroup, s->timeAndPlace);
+    UpdateSelectedRodPosition2(&s->selectionState, &s->collisionState, s->rodGroup, s->collisionWorld, s->timeAndPlace);
+    LogCollision(s);
+    LogContacts(s);
   } else {
     somethingGoingOn = false;
   }
@@ -724,11 +1168,11 @@ bool UpdateAppState(AppState *s)
   }
   
 
-  UpdateSignalState(&s->signalState, s->selectionState, s->collisionState, s->timeAndPlace);
+  UpdateSignalState(&s->signalState, s->selectionState, s->collisionState, s->timeAndPlace, GetSelectedRodClearance(s));
   UpdateCollisionState(&s->collisionState);
   UpdateSelectionTimer(&s->selectionState);
 
-  if (IsKeyPressed(KEY_U) || s->newUser)
+  if (s->input.newUserPressed || s->newUser)
   {
     ClearAppState(s);
     CreateUserFolder(s);
@@ -736,7 +1180,7 @@ bool UpdateAppState(AppState *s)
     OpenSaveFile(s);
   }
 
-  if (IsKeyPressed(KEY_N) || s->next)
+  if (s->input.nextPressed || s->next)
   {
     ClearAppState(s);
     StartProblem(s);
@@ -752,13 +1196,57 @@ bool UpdateAppState(AppState *s)
 }
 
 
-void ParseArgs(int argc, char **argv, char **configName, char **specName, char **replayName)
+void FreeAppState(AppState *s)
+{
+  StopConfigWatcher(s->configWatcher);
+  StopFieldBuilder(s->fieldBuilder);
+  FreeDistanceField(s->distanceField);
+  FreeConfigBank(s->configBank);
+  FreeRodHandleTable(s->rodHandles);
+  FreeCollisionWorld(s->collisionWorld);
+  FreeWorkerPool(s->workerPool);
+  FreeInputSource(s->inputSource);
+  FreeReplay(s->replay);
+  if (s->replayLog != NULL)
+  {
+    fclose(s->replayLog);
+  }
+}
+
+void ParseArgs(int argc, char **argv, char **configName, char **specName, char **replayName, char **bankName, Resolver *resolver, float *snapDistance,
+               bool *freePlay, bool *retainedRender, bool *headless, char **scriptName, char **exportName,
+               float *replaySpeed, char **replayLogName, bool *textTaps)
 {
   int c;
-  while ((c = getopt(argc, argv, "c:s:r:")) != -1)
+  while ((c = getopt(argc, argv, "c:s:r:b:m:g:fdHi:e:x:o:T")) != -1)
   {
     switch (c)
     {
+    case 'x':
+      *replaySpeed = strtof(optarg, NULL);
+      break;
+    case 'o':
+      *replayLogName = optarg;
+      break;
+    case 'e':
+      *exportName = optarg;
+      *headless = true;
+      break;
+    case 'H':
+      *headless = true;
+      break;
+    case 'i':
+      *scriptName = optarg;
+      break;
+    case 'f':
+      *freePlay = true;
+      break;
+    case 'T':
+      *textTaps = true;
+      break;
+    case 'd':
+      *retainedRender = true;
+      break;
     case 'c':
       *configName = optarg;
       break;
@@ -768,8 +1256,23 @@ void ParseArgs(int argc, char **argv, char **configName, char **specName, char *
     case 'r':
       *replayName = optarg;
       break;
+    case 'b':
+      *bankName = optarg;
+      break;
+    case 'm':
+      if (FindResolver(optarg) == -1)
+      {
+        fprintf(stderr, "Mode de collision inconnu : %s.\n", optarg);
+        abort();
+      }
+      *resolver = FindResolver(optarg);
+      break;
+    case 'g':
+      *snapDistance = strtof(optarg, NULL);
+      break;
     case '?':
-      if (optopt == 'c' || optopt == 's')
+      if (optopt == 'c' || optopt == 's' || optopt == 'b' || optopt == 'm' || optopt == 'g' || optopt == 'i' || optopt == 'e' ||
+          optopt == 'x' || optopt == 'o')
       {
         fprintf(stderr, "L'option -%c nécessite un argument.\n", optopt);
       }
@@ -789,10 +1292,58 @@ void ParseArgs(int argc, char **argv, char **configName, char **specName, char *
   }
 }
 
-int main(int argc, char **argv)
+// Runs the state machine without a window nor drawing, as fast as the input
+// comes: taps are replayed without waiting and scripts run on their own clock.
+// The exporter, if any, gets the rods after every frame. Returns the number
+// of frames run.
+long RunHeadless(AppState *s, FrameExporter *exporter)
+{
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long nbFrames = 0;
+  bool goOn = true;
+  while (goOn)
+  {
+    s->input = ReadInput(s->inputSource);
+    if (s->input.closed)
+    {
+      break;
+    }
+    UpdateViewCamera(&s->camera, s->input);
+    goOn = UpdateAppState(s);
+    nbFrames += 1;
+    if (exporter != NULL && goOn)
+    {
+      TimeAndPlace tap = s->timeAndPlace;
+      ExportFrames(exporter, tap.time, s->rodGroup, tap.MouseButtonDown || tap.MouseButtonPressed, tap.mousePosition);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+  printf("HEADLESS : %ld frames in %.3f s, %.0f frames/s\n", nbFrames, seconds, nbFrames / fmax(seconds, 1e-9));
+  return nbFrames;
+}
+
+// Ends the report of a replay with the rods where it left them.
+void EndReplay(AppState *s, long nbFrames)
+{
+  if (!s->isReplay)
+  {
+    return;
+  }
+  double seconds = GetReplayWallTime(s->replay);
+  printf("REPLAY : %ld frames in %.3f s, %.0f frames/s, at %g times real time\n", nbFrames, seconds,
+         seconds > 0 ? nbFrames / seconds : 0, s->replay->speed);
+  LogFinalRods(s);
+}
+
+void StartWebsocket(void)
 {
   // Find local IP -->
-  const char *host;
+  // Every interface when there is no wlan0. The server thread reads the
+  // address after this returns.
+  const char *host = "0.0.0.0";
+  static char addressBuffer[INET_ADDRSTRLEN];
 
   struct ifaddrs * ifAddrStruct=NULL;
   struct ifaddrs * ifa=NULL;
@@ -808,7 +1359,6 @@ int main(int argc, char **argv)
           // is a valid IP4 Address
 
           tmpAddrPtr=&((struct sockaddr_in *)ifa->ifa_addr)->sin_addr;
-          char addressBuffer[INET_ADDRSTRLEN];
           inet_ntop(AF_INET, tmpAddrPtr, addressBuffer, INET_ADDRSTRLEN);
           if (strcmp(ifa->ifa_name, "wlan0") == 0) {
             printf("My local address is : %s\n", addressBuffer);
@@ -829,14 +1379,60 @@ int main(int argc, char **argv)
       .evs.onopen = &onopen,
       .evs.onclose = &onclose,
       .evs.onmessage = &onmessage});
+}
 
+int main(int argc, char **argv)
+{
   SetTraceLogLevel(LOG_ERROR);
 
   // Parse command line arguments -->
   char *configName = (char *)DEFAULT_CONFIG;
   char *specName = (char *)DEFAULT_SPEC;
   char *replayName = NULL;
-  ParseArgs(argc, argv, &configName, &specName, &replayName);
+  char *bankName = NULL;
+  Resolver resolver = CORNER_RESOLVER;
+  float snapDistance = 0;
+  bool freePlay = false;
+  bool retainedRender = false;
+  bool headless = false;
+  char *scriptName = NULL;
+  char *exportName = NULL;
+  // A negative speed stands for the default: real time in a window, as fast
+  // as possible without.
+  float replaySpeed = -1;
+  char *replayLogName = NULL;
+  bool textTaps = false;
+  ParseArgs(argc, argv, &configName, &specName, &replayName, &bankName, &resolver, &snapDistance, &freePlay,
+            &retainedRender, &headless, &scriptName, &exportName, &replaySpeed, &replayLogName, &textTaps);
+  if ((exportName != NULL || replayLogName != NULL) && replayName == NULL)
+  {
+    fprintf(stderr, "L'export des images et le rapport se font depuis une relecture (-r).\n");
+    return (EXIT_FAILURE);
+  }
+  if (replaySpeed < 0)
+  {
+    replaySpeed = headless ? 0 : 1;
+  }
+  if (headless && replayName == NULL && scriptName == NULL)
+  {
+    fprintf(stderr, "Sans fenêtre, l'entrée vient d'une relecture (-r) ou d'un script (-i).\n");
+    return (EXIT_FAILURE);
+  }
+
+  // A batch run doesn't take orders over the websocket.
+  if (!headless)
+  {
+    StartWebsocket();
+  }
+
+  // Without a window, a replay comes with no other input.
+  InputSource *inputSource = scriptName != NULL ? NewScriptedInput(scriptName, FPS)
+                             : headless         ? NewScriptedInput(NULL, FPS)
+                                                : NewLiveInput();
+  if (inputSource == NULL)
+  {
+    return (EXIT_FAILURE);
+  }
 
   // Load config -->
   bool config_error = false;
@@ -846,8 +1442,58 @@ int main(int argc, char **argv)
   {
     return (EXIT_FAILURE);
   }
+  // Every signal table, including the bank's and the reloaded ones, has one
+  // signal per length of the catalogue.
+  InitRodLengths(ReadNbLengths(cfg));
+  printf("LENGTHS : %d\n", nbRodLengths);
+
+  appState = InitAppState(cfg, 0, 5, replayName != NULL, replayName, resolver, snapDistance, freePlay,
+                          retainedRender, textTaps);
+  if (bankName != NULL)
+  {
+    appState.configBank = LoadConfigBank(bankName, nbRodLengths);
+  }
+  appState.inputSource = inputSource;
+  if (appState.replay != NULL)
+  {
+    appState.replay->speed = replaySpeed;
+  }
+  if (replayLogName != NULL)
+  {
+    appState.replayLog = fopen(replayLogName, "w");
+    if (appState.replayLog == NULL)
+    {
+      fprintf(stderr, "Couldn't write the replay report to %s.\n", replayLogName);
+      return (EXIT_FAILURE);
+    }
+    appState.signalState.commandLog = appState.replayLog;
+  }
+  if (replayName == NULL && !headless)
+  {
+    appState.configWatcher = StartConfigWatcher(configName, nbRodLengths);
+  }
 
-  appState = InitAppState(cfg, 0, 5, replayName != NULL, replayName);
+  if (headless)
+  {
+    FrameExporter *exporter = NULL;
+    if (exportName != NULL)
+    {
+      exporter = NewFrameExporter(exportName, TABLET_LENGTH, TABLED_HEIGHT, FPS, appState.workerPool);
+      if (exporter == NULL)
+      {
+        return (EXIT_FAILURE);
+      }
+    }
+    long nbFrames = RunHeadless(&appState, exporter);
+    if (exporter != NULL)
+    {
+      printf("EXPORT : %ld frames written to %s\n", CloseFrameExporter(exporter), exportName);
+    }
+    ClearAppState(&appState);
+    EndReplay(&appState, nbFrames);
+    FreeAppState(&appState);
+    return 0;
+  }
 
   InitWindow(TABLET_LENGTH, TABLED_HEIGHT, "HapticRods");
 
@@ -856,39 +1502,61 @@ int main(int argc, char **argv)
   ToggleFullscreen();
 #endif
 
-  SetTargetFPS(FPS);
-
-  FILE *save = NULL;
-  if (replayName != NULL) {
-    save = fopen(replayName, "r");
-    printf("%p\n", save);
+  // A replay feeds an event per frame, so it draws as many frames as it
+  // plays events; 0 doesn't cap the frame rate. A slow motion replay still
+  // draws a frame per second at least.
+  int frameRate = FPS;
+  if (replayName != NULL)
+  {
+    frameRate = replaySpeed > 0 ? fmaxf(lroundf(FPS * replaySpeed), 1) : 0;
   }
+  SetTargetFPS(frameRate);
 
   // Main loop
+  long nbFrames = 0;
   bool goOn = true;
   while (!WindowShouldClose() && goOn)
   {
-    BeginDrawing();
-    ClearBackground(RAYWHITE);
-
-
+    StartFrameStats(&appState.render);
+    appState.input = ReadInput(appState.inputSource);
+    if (appState.input.closed)
+    {
+      break;
+    }
+    UpdateViewCamera(&appState.camera, appState.input);
     goOn = UpdateAppState(&appState);
-    DrawRodGroup(appState.rodGroup);
-
-    if (save != NULL && (appState.timeAndPlace.MouseButtonDown || appState.timeAndPlace.MouseButtonPressed)) {
-      DrawCircle(appState.timeAndPlace.mousePosition.x, 
-          appState.timeAndPlace.mousePosition.y,
-          5,
-          RED);
+    nbFrames += 1;
+
+    ClearOverlays(&appState.render);
+    int selectedRod;
+    const int *movingRods;
+    int nbMovingRods = AddSelectionOverlays(&appState.render, appState.selectionState, appState.rodGroup,
+                                            appState.collisionWorld, &selectedRod, &movingRods);
+    if (appState.isReplay && (appState.timeAndPlace.MouseButtonDown || appState.timeAndPlace.MouseButtonPressed)) {
+      Vector2 mouse = appState.timeAndPlace.mousePosition;
+      AddOverlay(&appState.render, OVERLAY_CURSOR, (Rectangle){mouse.x - 5, mouse.y - 5, 10, 10}, RED);
     }
 
-    DrawFPS(0, 0);
-
-    EndDrawing();
+    SetRenderCamera(&appState.render, appState.camera);
+    // A skipped frame doesn't go through EndDrawing, which polls the input
+    // and waits for the next frame.
+    if (!RenderFrame(&appState.render, appState.rodGroup, appState.collisionWorld->grid, appState.rodHandles, movingRods,
+                     nbMovingRods))
+    {
+      PollInputEvents();
+      if (frameRate > 0)
+      {
+        WaitTime(1. / frameRate);
+      }
+    }
   } // <-- Main loop
 
   ClearAppState(&appState);
+  EndReplay(&appState, nbFrames);
+  PrintRenderStats(&appState.render);
+  FreeRenderCache(&appState.render);
   CloseWindow();
+  FreeAppState(&appState);
 
   printf("Window closed!\n");
 
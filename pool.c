@@ -0,0 +1,153 @@
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct Worker
+{
+  WorkerPool *pool;
+  int index;
+} Worker;
+
+int GetCoreCount(void)
+{
+  long nbCores = sysconf(_SC_NPROCESSORS_ONLN);
+  return nbCores < 1 ? 1 : nbCores;
+}
+
+// Tiles are handed out one at a time, so that threads finishing early take
+// more of them.
+void RunJobTiles(WorkerPool *pool, int worker)
+{
+  for (;;)
+  {
+    int tile = __atomic_fetch_add(&pool->nextTile, 1, __ATOMIC_RELAXED);
+    if (tile >= pool->nbTiles)
+    {
+      return;
+    }
+    pool->job(pool->context, tile, worker);
+  }
+}
+
+void *RunWorker(void *arg)
+{
+  Worker *worker = arg;
+  WorkerPool *pool = worker->pool;
+  int nbJobsSeen = 0;
+  pthread_mutex_lock(&pool->lock);
+  for (;;)
+  {
+    while (pool->nbJobs == nbJobsSeen && !pool->stopping)
+    {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->stopping)
+    {
+      break;
+    }
+    nbJobsSeen = pool->nbJobs;
+    pthread_mutex_unlock(&pool->lock);
+
+    RunJobTiles(pool, worker->index);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->nbBusy -= 1;
+    if (pool->nbBusy == 0)
+    {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  free(worker);
+  return NULL;
+}
+
+// nbWorkers threads besides the calling one; with none, jobs simply run on
+// the calling thread.
+WorkerPool *NewWorkerPool(int nbWorkers)
+{
+  WorkerPool *pool = malloc(sizeof(WorkerPool));
+  pool->threads = nbWorkers > 0 ? malloc(nbWorkers * sizeof(pthread_t)) : NULL;
+  pool->nbTiles = 0;
+  pool->nextTile = 0;
+  pool->nbBusy = 0;
+  pool->nbJobs = 0;
+  pool->stopping = false;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->nbWorkers = 0;
+  for (int i = 0; i < nbWorkers; i++)
+  {
+    Worker *worker = malloc(sizeof(Worker));
+    *worker = (Worker){pool, i + 1};
+    if (pthread_create(&pool->threads[i], NULL, RunWorker, worker) != 0)
+    {
+      perror("Couldn't start a worker");
+      free(worker);
+      break;
+    }
+    pool->nbWorkers += 1;
+  }
+  return pool;
+}
+
+void FreeWorkerPool(WorkerPool *pool)
+{
+  if (pool == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->nbWorkers; i++)
+  {
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->wake);
+  pthread_cond_destroy(&pool->done);
+  free(pool->threads);
+  free(pool);
+}
+
+// Threads running the tiles of a job, the calling one included.
+int GetPoolThreadCount(WorkerPool *pool)
+{
+  return pool == NULL ? 1 : pool->nbWorkers + 1;
+}
+
+// Runs job on every tile and returns once they are all done. Works without a
+// pool too, on the calling thread alone.
+void RunTiles(WorkerPool *pool, int nbTiles, TileJob job, void *context)
+{
+  if (pool == NULL || pool->nbWorkers == 0 || nbTiles <= 1)
+  {
+    for (int tile = 0; tile < nbTiles; tile++)
+    {
+      job(context, tile, 0);
+    }
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->job = job;
+  pool->context = context;
+  pool->nbTiles = nbTiles;
+  pool->nextTile = 0;
+  pool->nbBusy = pool->nbWorkers;
+  pool->nbJobs += 1;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  RunJobTiles(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->nbBusy > 0)
+  {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,37 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Called once per tile, by any thread of the pool. worker tells the threads
+// apart (0 to nbWorkers, the calling thread included), for per-thread scratch.
+typedef void (*TileJob)(void *context, int tile, int worker);
+
+// Threads sharing the tiles of a job with the calling thread. A job writes
+// each tile's results apart, and the caller merges them in tile order, so
+// results don't depend on the number of threads nor on their timing.
+typedef struct WorkerPool
+{
+  int nbWorkers;
+  pthread_t *threads;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+  TileJob job;
+  void *context;
+  int nbTiles;
+  int nextTile;
+  // Workers still on the current job, and the number of jobs started.
+  int nbBusy;
+  int nbJobs;
+  bool stopping;
+} WorkerPool;
+
+int GetCoreCount(void);
+WorkerPool *NewWorkerPool(int nbWorkers);
+void FreeWorkerPool(WorkerPool *pool);
+int GetPoolThreadCount(WorkerPool *pool);
+void RunTiles(WorkerPool *pool, int nbTiles, TileJob job, void *context);
+
+#endif
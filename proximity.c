@@ -0,0 +1,244 @@
+#include "proximity.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+float SignedRectDistance(Rectangle rect, float x, float y)
+{
+  float dx = fmaxf(fmaxf(rect.x - x, x - (rect.x + rect.width)), 0);
+  float dy = fmaxf(fmaxf(rect.y - y, y - (rect.y + rect.height)), 0);
+  if (dx > 0 || dy > 0)
+  {
+    return sqrtf(dx * dx + dy * dy);
+  }
+  float inside = fminf(fminf(x - rect.x, rect.x + rect.width - x),
+                       fminf(y - rect.y, rect.y + rect.height - y));
+  return -inside;
+}
+
+DistanceField *BuildDistanceField(const Rectangle *rects, int nbRods, float width, float height, float range)
+{
+  // The field covers the tablet and every rod, plus the range around them.
+  float minX = 0, minY = 0, maxX = width, maxY = height;
+  for (int i = 0; i < nbRods; i++)
+  {
+    minX = fminf(minX, rects[i].x);
+    minY = fminf(minY, rects[i].y);
+    maxX = fmaxf(maxX, rects[i].x + rects[i].width);
+    maxY = fmaxf(maxY, rects[i].y + rects[i].height);
+  }
+
+  DistanceField *field = malloc(sizeof(DistanceField));
+  field->originX = minX - range + PROXIMITY_CELL / 2.;
+  field->originY = minY - range + PROXIMITY_CELL / 2.;
+  field->nbColumns = ceilf((maxX - minX + 2 * range) / PROXIMITY_CELL) + 1;
+  field->nbRows = ceilf((maxY - minY + 2 * range) / PROXIMITY_CELL) + 1;
+  field->range = range;
+  int nbCells = field->nbColumns * field->nbRows;
+  field->nearest = malloc(nbCells * sizeof(float));
+  field->nearestRods = malloc(nbCells * sizeof(int));
+  field->second = malloc(nbCells * sizeof(float));
+  for (int c = 0; c < nbCells; c++)
+  {
+    field->nearest[c] = range;
+    field->nearestRods[c] = -1;
+    field->second[c] = range;
+  }
+
+  // Each rod only reaches the cells within range of it.
+  for (int i = 0; i < nbRods; i++)
+  {
+    Rectangle rect = rects[i];
+    int firstColumn = fmaxf(floorf((rect.x - range - field->originX) / PROXIMITY_CELL), 0);
+    int lastColumn = fminf(ceilf((rect.x + rect.width + range - field->originX) / PROXIMITY_CELL), field->nbColumns - 1);
+    int firstRow = fmaxf(floorf((rect.y - range - field->originY) / PROXIMITY_CELL), 0);
+    int lastRow = fminf(ceilf((rect.y + rect.height + range - field->originY) / PROXIMITY_CELL), field->nbRows - 1);
+    for (int row = firstRow; row <= lastRow; row++)
+    {
+      float y = field->originY + row * PROXIMITY_CELL;
+      for (int column = firstColumn; column <= lastColumn; column++)
+      {
+        int c = row * field->nbColumns + column;
+        float d = SignedRectDistance(rect, field->originX + column * PROXIMITY_CELL, y);
+        if (d < field->nearest[c])
+        {
+          field->second[c] = field->nearest[c];
+          field->nearest[c] = d;
+          field->nearestRods[c] = i;
+        }
+        else if (d < field->second[c])
+        {
+          field->second[c] = d;
+        }
+      }
+    }
+  }
+  return field;
+}
+
+void FreeDistanceField(DistanceField *field)
+{
+  if (field == NULL)
+  {
+    return;
+  }
+  free(field->nearest);
+  free(field->nearestRods);
+  free(field->second);
+  free(field);
+}
+
+float SampleField(const DistanceField *field, float x, float y, int rodIndex)
+{
+  int column = floorf((x - field->originX) / PROXIMITY_CELL + 0.5);
+  int row = floorf((y - field->originY) / PROXIMITY_CELL + 0.5);
+  if (column < 0 || column >= field->nbColumns || row < 0 || row >= field->nbRows)
+  {
+    return field->range;
+  }
+  int c = row * field->nbColumns + column;
+  return field->nearestRods[c] == rodIndex ? field->second[c] : field->nearest[c];
+}
+
+// Smallest distance between the outline of the rect and the other rods, up to the range.
+float GetRodClearance(const DistanceField *field, Rectangle rect, int rodIndex)
+{
+  if (field == NULL)
+  {
+    return INFINITY;
+  }
+  float clearance = field->range;
+  int nbStepsX = fmaxf(ceilf(rect.width / PROXIMITY_CELL), 1);
+  int nbStepsY = fmaxf(ceilf(rect.height / PROXIMITY_CELL), 1);
+  for (int i = 0; i <= nbStepsX; i++)
+  {
+    float x = rect.x + rect.width * i / nbStepsX;
+    clearance = fminf(clearance, SampleField(field, x, rect.y, rodIndex));
+    clearance = fminf(clearance, SampleField(field, x, rect.y + rect.height, rodIndex));
+  }
+  for (int i = 1; i < nbStepsY; i++)
+  {
+    float y = rect.y + rect.height * i / nbStepsY;
+    clearance = fminf(clearance, SampleField(field, rect.x, y, rodIndex));
+    clearance = fminf(clearance, SampleField(field, rect.x + rect.width, y, rodIndex));
+  }
+  return clearance;
+}
+
+void *BuildFields(void *arg)
+{
+  FieldBuilder *builder = arg;
+  pthread_mutex_lock(&builder->lock);
+  for (;;)
+  {
+    while (builder->requestRects == NULL && !builder->stopping)
+    {
+      pthread_cond_wait(&builder->wake, &builder->lock);
+    }
+    if (builder->stopping)
+    {
+      break;
+    }
+    Rectangle *rects = builder->requestRects;
+    int nbRods = builder->requestNbRods;
+    int generation = builder->requestGeneration;
+    builder->requestRects = NULL;
+    pthread_mutex_unlock(&builder->lock);
+
+    DistanceField *field = BuildDistanceField(rects, nbRods, builder->width, builder->height, builder->range);
+    free(rects);
+    field->generation = generation;
+    // A field that the render loop hasn't taken yet is simply replaced.
+    DistanceField *stale = __atomic_exchange_n(&builder->pending, field, __ATOMIC_ACQ_REL);
+    FreeDistanceField(stale);
+
+    pthread_mutex_lock(&builder->lock);
+  }
+  pthread_mutex_unlock(&builder->lock);
+  return NULL;
+}
+
+FieldBuilder *StartFieldBuilder(float width, float height, float range)
+{
+  FieldBuilder *builder = malloc(sizeof(FieldBuilder));
+  builder->width = width;
+  builder->height = height;
+  builder->range = range;
+  builder->requestRects = NULL;
+  builder->requestNbRods = 0;
+  builder->requestGeneration = 0;
+  builder->stopping = false;
+  builder->pending = NULL;
+  pthread_mutex_init(&builder->lock, NULL);
+  pthread_cond_init(&builder->wake, NULL);
+  if (pthread_create(&builder->thread, NULL, BuildFields, builder) != 0)
+  {
+    perror("Couldn't start the distance field builder");
+    pthread_mutex_destroy(&builder->lock);
+    pthread_cond_destroy(&builder->wake);
+    free(builder);
+    return NULL;
+  }
+  return builder;
+}
+
+// The layout is copied, so the rods can keep moving while the field is built.
+// The generation is that of the rod indices, bumped by the caller whenever
+// the rods change index.
+void RequestDistanceField(FieldBuilder *builder, const RodGroup *rodGroup, int generation)
+{
+  if (builder == NULL)
+  {
+    return;
+  }
+  // One spare byte so that an empty layout is still a request.
+  Rectangle *rects = malloc(rodGroup->nbRods * sizeof(Rectangle) + 1);
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    rects[i] = rodGroup->rods[i].rect;
+  }
+  pthread_mutex_lock(&builder->lock);
+  // Only the latest layout matters.
+  free(builder->requestRects);
+  builder->requestRects = rects;
+  builder->requestNbRods = rodGroup->nbRods;
+  builder->requestGeneration = generation;
+  pthread_cond_signal(&builder->wake);
+  pthread_mutex_unlock(&builder->lock);
+}
+
+// A field built before the rods last changed index would blame the wrong
+// rods: it is dropped, the field of the latest request being on its way.
+DistanceField *TakeDistanceField(FieldBuilder *builder, int generation)
+{
+  if (builder == NULL)
+  {
+    return NULL;
+  }
+  DistanceField *field = __atomic_exchange_n(&builder->pending, NULL, __ATOMIC_ACQ_REL);
+  if (field != NULL && field->generation < generation)
+  {
+    FreeDistanceField(field);
+    return NULL;
+  }
+  return field;
+}
+
+void StopFieldBuilder(FieldBuilder *builder)
+{
+  if (builder == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock(&builder->lock);
+  builder->stopping = true;
+  pthread_cond_signal(&builder->wake);
+  pthread_mutex_unlock(&builder->lock);
+  pthread_join(builder->thread, NULL);
+  free(builder->requestRects);
+  FreeDistanceField(builder->pending);
+  pthread_mutex_destroy(&builder->lock);
+  pthread_cond_destroy(&builder->wake);
+  free(builder);
+}
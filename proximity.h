@@ -0,0 +1,56 @@
+#ifndef PROXIMITY_H
+#define PROXIMITY_H
+
+#include "rods.h"
+#include <pthread.h>
+#include <stdbool.h>
+
+// Side of a distance field cell, in pixels.
+#define PROXIMITY_CELL 4
+
+// Signed distance to the static rods, sampled at the centre of each cell and
+// clamped to the range.
+typedef struct DistanceField
+{
+  float originX;
+  float originY;
+  int nbColumns;
+  int nbRows;
+  float range;
+  // Distance to the nearest rod, negative inside it.
+  float *nearest;
+  int *nearestRods;
+  // Distance to the nearest rod other than nearestRods, so that the dragged
+  // rod can ignore its own footprint.
+  float *second;
+  // Of the rod indices the field was built with.
+  int generation;
+} DistanceField;
+
+typedef struct FieldBuilder
+{
+  float width;
+  float height;
+  float range;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  // Latest layout to build, NULL when the thread is idle.
+  Rectangle *requestRects;
+  int requestNbRods;
+  int requestGeneration;
+  bool stopping;
+  // Published by the builder thread, taken by the render loop.
+  DistanceField *pending;
+} FieldBuilder;
+
+DistanceField *BuildDistanceField(const Rectangle *rects, int nbRods, float width, float height, float range);
+void FreeDistanceField(DistanceField *field);
+float GetRodClearance(const DistanceField *field, Rectangle rect, int rodIndex);
+
+FieldBuilder *StartFieldBuilder(float width, float height, float range);
+void RequestDistanceField(FieldBuilder *builder, const RodGroup *rodGroup, int generation);
+DistanceField *TakeDistanceField(FieldBuilder *builder, int generation);
+void StopFieldBuilder(FieldBuilder *builder);
+
+#endif
@@ -0,0 +1,475 @@
+#include "render.h"
+#include "rlgl.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Past this many damaged areas, their bounding box is redrawn instead.
+#define MAX_DAMAGED_AREAS 64
+// The FPS and the counters, in the top left corner.
+#define STATS_WIDTH 480
+#define STATS_HEIGHT 44
+
+RenderCache NewRenderCache(int width, int height, bool retained)
+{
+  // The textures need a window, they are loaded with the first frame.
+  return (RenderCache){.retained = retained, .width = width, .height = height,
+                       .camera = {.offset = {0, 0}, .target = {0, 0}, .rotation = 0, .zoom = 1},
+                       .loaded = false, .valid = false,
+                       .nbSwatches = 0, .swatches = NULL,
+                       .overlays = {0}, .drawnOverlays = {0},
+                       .nbMovingRods = 0, .movingCapacity = 0, .movingRods = NULL,
+                       .movingMarks = NULL, .movingMark = 0, .marksCapacity = 0,
+                       .nbDamaged = 0, .damagedCapacity = 0, .damaged = NULL,
+                       .stats = {0}};
+}
+
+void FreeRenderCache(RenderCache *cache)
+{
+  if (cache->loaded)
+  {
+    UnloadRenderTexture(cache->restingLayer);
+    UnloadRenderTexture(cache->frame);
+  }
+  free(cache->swatches);
+  free(cache->overlays.overlays);
+  free(cache->drawnOverlays.overlays);
+  free(cache->movingRods);
+  free(cache->movingMarks);
+  free(cache->damaged);
+}
+
+// To call when the rods changed in any other way than being picked up,
+// dragged or dropped, e.g. on a new problem.
+void InvalidateRenderCache(RenderCache *cache)
+{
+  cache->valid = false;
+}
+
+void SetRenderCamera(RenderCache *cache, Camera2D camera)
+{
+  Camera2D former = cache->camera;
+  if (camera.offset.x != former.offset.x || camera.offset.y != former.offset.y || camera.target.x != former.target.x ||
+      camera.target.y != former.target.y || camera.zoom != former.zoom)
+  {
+    cache->camera = camera;
+    cache->valid = false;
+  }
+}
+
+// Screen area covered by the world rectangle, the camera never rotating.
+Rectangle GetScreenArea(RenderCache *cache, Rectangle rect)
+{
+  Camera2D camera = cache->camera;
+  return (Rectangle){(rect.x - camera.target.x) * camera.zoom + camera.offset.x,
+                     (rect.y - camera.target.y) * camera.zoom + camera.offset.y, rect.width * camera.zoom,
+                     rect.height * camera.zoom};
+}
+
+Rectangle GetWorldArea(RenderCache *cache, Rectangle area)
+{
+  Camera2D camera = cache->camera;
+  return (Rectangle){(area.x - camera.offset.x) / camera.zoom + camera.target.x,
+                     (area.y - camera.offset.y) / camera.zoom + camera.target.y, area.width / camera.zoom,
+                     area.height / camera.zoom};
+}
+
+void SetRenderSwatches(RenderCache *cache, const Swatch *swatches, int nbSwatches)
+{
+  free(cache->swatches);
+  cache->swatches = NULL;
+  if (nbSwatches > 0)
+  {
+    cache->swatches = malloc(nbSwatches * sizeof(Swatch));
+    memcpy(cache->swatches, swatches, nbSwatches * sizeof(Swatch));
+  }
+  cache->nbSwatches = nbSwatches;
+  cache->valid = false;
+}
+
+void ClearOverlays(RenderCache *cache)
+{
+  cache->overlays.nbOverlays = 0;
+}
+
+void AddOverlay(RenderCache *cache, OverlayKind kind, Rectangle rect, Color color)
+{
+  OverlayList *list = &cache->overlays;
+  if (list->nbOverlays == list->capacity)
+  {
+    list->capacity = list->capacity == 0 ? 16 : 2 * list->capacity;
+    list->overlays = realloc(list->overlays, list->capacity * sizeof(Overlay));
+  }
+  list->overlays[list->nbOverlays] = (Overlay){kind, rect, color};
+  list->nbOverlays += 1;
+}
+
+double GetThreadCpuTime(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// To call before updating the state, so that the update counts in the frame.
+void StartFrameStats(RenderCache *cache)
+{
+  cache->stats.frameDrawCalls = 0;
+  cache->stats.frameRods = 0;
+  cache->stats.frameStart = GetThreadCpuTime();
+}
+
+void FinishFrameStats(RenderStats *stats, bool drawn)
+{
+  double cpuTime = GetThreadCpuTime() - stats->frameStart;
+  stats->totalCpuTime += cpuTime;
+  if (drawn)
+  {
+    stats->lastDrawCalls = stats->frameDrawCalls;
+    stats->lastRods = stats->frameRods;
+    stats->lastCpuTime = cpuTime;
+    stats->totalDrawCalls += stats->frameDrawCalls;
+    stats->nbFramesDrawn += 1;
+  }
+  else
+  {
+    stats->nbFramesSkipped += 1;
+  }
+}
+
+void DrawRestingRod(RenderStats *stats, Rod rod)
+{
+  DrawRectangleRec(rod.rect, GetRodColor(rod));
+  DrawRectangleLinesEx(rod.rect, 1., BLACK);
+  stats->frameDrawCalls += 2;
+}
+
+void DrawRodQuad(Rod rod)
+{
+  Color color = GetRodColor(rod);
+  rlColor4ub(color.r, color.g, color.b, color.a);
+  rlVertex2f(rod.rect.x, rod.rect.y);
+  rlVertex2f(rod.rect.x, rod.rect.y + rod.rect.height);
+  rlVertex2f(rod.rect.x + rod.rect.width, rod.rect.y + rod.rect.height);
+  rlVertex2f(rod.rect.x + rod.rect.width, rod.rect.y);
+}
+
+// Draws the rods in the world area, the overlays aside if skipMoving, and
+// returns the bounding box of the area and the rods drawn. The rods are drawn
+// whole, which is harmless since they don't overlap.
+Rectangle DrawRestingRods(RenderCache *cache, RodGroup *rodGroup, RodGrid *grid, Rectangle area, bool skipMoving)
+{
+  bool batched = cache->camera.zoom < BATCH_ZOOM;
+  if (batched)
+  {
+    rlBegin(RL_QUADS);
+  }
+  Rectangle drawn = area;
+  const int *rods;
+  int nbRods = QueryRodGrid(grid, area, &rods);
+  for (int i = 0; i < nbRods; i++)
+  {
+    Rod rod = rodGroup->rods[rods[i]];
+    if ((skipMoving && cache->movingMarks[rods[i]] == cache->movingMark) || !CheckCollisionRecs(rod.rect, area))
+    {
+      continue;
+    }
+    if (batched)
+    {
+      DrawRodQuad(rod);
+    }
+    else
+    {
+      DrawRestingRod(&cache->stats, rod);
+    }
+    cache->stats.frameRods += 1;
+    float right = fmaxf(drawn.x + drawn.width, GetRight(rod));
+    float bottom = fmaxf(drawn.y + drawn.height, GetBottom(rod));
+    drawn.x = fminf(drawn.x, GetLeft(rod));
+    drawn.y = fminf(drawn.y, GetTop(rod));
+    drawn.width = right - drawn.x;
+    drawn.height = bottom - drawn.y;
+  }
+  if (batched)
+  {
+    rlEnd();
+    cache->stats.frameDrawCalls += 1;
+  }
+  return drawn;
+}
+
+void DrawSwatches(RenderCache *cache, Rectangle area)
+{
+  for (int i = 0; i < cache->nbSwatches; i++)
+  {
+    if (CheckCollisionRecs(cache->swatches[i].rect, area))
+    {
+      DrawRectangleRec(cache->swatches[i].rect, cache->swatches[i].color);
+      DrawRectangleLinesEx(cache->swatches[i].rect, 1., BLACK);
+      cache->stats.frameDrawCalls += 2;
+    }
+  }
+}
+
+void DrawOverlays(RenderCache *cache)
+{
+  for (int i = 0; i < cache->overlays.nbOverlays; i++)
+  {
+    Overlay overlay = cache->overlays.overlays[i];
+    switch (overlay.kind)
+    {
+    case OVERLAY_ROD:
+      DrawRectangleRec(overlay.rect, overlay.color);
+      DrawRectangleLinesEx(overlay.rect, 1., BLACK);
+      cache->stats.frameDrawCalls += 2;
+      break;
+    case OVERLAY_OUTLINE:
+      DrawRectangleLinesEx(overlay.rect, 3., overlay.color);
+      cache->stats.frameDrawCalls += 1;
+      break;
+    case OVERLAY_CURSOR:
+      DrawCircle(overlay.rect.x + overlay.rect.width / 2, overlay.rect.y + overlay.rect.height / 2, overlay.rect.width / 2,
+                 overlay.color);
+      cache->stats.frameDrawCalls += 1;
+      break;
+    }
+  }
+}
+
+void DrawRenderStats(RenderCache *cache)
+{
+  DrawFPS(0, 0);
+  DrawText(TextFormat("%d draw calls, %d rods, %.2f ms CPU", cache->stats.lastDrawCalls, cache->stats.lastRods,
+                      cache->stats.lastCpuTime * 1000),
+           0, 22, 20, DARKGRAY);
+  cache->stats.frameDrawCalls += 2;
+}
+
+void RenderImmediateFrame(RenderCache *cache, RodGroup *rodGroup, RodGrid *grid)
+{
+  BeginDrawing();
+  ClearBackground(RAYWHITE);
+  cache->stats.frameDrawCalls += 1;
+  BeginMode2D(cache->camera);
+  Rectangle view = GetWorldArea(cache, (Rectangle){0, 0, cache->width, cache->height});
+  DrawSwatches(cache, DrawRestingRods(cache, rodGroup, grid, view, false));
+  DrawOverlays(cache);
+  EndMode2D();
+  DrawRenderStats(cache);
+  FinishFrameStats(&cache->stats, true);
+  EndDrawing();
+}
+
+void AddDamagedArea(RenderCache *cache, Rectangle area)
+{
+  float left = fmaxf(floorf(area.x) - 1, 0);
+  float top = fmaxf(floorf(area.y) - 1, 0);
+  float right = fminf(ceilf(area.x + area.width) + 1, cache->width);
+  float bottom = fminf(ceilf(area.y + area.height) + 1, cache->height);
+  if (left >= right || top >= bottom)
+  {
+    return;
+  }
+  if (cache->nbDamaged == cache->damagedCapacity)
+  {
+    cache->damagedCapacity = cache->damagedCapacity == 0 ? 16 : 2 * cache->damagedCapacity;
+    cache->damaged = realloc(cache->damaged, cache->damagedCapacity * sizeof(Rectangle));
+  }
+  cache->damaged[cache->nbDamaged] = (Rectangle){left, top, right - left, bottom - top};
+  cache->nbDamaged += 1;
+}
+
+// Replaces the damaged areas by their bounding box when there are too many.
+void MergeDamagedAreas(RenderCache *cache, int first)
+{
+  if (cache->nbDamaged - first <= MAX_DAMAGED_AREAS)
+  {
+    return;
+  }
+  Rectangle box = cache->damaged[first];
+  for (int i = first + 1; i < cache->nbDamaged; i++)
+  {
+    Rectangle area = cache->damaged[i];
+    float right = fmaxf(box.x + box.width, area.x + area.width);
+    float bottom = fmaxf(box.y + box.height, area.y + area.height);
+    box.x = fminf(box.x, area.x);
+    box.y = fminf(box.y, area.y);
+    box.width = right - box.x;
+    box.height = bottom - box.y;
+  }
+  cache->damaged[first] = box;
+  cache->nbDamaged = first + 1;
+}
+
+// Redraws the resting rods over the area of the screen, the overlays aside,
+// and the swatches over them.
+void RepaintRestingArea(RenderCache *cache, RodGroup *rodGroup, RodGrid *grid, Rectangle screenArea)
+{
+  Rectangle area = GetWorldArea(cache, screenArea);
+  DrawRectangleRec(area, RAYWHITE);
+  cache->stats.frameDrawCalls += 1;
+  DrawSwatches(cache, DrawRestingRods(cache, rodGroup, grid, area, true));
+}
+
+// Marks the rods drawn as overlays in this frame, and damages the place of
+// those that were picked up or dropped since the last frame drawn.
+void UpdateMovingRods(RenderCache *cache, RodGroup *rodGroup, RodHandleTable *rodHandles, const int *movingRods,
+                      int nbMovingRods)
+{
+  if (cache->marksCapacity < rodGroup->capacity)
+  {
+    cache->movingMarks = realloc(cache->movingMarks, rodGroup->capacity * sizeof(int));
+    memset(&cache->movingMarks[cache->marksCapacity], 0, (rodGroup->capacity - cache->marksCapacity) * sizeof(int));
+    cache->marksCapacity = rodGroup->capacity;
+  }
+  int formerMark = ++cache->movingMark;
+  for (int i = 0; i < cache->nbMovingRods; i++)
+  {
+    int rodIndex = ResolveRodHandle(rodHandles, cache->movingRods[i]);
+    if (rodIndex != -1)
+    {
+      cache->movingMarks[rodIndex] = formerMark;
+    }
+  }
+  int mark = ++cache->movingMark;
+  for (int i = 0; i < nbMovingRods; i++)
+  {
+    if (cache->valid && cache->movingMarks[movingRods[i]] != formerMark)
+    {
+      AddDamagedArea(cache, GetScreenArea(cache, rodGroup->rods[movingRods[i]].rect));
+    }
+    cache->movingMarks[movingRods[i]] = mark;
+  }
+  // A rod that was deleted since has no index anymore; its place is damaged
+  // as that of an overlay.
+  for (int i = 0; i < cache->nbMovingRods; i++)
+  {
+    int rodIndex = ResolveRodHandle(rodHandles, cache->movingRods[i]);
+    if (cache->valid && rodIndex != -1 && cache->movingMarks[rodIndex] != mark)
+    {
+      AddDamagedArea(cache, GetScreenArea(cache, rodGroup->rods[rodIndex].rect));
+    }
+  }
+
+  if (cache->movingCapacity < nbMovingRods)
+  {
+    cache->movingCapacity = nbMovingRods;
+    cache->movingRods = realloc(cache->movingRods, cache->movingCapacity * sizeof(RodHandle));
+  }
+  for (int i = 0; i < nbMovingRods; i++)
+  {
+    cache->movingRods[i] = GetRodHandle(rodHandles, movingRods[i]);
+  }
+  cache->nbMovingRods = nbMovingRods;
+}
+
+bool SameOverlays(OverlayList *a, OverlayList *b)
+{
+  return a->nbOverlays == b->nbOverlays && memcmp(a->overlays, b->overlays, a->nbOverlays * sizeof(Overlay)) == 0;
+}
+
+void DamageOverlays(RenderCache *cache, OverlayList *list)
+{
+  for (int i = 0; i < list->nbOverlays; i++)
+  {
+    AddDamagedArea(cache, GetScreenArea(cache, list->overlays[i].rect));
+  }
+}
+
+// The region of a render texture that covers the area of the screen, since
+// render textures are stored upside down.
+Rectangle GetTextureArea(RenderCache *cache, Rectangle area)
+{
+  return (Rectangle){area.x, cache->height - area.y - area.height, area.width, -area.height};
+}
+
+// Draws the frame, the movingRods being drawn as overlays, and returns false
+// when it was skipped: the caller must then poll the input and wait itself.
+bool RenderFrame(RenderCache *cache, RodGroup *rodGroup, RodGrid *grid, RodHandleTable *rodHandles, const int *movingRods,
+                 int nbMovingRods)
+{
+  if (!cache->retained)
+  {
+    RenderImmediateFrame(cache, rodGroup, grid);
+    return true;
+  }
+  if (!cache->loaded)
+  {
+    cache->restingLayer = LoadRenderTexture(cache->width, cache->height);
+    cache->frame = LoadRenderTexture(cache->width, cache->height);
+    cache->loaded = true;
+  }
+
+  cache->nbDamaged = 0;
+  UpdateMovingRods(cache, rodGroup, rodHandles, movingRods, nbMovingRods);
+  if (cache->valid && cache->nbDamaged == 0 && SameOverlays(&cache->overlays, &cache->drawnOverlays))
+  {
+    FinishFrameStats(&cache->stats, false);
+    return false;
+  }
+
+  Rectangle screen = {0, 0, cache->width, cache->height};
+  BeginTextureMode(cache->restingLayer);
+  if (!cache->valid)
+  {
+    ClearBackground(RAYWHITE);
+    cache->stats.frameDrawCalls += 1;
+    BeginMode2D(cache->camera);
+    DrawSwatches(cache, DrawRestingRods(cache, rodGroup, grid, GetWorldArea(cache, screen), true));
+    EndMode2D();
+    cache->nbDamaged = 0;
+    AddDamagedArea(cache, screen);
+  }
+  else
+  {
+    MergeDamagedAreas(cache, 0);
+    BeginMode2D(cache->camera);
+    for (int i = 0; i < cache->nbDamaged; i++)
+    {
+      RepaintRestingArea(cache, rodGroup, grid, cache->damaged[i]);
+    }
+    EndMode2D();
+    DamageOverlays(cache, &cache->drawnOverlays);
+    DamageOverlays(cache, &cache->overlays);
+    AddDamagedArea(cache, (Rectangle){0, 0, STATS_WIDTH, STATS_HEIGHT});
+    MergeDamagedAreas(cache, 0);
+  }
+  EndTextureMode();
+
+  BeginTextureMode(cache->frame);
+  for (int i = 0; i < cache->nbDamaged; i++)
+  {
+    Rectangle area = cache->damaged[i];
+    DrawTextureRec(cache->restingLayer.texture, GetTextureArea(cache, area), (Vector2){area.x, area.y}, WHITE);
+    cache->stats.frameDrawCalls += 1;
+  }
+  BeginMode2D(cache->camera);
+  DrawOverlays(cache);
+  EndMode2D();
+  DrawRenderStats(cache);
+  EndTextureMode();
+
+  BeginDrawing();
+  DrawTextureRec(cache->frame.texture, GetTextureArea(cache, screen), (Vector2){0, 0}, WHITE);
+  cache->stats.frameDrawCalls += 1;
+  FinishFrameStats(&cache->stats, true);
+  EndDrawing();
+
+  OverlayList drawn = cache->drawnOverlays;
+  cache->drawnOverlays = cache->overlays;
+  cache->overlays = drawn;
+  cache->valid = true;
+  return true;
+}
+
+void PrintRenderStats(RenderCache *cache)
+{
+  RenderStats stats = cache->stats;
+  long nbFrames = stats.nbFramesDrawn + stats.nbFramesSkipped;
+  printf("RENDER (%s) : %ld frames drawn, %ld skipped, %.1f draw calls per frame drawn, %.3f ms CPU per frame\n",
+         cache->retained ? "retained" : "immediate", stats.nbFramesDrawn, stats.nbFramesSkipped,
+         stats.nbFramesDrawn > 0 ? (double)stats.totalDrawCalls / stats.nbFramesDrawn : 0,
+         nbFrames > 0 ? stats.totalCpuTime * 1000 / nbFrames : 0);
+}
@@ -0,0 +1,110 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "rods.h"
+#include "grid.h"
+#include "handles.h"
+#include <stdbool.h>
+
+// Below this zoom, rods are a few pixels tall: they are drawn without their
+// outline, all in one batch of quads.
+#define BATCH_ZOOM 0.5
+
+// Everything drawn over the resting rods: the dragged rods, the outlines of
+// the rods they touch, the replay cursor.
+typedef enum OverlayKind
+{
+  OVERLAY_ROD,
+  OVERLAY_OUTLINE,
+  OVERLAY_CURSOR,
+} OverlayKind;
+
+typedef struct Overlay
+{
+  OverlayKind kind;
+  Rectangle rect;
+  Color color;
+} Overlay;
+
+typedef struct OverlayList
+{
+  int nbOverlays;
+  int capacity;
+  Overlay *overlays;
+} OverlayList;
+
+// Swatches of the palette, drawn over the resting rods.
+typedef struct Swatch
+{
+  Rectangle rect;
+  Color color;
+} Swatch;
+
+// Draw calls are the calls to raylib's drawing functions, each of which may
+// end up in the same GPU batch.
+typedef struct RenderStats
+{
+  int frameDrawCalls;
+  // Rods drawn, those outside the view being culled.
+  int frameRods;
+  // Thread CPU time when the frame started, update included.
+  double frameStart;
+  // Shown on screen: the figures of the last frame drawn.
+  int lastDrawCalls;
+  int lastRods;
+  double lastCpuTime;
+  long nbFramesDrawn;
+  long nbFramesSkipped;
+  long totalDrawCalls;
+  double totalCpuTime;
+} RenderStats;
+
+// The rods and the overlays are in world coordinates, seen through the
+// camera. In retained mode, the resting rods are cached in a texture and the
+// frame is kept from one frame to the next: only the areas the overlays
+// leave or enter, and those of the rods picked up or dropped, are redrawn. A
+// frame in which nothing changed isn't drawn at all, and moving the camera
+// redraws everything.
+typedef struct RenderCache
+{
+  bool retained;
+  int width;
+  int height;
+  Camera2D camera;
+  bool loaded;
+  // False when the whole cache must be redrawn, e.g. on a new layout.
+  bool valid;
+  RenderTexture2D restingLayer;
+  RenderTexture2D frame;
+  int nbSwatches;
+  Swatch *swatches;
+  // The overlays of the frame being built and those of the last frame drawn.
+  OverlayList overlays;
+  OverlayList drawnOverlays;
+  // Rods drawn as overlays, known by handle since the rods may be reordered
+  // in between.
+  int nbMovingRods;
+  int movingCapacity;
+  RodHandle *movingRods;
+  int *movingMarks;
+  int movingMark;
+  int marksCapacity;
+  int nbDamaged;
+  int damagedCapacity;
+  Rectangle *damaged;
+  RenderStats stats;
+} RenderCache;
+
+RenderCache NewRenderCache(int width, int height, bool retained);
+void FreeRenderCache(RenderCache *cache);
+void InvalidateRenderCache(RenderCache *cache);
+void SetRenderCamera(RenderCache *cache, Camera2D camera);
+void SetRenderSwatches(RenderCache *cache, const Swatch *swatches, int nbSwatches);
+void ClearOverlays(RenderCache *cache);
+void AddOverlay(RenderCache *cache, OverlayKind kind, Rectangle rect, Color color);
+void StartFrameStats(RenderCache *cache);
+bool RenderFrame(RenderCache *cache, RodGroup *rodGroup, RodGrid *grid, RodHandleTable *rodHandles, const int *movingRods,
+                 int nbMovingRods);
+void PrintRenderStats(RenderCache *cache);
+
+#endif
@@ -0,0 +1,157 @@
+#include "replay.h"
+#include "collision.h"
+#include "tap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void AddReplayEvent(Replay *replay, ReplayEvent event)
+{
+  if (replay->nbEvents == replay->capacity)
+  {
+    replay->capacity = replay->capacity == 0 ? 1024 : 2 * replay->capacity;
+    replay->events = realloc(replay->events, replay->capacity * sizeof(ReplayEvent));
+  }
+  replay->events[replay->nbEvents] = event;
+  replay->nbEvents += 1;
+}
+
+// The rods of an 's' record.
+RodGroup *NewRodGroupFromRecord(const TapRecord *record)
+{
+  RodGroup *rodGroup = malloc(sizeof(RodGroup) + record->nbRods * sizeof(Rod));
+  rodGroup->nbRods = record->nbRods;
+  rodGroup->capacity = record->nbRods;
+  for (int i = 0; i < record->nbRods; i++)
+  {
+    TapRod rod = record->rods[i];
+    WarnIfOutOfCatalogue(rod.length);
+    rodGroup->rods[i] = NewRod(rod.length, GetTapValue(rod.x), GetTapValue(rod.y));
+  }
+  return rodGroup;
+}
+
+// Reads the whole tap up front, text or binary, so that replaying it only
+// reads memory.
+Replay *LoadReplay(const char *tapName)
+{
+  TapReader *reader = OpenTapReader(tapName);
+  if (reader == NULL)
+  {
+    return NULL;
+  }
+  Replay *replay = calloc(1, sizeof(Replay));
+  replay->speed = 1;
+  TapRecord record;
+  while (ReadTapRecord(reader, &record))
+  {
+    ReplayEvent event = {.time = GetTapValue(record.time)};
+    switch (record.kind)
+    {
+    case 's':
+      if (replay->rodGroup == NULL)
+      {
+        replay->rodGroup = NewRodGroupFromRecord(&record);
+      }
+      break;
+    case 'm':
+      event.kind = MOVE_EVENT;
+      event.position = (Vector2){GetTapValue(record.x), GetTapValue(record.y)};
+      AddReplayEvent(replay, event);
+      break;
+    case 'r':
+      event.kind = RELEASE_EVENT;
+      AddReplayEvent(replay, event);
+      break;
+    case 'g':
+      event.kind = TRAIN_EVENT;
+      AddReplayEvent(replay, event);
+      break;
+    case 'p':
+      event.kind = SPAWN_EVENT;
+      event.arg = record.length;
+      AddReplayEvent(replay, event);
+      break;
+    case 'f':
+      event.kind = FREE_PLAY_EVENT;
+      AddReplayEvent(replay, event);
+      break;
+    case 'k':
+      // Sessions are replayed with the collision settings they were recorded with.
+      event.kind = RESOLVER_EVENT;
+      event.arg = FindResolver(record.resolverName);
+      event.snapDistance = GetTapValue(record.snapDistance);
+      if (event.arg != -1)
+      {
+        AddReplayEvent(replay, event);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  CloseTapReader(reader);
+  return replay;
+}
+
+void RewindReplay(Replay *replay)
+{
+  replay->nextEvent = 0;
+  replay->started = false;
+}
+
+bool NextReplayEvent(Replay *replay, ReplayEvent *event)
+{
+  if (replay->nextEvent == replay->nbEvents)
+  {
+    return false;
+  }
+  *event = replay->events[replay->nextEvent];
+  replay->nextEvent += 1;
+  return true;
+}
+
+// Seconds since the first event was played, 0 before it.
+double GetReplayWallTime(Replay *replay)
+{
+  if (!replay->started)
+  {
+    return 0;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - replay->wallStart.tv_sec) + (now.tv_nsec - replay->wallStart.tv_nsec) * 1e-9;
+}
+
+// Waits until the event at time is due. The clock starts with the first
+// event, and a replay late on its clock catches up without waiting.
+void WaitReplayEvent(Replay *replay, float time)
+{
+  if (!replay->started)
+  {
+    replay->started = true;
+    replay->startTime = time;
+    clock_gettime(CLOCK_MONOTONIC, &replay->wallStart);
+    return;
+  }
+  if (replay->speed <= 0)
+  {
+    return;
+  }
+  double delay = (time - replay->startTime) / replay->speed - GetReplayWallTime(replay);
+  if (delay > 0)
+  {
+    struct timespec wait = {.tv_sec = (time_t)delay, .tv_nsec = (long)((delay - (time_t)delay) * 1e9)};
+    nanosleep(&wait, NULL);
+  }
+}
+
+void FreeReplay(Replay *replay)
+{
+  if (replay == NULL)
+  {
+    return;
+  }
+  free(replay->rodGroup);
+  free(replay->events);
+  free(replay);
+}
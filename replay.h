@@ -0,0 +1,54 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "raylib.h"
+#include "rods.h"
+#include <stdbool.h>
+#include <time.h>
+
+// The lines of a tap, save for the rods and the dates.
+typedef enum ReplayEventKind
+{
+  MOVE_EVENT,
+  RELEASE_EVENT,
+  TRAIN_EVENT,
+  SPAWN_EVENT,
+  FREE_PLAY_EVENT,
+  RESOLVER_EVENT,
+} ReplayEventKind;
+
+typedef struct ReplayEvent
+{
+  ReplayEventKind kind;
+  float time;
+  Vector2 position;
+  // Length of the spawned rod, or the resolver and its snap distance.
+  int arg;
+  float snapDistance;
+} ReplayEvent;
+
+// A tap read once, whose events are fed to the app one after the other. The
+// moves and releases are paced on a clock running speed times faster than
+// real time, or not at all when speed is 0.
+typedef struct Replay
+{
+  // The rods when the session started, NULL if the tap has none.
+  RodGroup *rodGroup;
+  int nbEvents;
+  int capacity;
+  ReplayEvent *events;
+  int nextEvent;
+  float speed;
+  bool started;
+  float startTime;
+  struct timespec wallStart;
+} Replay;
+
+Replay *LoadReplay(const char *tapName);
+void RewindReplay(Replay *replay);
+bool NextReplayEvent(Replay *replay, ReplayEvent *event);
+void WaitReplayEvent(Replay *replay, float time);
+double GetReplayWallTime(Replay *replay);
+void FreeReplay(Replay *replay);
+
+#endif
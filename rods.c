@@ -1,14 +1,24 @@
 #include "rods.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 const int UNIT_ROD_LENGTH = 30;
 const int ROD_HEIGHT = 30;
 
+const int TABLET_LENGTH = 1000;
+const int TABLED_HEIGHT = 600;
+
 
 const Color COLORS[] = {LIGHTGRAY, RED, GREEN, PURPLE, YELLOW,
                         DARKGREEN, BLACK, BROWN, BLUE, ORANGE};
 
+// The length catalogue: lengths 1 to nbRodLengths, the classic rods until
+// InitRodLengths is called.
+int nbRodLengths = NB_RODS_MENU;
+static const Color *lengthColors = COLORS;
+
 
 
 
@@ -83,38 +93,94 @@ void SetTopLeft(Rod *rod, Vector2 newPos)
   rod->rect.y = newPos.y;
 }
 
+// Puts the rod on whole pixels. Lengths are already whole, so every bound of
+// a rounded rod is an integer and is exact in float.
+void RoundRod(Rod *rod)
+{
+  rod->rect.x = roundf(rod->rect.x);
+  rod->rect.y = roundf(rod->rect.y);
+}
+
+// The classic rods keep their colours, the longer ones get hues a golden
+// angle apart so that neighbouring lengths stay far apart on the wheel.
+void InitRodLengths(int nbLengths)
+{
+  Color *colors = malloc(nbLengths * sizeof(Color));
+  for (int i = 0; i < nbLengths; i++)
+  {
+    colors[i] = i < NB_RODS_MENU ? COLORS[i]
+                                 : ColorFromHSV(fmodf(i * 137.508, 360), 0.45 + 0.1 * (i % 5), 0.9 - 0.1 * (i % 3));
+  }
+  if (lengthColors != COLORS)
+  {
+    free((Color *)lengthColors);
+  }
+  lengthColors = colors;
+  nbRodLengths = nbLengths;
+}
+
+// Index of the length in the per-length tables. A length outside the
+// catalogue is looked up as the nearest one in it.
+int GetLengthIndex(int numericLength)
+{
+  if (numericLength < 1)
+  {
+    return 0;
+  }
+  return numericLength > nbRodLengths ? nbRodLengths - 1 : numericLength - 1;
+}
+
+Color GetLengthColor(int numericLength)
+{
+  return lengthColors[GetLengthIndex(numericLength)];
+}
+
 Color GetRodColor(Rod rod)
 {
-  return COLORS[rod.numericLength - 1];
+  return GetLengthColor(rod.numericLength);
 }
 
-RodGroup *NewRodGroup(const char *spec_name)
+void WarnIfOutOfCatalogue(int numericLength)
 {
-  int i;
-  int nbRods;
-  FILE *f;
-  f = fopen(spec_name, "r");
-  if (f == NULL)
+  if (numericLength < 1 || numericLength > nbRodLengths)
   {
-    perror("Couldn't open the spec.\n");
-    abort();
+    fprintf(stderr, "Rod of length %d outside of the %d lengths of the catalogue (see nb_lengths).\n", numericLength,
+            nbRodLengths);
   }
-  fscanf(f, "%d ", &nbRods);
-  RodGroup *rod_group = malloc(sizeof(RodGroup) + nbRods * sizeof(Rod));
-  rod_group->nbRods = nbRods;
-  for (i = 0; i < nbRods; i++)
+}
+
+// In free play, rods are spawned from a palette: one swatch per length of the
+// catalogue, in columns from the right edge of the tablet.
+Rectangle GetSwatchRect(int numericLength)
+{
+  int swatchesPerColumn = TABLED_HEIGHT / ROD_HEIGHT;
+  int column = (numericLength - 1) / swatchesPerColumn;
+  int row = (numericLength - 1) % swatchesPerColumn;
+  return (Rectangle){TABLET_LENGTH - (column + 1) * UNIT_ROD_LENGTH, row * ROD_HEIGHT, UNIT_ROD_LENGTH, ROD_HEIGHT};
+}
+
+// Length of the swatch under the point, 0 when there is none.
+int GetSwatchUnder(Vector2 point)
+{
+  if (point.x >= TABLET_LENGTH || point.y < 0 || point.y >= TABLED_HEIGHT)
   {
-    int l;
-    float x;
-    float y;
-    fscanf(f, "%d %f %f ", &l, &x, &y);
-    rod_group->rods[i] = NewRod(l, x, y);
+    return 0;
   }
-  fclose(f);
-  return rod_group;
+  int column = (TABLET_LENGTH - point.x) / UNIT_ROD_LENGTH;
+  int row = point.y / ROD_HEIGHT;
+  int l = column * (TABLED_HEIGHT / ROD_HEIGHT) + row + 1;
+  return l > nbRodLengths ? 0 : l;
 }
 
-RodGroup *NewRodGroupFromTap(const char *spec_name)
+// Where a swatch spawns its rod: flush with the right edge of the tablet, on
+// the row of the swatch.
+Rod NewSpawnedRod(int numericLength)
+{
+  Rectangle swatch = GetSwatchRect(numericLength);
+  return NewRod(numericLength, swatch.x + swatch.width - numericLength * UNIT_ROD_LENGTH, swatch.y);
+}
+
+RodGroup *NewRodGroup(const char *spec_name)
 {
   int i;
   int nbRods;
@@ -125,21 +191,33 @@ RodGroup *NewRodGroupFromTap(const char *spec_name)
     perror("Couldn't open the spec.\n");
     abort();
   }
-  fscanf(f, "s %d ", &nbRods);
+  fscanf(f, "%d ", &nbRods);
   RodGroup *rod_group = malloc(sizeof(RodGroup) + nbRods * sizeof(Rod));
   rod_group->nbRods = nbRods;
+  rod_group->capacity = nbRods;
   for (i = 0; i < nbRods; i++)
   {
     int l;
     float x;
     float y;
     fscanf(f, "%d %f %f ", &l, &x, &y);
+    WarnIfOutOfCatalogue(l);
     rod_group->rods[i] = NewRod(l, x, y);
   }
   fclose(f);
   return rod_group;
 }
 
+// Doubles the room of the group, which may move: every pointer to it or to
+// its rods must be updated.
+RodGroup *GrowRodGroup(RodGroup *rodGroup)
+{
+  int capacity = rodGroup->capacity < 8 ? 16 : 2 * rodGroup->capacity;
+  rodGroup = realloc(rodGroup, sizeof(RodGroup) + capacity * sizeof(Rod));
+  rodGroup->capacity = capacity;
+  return rodGroup;
+}
+
 void SaveRodGroup(RodGroup *rodGroup, FILE *file)
 {
   fprintf(file, "%d ", rodGroup->nbRods);
@@ -257,3 +335,80 @@ StrictCollisionType CheckStrictCollision(Rod rod_before, Rod rod_after, Rod othe
     return NO_STRICT_COLLISION;
   }
 }
+
+// Spreads the 16 low bits of v over the even bits.
+uint32_t SpreadBits(uint32_t v)
+{
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// Position of the rod centre along a Z-order curve over cells of a rod
+// height, so that rods close on the tablet get close codes. The curve is
+// centred on the origin and covers far more than the margin rods may be
+// dragged to.
+uint32_t GetMortonCode(Rod rod)
+{
+  float column = floorf((rod.rect.x + rod.rect.width / 2) / ROD_HEIGHT) + 0x8000;
+  float row = floorf((rod.rect.y + rod.rect.height / 2) / ROD_HEIGHT) + 0x8000;
+  column = fminf(fmaxf(column, 0), 0xFFFF);
+  row = fminf(fmaxf(row, 0), 0xFFFF);
+  return SpreadBits(column) | (SpreadBits(row) << 1);
+}
+
+// Whether the rod still sits between its neighbours in storage, which is all
+// a single moved rod can break.
+bool IsInMortonOrder(RodGroup *rodGroup, int rodIndex)
+{
+  uint32_t code = GetMortonCode(rodGroup->rods[rodIndex]);
+  return (rodIndex == 0 || GetMortonCode(rodGroup->rods[rodIndex - 1]) <= code) &&
+         (rodIndex == rodGroup->nbRods - 1 || code <= GetMortonCode(rodGroup->rods[rodIndex + 1]));
+}
+
+typedef struct MortonKey
+{
+  uint32_t code;
+  int rodIndex;
+} MortonKey;
+
+int CompareMortonKeys(const void *a, const void *b)
+{
+  const MortonKey *key_a = a;
+  const MortonKey *key_b = b;
+  if (key_a->code != key_b->code)
+  {
+    return key_a->code < key_b->code ? -1 : 1;
+  }
+  // Stable, so that sorting a sorted group changes nothing.
+  return key_a->rodIndex - key_b->rodIndex;
+}
+
+// Stores the rods in Z-order, so that the rods of a neighbourhood lie close
+// in memory. order[i] receives the former index of the rod now at i.
+void SortRodGroupByMorton(RodGroup *rodGroup, int *order)
+{
+  int nbRods = rodGroup->nbRods;
+  if (nbRods == 0)
+  {
+    return;
+  }
+  MortonKey *keys = malloc(nbRods * sizeof(MortonKey));
+  for (int i = 0; i < nbRods; i++)
+  {
+    keys[i] = (MortonKey){GetMortonCode(rodGroup->rods[i]), i};
+  }
+  qsort(keys, nbRods, sizeof(MortonKey), CompareMortonKeys);
+  Rod *rods = malloc(nbRods * sizeof(Rod));
+  for (int i = 0; i < nbRods; i++)
+  {
+    order[i] = keys[i].rodIndex;
+    rods[i] = rodGroup->rods[keys[i].rodIndex];
+  }
+  memcpy(rodGroup->rods, rods, nbRods * sizeof(Rod));
+  free(rods);
+  free(keys);
+}
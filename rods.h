@@ -1,12 +1,17 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <raylib.h>
 
 #define NB_RODS_MENU 10
 extern const int UNIT_ROD_LENGTH;
 extern const int ROD_HEIGHT;
 
+extern const int TABLET_LENGTH;
+extern const int TABLED_HEIGHT;
+
 
 extern const Color COLORS[NB_RODS_MENU];
+extern int nbRodLengths;
 
 #ifndef RODSS
 #define RODSS
@@ -20,7 +25,6 @@ typedef enum StrictCollisionType
   FROM_BELOW,
 } StrictCollisionType;
 
-#endif
 typedef struct Rod
 {
   Rectangle rect;
@@ -28,9 +32,12 @@ typedef struct Rod
 } Rod;
 
 
+// Rods are stored contiguously; capacity is the number of rods the
+// allocation has room for.
 typedef struct RodGroup
 {
   int nbRods;
+  int capacity;
   Rod rods[];
 } RodGroup;
 
@@ -55,12 +62,26 @@ float GetRight(Rod rod);
 void SetRight(Rod *rod, float right);
 
 void SetTopLeft(Rod *rod, Vector2 newPos);
+void RoundRod(Rod *rod);
+void InitRodLengths(int nbLengths);
+int GetLengthIndex(int numericLength);
+Color GetLengthColor(int numericLength);
 Color GetRodColor(Rod rod);
+void WarnIfOutOfCatalogue(int numericLength);
+Rectangle GetSwatchRect(int numericLength);
+int GetSwatchUnder(Vector2 point);
+Rod NewSpawnedRod(int numericLength);
 RodGroup *NewRodGroup(const char *spec_name);
-RodGroup *NewRodGroupFromTap(const char *spec_name);
+RodGroup *GrowRodGroup(RodGroup *rodGroup);
 
 
 void SaveRodGroup(RodGroup *rodGroup, FILE *file);
+uint32_t GetMortonCode(Rod rod);
+bool IsInMortonOrder(RodGroup *rodGroup, int rodIndex);
+void SortRodGroupByMorton(RodGroup *rodGroup, int *order);
 
 bool StrictlyCollide(Rod rod1, Rod rod2);
-enum StrictCollisionType CheckStrictCollision(Rod rod_before, Rod rod_after, Rod other_rod);
\ No newline at end of file
+bool SoftlyCollide(Rod rod1, Rod rod2);
+enum StrictCollisionType CheckStrictCollision(Rod rod_before, Rod rod_after, Rod other_rod);
+
+#endif
@@ -0,0 +1,180 @@
+#include "soa.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+RodSoA NewRodSoA(void)
+{
+  return (RodSoA){.nbRods = 0, .capacity = 0, .x = NULL, .y = NULL, .w = NULL, .h = NULL, .indices = NULL, .mask = NULL};
+}
+
+void FreeRodSoA(RodSoA *soa)
+{
+  free(soa->x);
+  free(soa->y);
+  free(soa->w);
+  free(soa->h);
+  free(soa->indices);
+  free(soa->mask);
+  *soa = NewRodSoA();
+}
+
+float *AllocLanes(int capacity)
+{
+  void *lanes = NULL;
+  if (posix_memalign(&lanes, SOA_LANES * sizeof(float), capacity * sizeof(float)) != 0)
+  {
+    perror("Couldn't allocate the rod arrays");
+    abort();
+  }
+  return lanes;
+}
+
+void ReserveRodSoA(RodSoA *soa, int nbRods)
+{
+  int capacity = (nbRods + SOA_LANES - 1) / SOA_LANES * SOA_LANES;
+  if (capacity <= soa->capacity)
+  {
+    return;
+  }
+  FreeRodSoA(soa);
+  soa->capacity = capacity;
+  soa->x = AllocLanes(capacity);
+  soa->y = AllocLanes(capacity);
+  soa->w = AllocLanes(capacity);
+  soa->h = AllocLanes(capacity);
+  soa->indices = malloc(capacity * sizeof(int));
+  soa->mask = malloc((capacity + 31) / 32 * sizeof(uint32_t));
+}
+
+// Copies the listed rods of the group, or all of them when indices is NULL,
+// leaving out excludedRod (typically the selected one).
+void FillRodSoA(RodSoA *soa, RodGroup *rodGroup, const int *indices, int nbIndices, int excludedRod)
+{
+  ReserveRodSoA(soa, nbIndices);
+  int n = 0;
+  for (int k = 0; k < nbIndices; k++)
+  {
+    int i = indices == NULL ? k : indices[k];
+    if (i == excludedRod)
+    {
+      continue;
+    }
+    Rectangle rect = rodGroup->rods[i].rect;
+    soa->x[n] = rect.x;
+    soa->y[n] = rect.y;
+    soa->w[n] = rect.width;
+    soa->h[n] = rect.height;
+    soa->indices[n] = i;
+    n += 1;
+  }
+  soa->nbRods = n;
+  for (; n % SOA_LANES != 0; n++)
+  {
+    soa->x[n] = INFINITY;
+    soa->y[n] = INFINITY;
+    soa->w[n] = 0;
+    soa->h[n] = 0;
+  }
+}
+
+// Strict collision is StrictlyCollide without the branches: both intervals
+// overlap on more than a boundary. Right and bottom are computed with the same
+// float additions as GetRight and GetBottom, so the results are identical.
+// Returns a bitmask of the colliding entries among lanes [first, first + SOA_LANES).
+uint32_t CollideLanes(RodSoA *soa, int first, Rectangle rect)
+{
+  const float right = rect.x + rect.width;
+  const float bottom = rect.y + rect.height;
+#if defined(__AVX__)
+  __m256 x = _mm256_load_ps(soa->x + first);
+  __m256 y = _mm256_load_ps(soa->y + first);
+  __m256 otherRight = _mm256_add_ps(x, _mm256_load_ps(soa->w + first));
+  __m256 otherBottom = _mm256_add_ps(y, _mm256_load_ps(soa->h + first));
+  __m256 hit = _mm256_and_ps(
+      _mm256_and_ps(_mm256_cmp_ps(_mm256_set1_ps(right), x, _CMP_GT_OQ),
+                    _mm256_cmp_ps(_mm256_set1_ps(rect.x), otherRight, _CMP_LT_OQ)),
+      _mm256_and_ps(_mm256_cmp_ps(_mm256_set1_ps(bottom), y, _CMP_GT_OQ),
+                    _mm256_cmp_ps(_mm256_set1_ps(rect.y), otherBottom, _CMP_LT_OQ)));
+  return _mm256_movemask_ps(hit);
+#elif defined(__SSE2__)
+  uint32_t bits = 0;
+  for (int half = 0; half < SOA_LANES; half += 4)
+  {
+    __m128 x = _mm_load_ps(soa->x + first + half);
+    __m128 y = _mm_load_ps(soa->y + first + half);
+    __m128 otherRight = _mm_add_ps(x, _mm_load_ps(soa->w + first + half));
+    __m128 otherBottom = _mm_add_ps(y, _mm_load_ps(soa->h + first + half));
+    __m128 hit = _mm_and_ps(
+        _mm_and_ps(_mm_cmpgt_ps(_mm_set1_ps(right), x), _mm_cmplt_ps(_mm_set1_ps(rect.x), otherRight)),
+        _mm_and_ps(_mm_cmpgt_ps(_mm_set1_ps(bottom), y), _mm_cmplt_ps(_mm_set1_ps(rect.y), otherBottom)));
+    bits |= _mm_movemask_ps(hit) << half;
+  }
+  return bits;
+#elif defined(__ARM_NEON)
+  const uint32x4_t laneBits = {1, 2, 4, 8};
+  uint32_t bits = 0;
+  for (int half = 0; half < SOA_LANES; half += 4)
+  {
+    float32x4_t x = vld1q_f32(soa->x + first + half);
+    float32x4_t y = vld1q_f32(soa->y + first + half);
+    float32x4_t otherRight = vaddq_f32(x, vld1q_f32(soa->w + first + half));
+    float32x4_t otherBottom = vaddq_f32(y, vld1q_f32(soa->h + first + half));
+    uint32x4_t hit = vandq_u32(
+        vandq_u32(vcgtq_f32(vdupq_n_f32(right), x), vcltq_f32(vdupq_n_f32(rect.x), otherRight)),
+        vandq_u32(vcgtq_f32(vdupq_n_f32(bottom), y), vcltq_f32(vdupq_n_f32(rect.y), otherBottom)));
+    // No horizontal add on 32-bit ARM, so the lane bits are summed pairwise.
+    uint32x4_t masked = vandq_u32(hit, laneBits);
+    uint32x2_t sum = vpadd_u32(vget_low_u32(masked), vget_high_u32(masked));
+    sum = vpadd_u32(sum, sum);
+    bits |= vget_lane_u32(sum, 0) << half;
+  }
+  return bits;
+#else
+  uint32_t bits = 0;
+  for (int lane = 0; lane < SOA_LANES; lane++)
+  {
+    int i = first + lane;
+    if (right > soa->x[i] && rect.x < soa->x[i] + soa->w[i] &&
+        bottom > soa->y[i] && rect.y < soa->y[i] + soa->h[i])
+    {
+      bits |= 1u << lane;
+    }
+  }
+  return bits;
+#endif
+}
+
+// Tests the rectangle against every entry at once. Bit i of soa->mask tells
+// whether entry i strictly collides with it. Returns the number of collisions.
+int StrictCollisionMask(RodSoA *soa, Rectangle rect)
+{
+  int nbCollisions = 0;
+  memset(soa->mask, 0, (soa->capacity + 31) / 32 * sizeof(uint32_t));
+  for (int first = 0; first < soa->nbRods; first += SOA_LANES)
+  {
+    uint32_t bits = CollideLanes(soa, first, rect);
+    soa->mask[first / 32] |= bits << (first % 32);
+    nbCollisions += __builtin_popcount(bits);
+  }
+  return nbCollisions;
+}
+
+bool AnyStrictCollision(RodSoA *soa, Rectangle rect)
+{
+  for (int first = 0; first < soa->nbRods; first += SOA_LANES)
+  {
+    if (CollideLanes(soa, first, rect) != 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
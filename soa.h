@@ -0,0 +1,32 @@
+#ifndef SOA_H
+#define SOA_H
+
+#include "rods.h"
+#include <stdint.h>
+
+// Vector width the arrays are padded to, the widest of the kernels (AVX).
+#define SOA_LANES 8
+
+// Structure-of-arrays copy of some rods of a group, laid out for the
+// vectorized collision kernels. Padding entries never collide.
+typedef struct RodSoA
+{
+  int nbRods;
+  int capacity;
+  float *x;
+  float *y;
+  float *w;
+  float *h;
+  // Index in the group of each entry.
+  int *indices;
+  // One bit per entry, filled by StrictCollisionMask.
+  uint32_t *mask;
+} RodSoA;
+
+RodSoA NewRodSoA(void);
+void FreeRodSoA(RodSoA *soa);
+void FillRodSoA(RodSoA *soa, RodGroup *rodGroup, const int *indices, int nbIndices, int excludedRod);
+int StrictCollisionMask(RodSoA *soa, Rectangle rect);
+bool AnyStrictCollision(RodSoA *soa, Rectangle rect);
+
+#endif
@@ -0,0 +1,664 @@
+#include "tap.h"
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TRAILING_ZEROS 6
+// The zero count of a negative zero, which no other number has.
+#define NEGATIVE_ZERO_ZEROS 7
+// The fewest bytes a rod of an 's' record takes: " 1 0 0" in a text tap, a
+// byte per number in a binary one. Counts beyond what the rest of the record
+// could hold are corrupt.
+#define MIN_TEXT_ROD_CHARS 6
+#define MIN_BINARY_ROD_BYTES 3
+
+// As printf's %f rounds it, the float being exact in a double once scaled,
+// down to the sign of a value rounding to 0.
+int64_t GetMillionths(float value)
+{
+  int64_t millionths = llrint((double)value * 1e6);
+  return millionths == 0 && signbit(value) ? TAP_NEGATIVE_ZERO : millionths;
+}
+
+float GetTapValue(int64_t millionths)
+{
+  return millionths == TAP_NEGATIVE_ZERO ? -0.0f : millionths / 1e6;
+}
+
+// The value to do sums with.
+int64_t StripNegativeZero(int64_t millionths)
+{
+  return millionths == TAP_NEGATIVE_ZERO ? 0 : millionths;
+}
+
+bool HasBinaryTapName(const char *tapName)
+{
+  size_t len = strlen(tapName);
+  size_t extensionLen = strlen(TAP_BINARY_EXTENSION);
+  return len >= extensionLen && strcmp(tapName + len - extensionLen, TAP_BINARY_EXTENSION) == 0;
+}
+
+// Text
+
+// A number as %f writes it, in millionths. The digits past the sixth
+// decimal are dropped, and end is left on text when there is no number.
+int64_t ParseMillionths(const char *text, const char **end)
+{
+  const char *p = text;
+  while (*p == ' ' || *p == '\t')
+  {
+    p++;
+  }
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+')
+  {
+    p++;
+  }
+  bool hasDigits = false;
+  int64_t whole = 0;
+  while (isdigit((unsigned char)*p))
+  {
+    whole = whole * 10 + (*p - '0');
+    hasDigits = true;
+    p++;
+  }
+  int64_t fraction = 0;
+  int nbDecimals = 0;
+  if (*p == '.')
+  {
+    p++;
+    while (isdigit((unsigned char)*p))
+    {
+      if (nbDecimals < 6)
+      {
+        fraction = fraction * 10 + (*p - '0');
+        nbDecimals += 1;
+      }
+      hasDigits = true;
+      p++;
+    }
+  }
+  for (; nbDecimals < 6; nbDecimals++)
+  {
+    fraction *= 10;
+  }
+  *end = hasDigits ? p : text;
+  int64_t value = whole * 1000000 + fraction;
+  if (negative && value == 0)
+  {
+    return TAP_NEGATIVE_ZERO;
+  }
+  return negative ? -value : value;
+}
+
+// The reverse, as %f would have written it.
+void PrintMillionths(FILE *file, int64_t value)
+{
+  if (value == TAP_NEGATIVE_ZERO)
+  {
+    fputs("-0.000000", file);
+    return;
+  }
+  long long magnitude = llabs(value);
+  fprintf(file, "%s%lld.%06lld", value < 0 ? "-" : "", magnitude / 1000000, magnitude % 1000000);
+}
+
+void ReserveTapRods(TapReader *reader, int nbRods)
+{
+  if (reader->rodsCapacity < nbRods)
+  {
+    reader->rodsCapacity = nbRods;
+    reader->rods = realloc(reader->rods, nbRods * sizeof(TapRod));
+  }
+}
+
+bool ParseTextRods(TapReader *reader, const char *text, TapRecord *record)
+{
+  char *end;
+  long nbRods = strtol(text, &end, 10);
+  if (end == text || nbRods < 0 || nbRods > INT_MAX || (size_t)nbRods > strlen(end) / MIN_TEXT_ROD_CHARS)
+  {
+    return false;
+  }
+  ReserveTapRods(reader, nbRods);
+  record->nbRods = 0;
+  record->rods = reader->rods;
+  const char *p = end;
+  for (int i = 0; i < nbRods; i++)
+  {
+    long length = strtol(p, &end, 10);
+    if (end == p)
+    {
+      break;
+    }
+    TapRod rod = {.length = length};
+    rod.x = ParseMillionths(end, &p);
+    rod.y = ParseMillionths(p, &p);
+    reader->rods[i] = rod;
+    record->nbRods += 1;
+  }
+  return true;
+}
+
+// Skips the lines that aren't records, such as the blank ones.
+bool ReadTextRecord(TapReader *reader, TapRecord *record)
+{
+  while (getline(&reader->line, &reader->lineCapacity, reader->file) != -1)
+  {
+    const char *line = reader->line;
+    const char *end;
+    int n = 0;
+    *record = (TapRecord){.kind = line[0]};
+    switch (line[0])
+    {
+    case 's':
+      if (ParseTextRods(reader, line + 1, record))
+      {
+        return true;
+      }
+      break;
+    case 't':
+      if (sscanf(line, "t %ld", &record->date) == 1)
+      {
+        return true;
+      }
+      break;
+    case 'k':
+      if (sscanf(line, "k %15s %n", record->resolverName, &n) == 1)
+      {
+        record->snapDistance = n > 0 ? ParseMillionths(line + n, &end) : 0;
+        return true;
+      }
+      break;
+    case 'f':
+    case 'g':
+      return true;
+    case 'p':
+      if (sscanf(line, "p %d", &record->length) == 1)
+      {
+        return true;
+      }
+      break;
+    case 'm':
+      record->time = ParseMillionths(line + 1, &end);
+      if (end == line + 1)
+      {
+        break;
+      }
+      record->x = ParseMillionths(end, &end);
+      record->y = ParseMillionths(end, &end);
+      record->press = reader->released;
+      reader->released = false;
+      return true;
+    case 'r':
+      record->time = ParseMillionths(line + 1, &end);
+      if (end == line + 1)
+      {
+        break;
+      }
+      reader->released = true;
+      return true;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+void WriteTextRecord(TapWriter *writer, const TapRecord *record)
+{
+  FILE *file = writer->file;
+  switch (record->kind)
+  {
+  case 's':
+    fprintf(file, "s %d ", record->nbRods);
+    for (int i = 0; i < record->nbRods; i++)
+    {
+      fprintf(file, "%d ", record->rods[i].length);
+      PrintMillionths(file, record->rods[i].x);
+      fputc(' ', file);
+      PrintMillionths(file, record->rods[i].y);
+      fputc(' ', file);
+    }
+    fputc('\n', file);
+    break;
+  case 't':
+    fprintf(file, "t %ld \n", record->date);
+    break;
+  case 'k':
+    fprintf(file, "k %s ", record->resolverName);
+    PrintMillionths(file, record->snapDistance);
+    fputs(" \n", file);
+    break;
+  case 'f':
+  case 'g':
+    fprintf(file, "%c \n", record->kind);
+    break;
+  case 'p':
+    fprintf(file, "p %d \n", record->length);
+    break;
+  case 'm':
+    fputs("m ", file);
+    PrintMillionths(file, record->time);
+    fputc(' ', file);
+    PrintMillionths(file, record->x);
+    fputc(' ', file);
+    PrintMillionths(file, record->y);
+    fputs(" \n", file);
+    break;
+  case 'r':
+    // The release that starts the session isn't followed by a blank line.
+    fputs("r ", file);
+    PrintMillionths(file, record->time);
+    fputs(writer->nbReleases == 0 ? " \n" : " \n\n", file);
+    break;
+  }
+}
+
+// Binary
+
+bool GetVarint(TapReader *reader, uint64_t *value)
+{
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    if (reader->position == reader->size)
+    {
+      return false;
+    }
+    unsigned char byte = reader->data[reader->position];
+    reader->position += 1;
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool GetSigned(TapReader *reader, int64_t *value)
+{
+  uint64_t zigzag;
+  if (!GetVarint(reader, &zigzag))
+  {
+    return false;
+  }
+  *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  return true;
+}
+
+bool GetDecimal(TapReader *reader, int64_t *value)
+{
+  uint64_t packed;
+  if (!GetVarint(reader, &packed))
+  {
+    return false;
+  }
+  if ((packed & 7) == NEGATIVE_ZERO_ZEROS)
+  {
+    *value = TAP_NEGATIVE_ZERO;
+    return true;
+  }
+  uint64_t zigzag = packed >> 3;
+  int64_t significand = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  for (int k = packed & 7; k > 0; k--)
+  {
+    significand *= 10;
+  }
+  *value = significand;
+  return true;
+}
+
+// The next value from the previous one. A negative zero is stored as is.
+bool GetDelta(TapReader *reader, int64_t *value)
+{
+  int64_t delta;
+  if (!GetDecimal(reader, &delta))
+  {
+    return false;
+  }
+  *value = delta == TAP_NEGATIVE_ZERO ? delta : StripNegativeZero(*value) + delta;
+  return true;
+}
+
+void PutVarint(FILE *file, uint64_t value)
+{
+  unsigned char bytes[10];
+  int nbBytes = 0;
+  do
+  {
+    bytes[nbBytes] = (value & 0x7f) | (value > 0x7f ? 0x80 : 0);
+    value >>= 7;
+    nbBytes += 1;
+  } while (value != 0);
+  fwrite(bytes, 1, nbBytes, file);
+}
+
+void PutSigned(FILE *file, int64_t value)
+{
+  PutVarint(file, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+void PutDecimal(FILE *file, int64_t value)
+{
+  if (value == TAP_NEGATIVE_ZERO)
+  {
+    PutVarint(file, NEGATIVE_ZERO_ZEROS);
+    return;
+  }
+  int nbZeros = 0;
+  while (nbZeros < MAX_TRAILING_ZEROS && value != 0 && value % 10 == 0)
+  {
+    value /= 10;
+    nbZeros += 1;
+  }
+  uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+  PutVarint(file, zigzag << 3 | nbZeros);
+}
+
+void PutDelta(FILE *file, int64_t value, int64_t previous)
+{
+  PutDecimal(file, value == TAP_NEGATIVE_ZERO ? value : value - StripNegativeZero(previous));
+}
+
+bool ReadBinaryRecord(TapReader *reader, TapRecord *record)
+{
+  if (reader->position == reader->size)
+  {
+    return false;
+  }
+  char tag = reader->data[reader->position];
+  reader->position += 1;
+  *record = (TapRecord){.kind = tag};
+  uint64_t value;
+  switch (tag)
+  {
+  case 's':
+    if (!GetVarint(reader, &value) || value > INT_MAX ||
+        value > (reader->size - reader->position) / MIN_BINARY_ROD_BYTES)
+    {
+      break;
+    }
+    ReserveTapRods(reader, value);
+    record->rods = reader->rods;
+    for (; record->nbRods < (int)value; record->nbRods++)
+    {
+      uint64_t length;
+      TapRod *rod = &reader->rods[record->nbRods];
+      if (!GetVarint(reader, &length) || !GetDecimal(reader, &rod->x) || !GetDecimal(reader, &rod->y))
+      {
+        break;
+      }
+      rod->length = length;
+    }
+    if (record->nbRods == (int)value)
+    {
+      return true;
+    }
+    break;
+  case 't':
+  {
+    int64_t date;
+    if (!GetSigned(reader, &date))
+    {
+      break;
+    }
+    record->date = date;
+    return true;
+  }
+  case 'k':
+    if (reader->position == reader->size || reader->data[reader->position] > MAX_RESOLVER_NAME ||
+        reader->position + 1 + reader->data[reader->position] > reader->size)
+    {
+      break;
+    }
+    value = reader->data[reader->position];
+    memcpy(record->resolverName, reader->data + reader->position + 1, value);
+    record->resolverName[value] = '\0';
+    reader->position += 1 + value;
+    return GetDecimal(reader, &record->snapDistance);
+  case 'f':
+  case 'g':
+    return true;
+  case 'p':
+    if (!GetVarint(reader, &value))
+    {
+      break;
+    }
+    record->length = value;
+    return true;
+  case 'd':
+  case 'm':
+    if (!GetDelta(reader, &reader->time) || !GetDelta(reader, &reader->x) || !GetDelta(reader, &reader->y))
+    {
+      break;
+    }
+    *record = (TapRecord){.kind = 'm', .press = tag == 'd', .time = reader->time, .x = reader->x, .y = reader->y};
+    return true;
+  case 'r':
+    if (!GetDelta(reader, &reader->time))
+    {
+      break;
+    }
+    record->time = reader->time;
+    return true;
+  default:
+    fprintf(stderr, "Unknown record '%c' in a binary tap, at byte %zu.\n", tag, reader->position - 1);
+    reader->position = reader->size;
+    return false;
+  }
+  // A tap cut short, e.g. when the app was killed.
+  reader->position = reader->size;
+  return false;
+}
+
+void WriteBinaryRecord(TapWriter *writer, const TapRecord *record)
+{
+  FILE *file = writer->file;
+  switch (record->kind)
+  {
+  case 's':
+    fputc('s', file);
+    PutVarint(file, record->nbRods);
+    for (int i = 0; i < record->nbRods; i++)
+    {
+      PutVarint(file, record->rods[i].length);
+      PutDecimal(file, record->rods[i].x);
+      PutDecimal(file, record->rods[i].y);
+    }
+    break;
+  case 't':
+    fputc('t', file);
+    PutSigned(file, record->date);
+    break;
+  case 'k':
+  {
+    size_t len = strnlen(record->resolverName, MAX_RESOLVER_NAME);
+    fputc('k', file);
+    fputc(len, file);
+    fwrite(record->resolverName, 1, len, file);
+    PutDecimal(file, record->snapDistance);
+    break;
+  }
+  case 'f':
+  case 'g':
+    fputc(record->kind, file);
+    break;
+  case 'p':
+    fputc('p', file);
+    PutVarint(file, record->length);
+    break;
+  case 'm':
+    fputc(writer->released ? 'd' : 'm', file);
+    PutDelta(file, record->time, writer->time);
+    PutDelta(file, record->x, writer->x);
+    PutDelta(file, record->y, writer->y);
+    break;
+  case 'r':
+    fputc('r', file);
+    PutDelta(file, record->time, writer->time);
+    break;
+  }
+}
+
+// Reader
+
+TapReader *OpenTapReader(const char *tapName)
+{
+  FILE *file = fopen(tapName, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Couldn't open the tap %s.\n", tapName);
+    return NULL;
+  }
+  TapReader *reader = calloc(1, sizeof(TapReader));
+  reader->file = file;
+  reader->released = true;
+  char magic[TAP_MAGIC_LEN];
+  if (fread(magic, 1, TAP_MAGIC_LEN, file) == TAP_MAGIC_LEN && memcmp(magic, TAP_MAGIC, TAP_MAGIC_LEN) == 0)
+  {
+    reader->binary = true;
+    size_t capacity = 1 << 16;
+    reader->data = malloc(capacity);
+    size_t nbRead;
+    while ((nbRead = fread(reader->data + reader->size, 1, capacity - reader->size, file)) > 0)
+    {
+      reader->size += nbRead;
+      if (reader->size == capacity)
+      {
+        capacity *= 2;
+        reader->data = realloc(reader->data, capacity);
+      }
+    }
+  }
+  else
+  {
+    rewind(file);
+  }
+  return reader;
+}
+
+bool ReadTapRecord(TapReader *reader, TapRecord *record)
+{
+  return reader->binary ? ReadBinaryRecord(reader, record) : ReadTextRecord(reader, record);
+}
+
+void CloseTapReader(TapReader *reader)
+{
+  if (reader == NULL)
+  {
+    return;
+  }
+  fclose(reader->file);
+  free(reader->line);
+  free(reader->data);
+  free(reader->rods);
+  free(reader);
+}
+
+// Writer
+
+TapWriter *OpenTapWriter(const char *tapName, bool binary)
+{
+  FILE *file = fopen(tapName, binary ? "wb" : "w");
+  if (file == NULL)
+  {
+    fprintf(stderr, "Couldn't write the tap %s.\n", tapName);
+    return NULL;
+  }
+  TapWriter *writer = calloc(1, sizeof(TapWriter));
+  writer->binary = binary;
+  writer->file = file;
+  writer->released = true;
+  if (binary)
+  {
+    fwrite(TAP_MAGIC, 1, TAP_MAGIC_LEN, file);
+  }
+  return writer;
+}
+
+// The record is written as is, its press flag aside: a move is a press when
+// it follows a release.
+void WriteTapRecord(TapWriter *writer, const TapRecord *record)
+{
+  if (writer->binary)
+  {
+    WriteBinaryRecord(writer, record);
+  }
+  else
+  {
+    WriteTextRecord(writer, record);
+  }
+  if (record->kind == 'm')
+  {
+    writer->time = record->time;
+    writer->x = record->x;
+    writer->y = record->y;
+    writer->released = false;
+  }
+  else if (record->kind == 'r')
+  {
+    writer->time = record->time;
+    writer->released = true;
+    writer->nbReleases += 1;
+  }
+}
+
+void WriteTapRods(TapWriter *writer, const RodGroup *rodGroup)
+{
+  TapRod *rods = malloc(rodGroup->nbRods * sizeof(TapRod));
+  for (int i = 0; i < rodGroup->nbRods; i++)
+  {
+    Rod rod = rodGroup->rods[i];
+    rods[i] = (TapRod){rod.numericLength, GetMillionths(rod.rect.x), GetMillionths(rod.rect.y)};
+  }
+  WriteTapRecord(writer, &(TapRecord){.kind = 's', .nbRods = rodGroup->nbRods, .rods = rods});
+  free(rods);
+}
+
+void WriteTapDate(TapWriter *writer, long date)
+{
+  WriteTapRecord(writer, &(TapRecord){.kind = 't', .date = date});
+}
+
+void WriteTapResolver(TapWriter *writer, const char *resolverName, float snapDistance)
+{
+  TapRecord record = {.kind = 'k', .snapDistance = GetMillionths(snapDistance)};
+  strncpy(record.resolverName, resolverName, MAX_RESOLVER_NAME);
+  WriteTapRecord(writer, &record);
+}
+
+// The records without arguments: free play and trains.
+void WriteTapMark(TapWriter *writer, char kind)
+{
+  WriteTapRecord(writer, &(TapRecord){.kind = kind});
+}
+
+void WriteTapSpawn(TapWriter *writer, int length)
+{
+  WriteTapRecord(writer, &(TapRecord){.kind = 'p', .length = length});
+}
+
+void WriteTapMove(TapWriter *writer, float time, float x, float y)
+{
+  WriteTapRecord(writer,
+                 &(TapRecord){.kind = 'm', .time = GetMillionths(time), .x = GetMillionths(x), .y = GetMillionths(y)});
+}
+
+void WriteTapRelease(TapWriter *writer, float time)
+{
+  WriteTapRecord(writer, &(TapRecord){.kind = 'r', .time = GetMillionths(time)});
+}
+
+void CloseTapWriter(TapWriter *writer)
+{
+  if (writer == NULL)
+  {
+    return;
+  }
+  fclose(writer->file);
+  free(writer);
+}
@@ -0,0 +1,110 @@
+#ifndef TAP_H
+#define TAP_H
+
+#include "rods.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Taps come in two formats, told apart by the first bytes of the file.
+//
+// Text taps have a line per record, the letter first:
+//   s <nbRods> <length> <x> <y> ...   the rods when the session starts
+//   t <date>                          seconds since the epoch
+//   k <resolver> <snapDistance>
+//   f                                 free play
+//   g / p <length>                    the next drag moves a train / a new rod
+//   m <time> <x> <y>                  the mouse, button down
+//   r <time>                          the button released
+//
+// Binary taps start with TAP_MAGIC, then have the same records, a byte for
+// the letter first, save that the first move of a drag is a 'd' (down). The
+// times and positions are in millionths, as many digits as the text has, and
+// a move or a release only stores the difference with the previous one. Each
+// number is a varint of its zigzagged significand, shifted left by 3 for the
+// number of trailing decimal zeros dropped: a move of whole pixels every
+// 25 ms takes 5 bytes instead of about 30. A negative zero, which %f writes
+// as -0.000000, is kept whole rather than as a difference, with 7 zeros.
+#define TAP_MAGIC "RODTAP1\n"
+#define TAP_MAGIC_LEN 8
+#define TAP_BINARY_EXTENSION ".tapb"
+#define MAX_RESOLVER_NAME 15
+
+typedef struct TapRod
+{
+  int length;
+  int64_t x;
+  int64_t y;
+} TapRod;
+
+// Stands for -0.000000 among the millionths, so that a tap converted back and
+// forth stays the same.
+#define TAP_NEGATIVE_ZERO INT64_MIN
+
+// Times, positions and distances are in millionths.
+typedef struct TapRecord
+{
+  char kind;
+  // Set on the first move after a release.
+  bool press;
+  int64_t time;
+  int64_t x;
+  int64_t y;
+  long date;
+  int length;
+  char resolverName[MAX_RESOLVER_NAME + 1];
+  int64_t snapDistance;
+  // The rods of an 's' record, owned by the reader.
+  int nbRods;
+  TapRod *rods;
+} TapRecord;
+
+typedef struct TapReader
+{
+  bool binary;
+  FILE *file;
+  char *line;
+  size_t lineCapacity;
+  // A binary tap is read whole.
+  unsigned char *data;
+  size_t size;
+  size_t position;
+  int64_t time;
+  int64_t x;
+  int64_t y;
+  bool released;
+  int rodsCapacity;
+  TapRod *rods;
+} TapReader;
+
+typedef struct TapWriter
+{
+  bool binary;
+  FILE *file;
+  int64_t time;
+  int64_t x;
+  int64_t y;
+  bool released;
+  int nbReleases;
+} TapWriter;
+
+int64_t GetMillionths(float value);
+float GetTapValue(int64_t millionths);
+bool HasBinaryTapName(const char *tapName);
+
+TapReader *OpenTapReader(const char *tapName);
+bool ReadTapRecord(TapReader *reader, TapRecord *record);
+void CloseTapReader(TapReader *reader);
+
+TapWriter *OpenTapWriter(const char *tapName, bool binary);
+void WriteTapRecord(TapWriter *writer, const TapRecord *record);
+void WriteTapRods(TapWriter *writer, const RodGroup *rodGroup);
+void WriteTapDate(TapWriter *writer, long date);
+void WriteTapResolver(TapWriter *writer, const char *resolverName, float snapDistance);
+void WriteTapMark(TapWriter *writer, char kind);
+void WriteTapSpawn(TapWriter *writer, int length);
+void WriteTapMove(TapWriter *writer, float time, float x, float y);
+void WriteTapRelease(TapWriter *writer, float time);
+void CloseTapWriter(TapWriter *writer);
+
+#endif
@@ -0,0 +1,40 @@
+#include "tap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Tap converter: copies a tap record by record, the input in either format,
+// the output in the binary one when its name ends in .tapb and in the text
+// one otherwise. Converting back gives the original text tap, byte for byte.
+//
+// Usage: haptic_rods_tapconv input output
+
+int main(int argc, char **argv)
+{
+  if (argc != 3)
+  {
+    fprintf(stderr, "Usage: %s input output\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  TapReader *reader = OpenTapReader(argv[1]);
+  if (reader == NULL)
+  {
+    return EXIT_FAILURE;
+  }
+  TapWriter *writer = OpenTapWriter(argv[2], HasBinaryTapName(argv[2]));
+  if (writer == NULL)
+  {
+    CloseTapReader(reader);
+    return EXIT_FAILURE;
+  }
+  long nbRecords = 0;
+  TapRecord record;
+  while (ReadTapRecord(reader, &record))
+  {
+    WriteTapRecord(writer, &record);
+    nbRecords += 1;
+  }
+  CloseTapReader(reader);
+  CloseTapWriter(writer);
+  fprintf(stderr, "%ld records written to %s\n", nbRecords, argv[2]);
+  return EXIT_SUCCESS;
+}
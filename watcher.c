@@ -0,0 +1,127 @@
+#include "watcher.h"
+#include "config.h"
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define EVENT_BUFFER_LEN (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+void ReloadConfig(ConfigWatcher *watcher)
+{
+  bool err = false;
+  config_t cfg = LoadConfig(&err, watcher->configName);
+  if (err)
+  {
+    fprintf(stderr, "Config %s not reloaded.\n", watcher->configName);
+    return;
+  }
+  if (!CheckConfigExprs(&cfg))
+  {
+    fprintf(stderr, "Config %s not reloaded.\n", watcher->configName);
+    config_destroy(&cfg);
+    return;
+  }
+  Signal *signals = InitSignals(cfg, watcher->nbLengths);
+  config_destroy(&cfg);
+
+  // A table that the render loop hasn't taken yet is simply replaced.
+  Signal *stale = __atomic_exchange_n(&watcher->pending, signals, __ATOMIC_ACQ_REL);
+  free(stale);
+  printf("CONFIG RELOADED : %s\n", watcher->configName);
+}
+
+void *WatchConfig(void *arg)
+{
+  ConfigWatcher *watcher = arg;
+  char buffer[EVENT_BUFFER_LEN] __attribute__((aligned(__alignof__(struct inotify_event))));
+  for (;;)
+  {
+    ssize_t len = read(watcher->inotifyFd, buffer, sizeof(buffer));
+    if (len <= 0)
+    {
+      perror("Couldn't watch the config");
+      return NULL;
+    }
+    bool changed = false;
+    for (char *ptr = buffer; ptr < buffer + len;)
+    {
+      struct inotify_event *event = (struct inotify_event *)ptr;
+      if (event->len > 0 && strcmp(event->name, watcher->baseName) == 0)
+      {
+        changed = true;
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+    if (changed)
+    {
+      // Only the blocking read may be cancelled, never libconfig or tinyexpr.
+      int oldState;
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldState);
+      ReloadConfig(watcher);
+      pthread_setcancelstate(oldState, NULL);
+    }
+  }
+}
+
+// The directory is watched rather than the file itself, because most editors
+// save by writing a new file and renaming it over the old one.
+ConfigWatcher *StartConfigWatcher(const char *config_name, int nbLengths)
+{
+  ConfigWatcher *watcher = malloc(sizeof(ConfigWatcher));
+  char *dirCopy = strdup(config_name);
+  char *baseCopy = strdup(config_name);
+  watcher->configName = strdup(config_name);
+  watcher->dirName = strdup(dirname(dirCopy));
+  watcher->baseName = strdup(basename(baseCopy));
+  watcher->nbLengths = nbLengths;
+  watcher->pending = NULL;
+  free(dirCopy);
+  free(baseCopy);
+
+  watcher->inotifyFd = inotify_init1(IN_CLOEXEC);
+  if (watcher->inotifyFd < 0 ||
+      inotify_add_watch(watcher->inotifyFd, watcher->dirName, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+      pthread_create(&watcher->thread, NULL, WatchConfig, watcher) != 0)
+  {
+    perror("Couldn't watch the config");
+    if (watcher->inotifyFd >= 0)
+    {
+      close(watcher->inotifyFd);
+    }
+    free(watcher->configName);
+    free(watcher->dirName);
+    free(watcher->baseName);
+    free(watcher);
+    return NULL;
+  }
+  return watcher;
+}
+
+Signal *TakeReloadedSignals(ConfigWatcher *watcher)
+{
+  if (watcher == NULL)
+  {
+    return NULL;
+  }
+  return __atomic_exchange_n(&watcher->pending, NULL, __ATOMIC_ACQ_REL);
+}
+
+void StopConfigWatcher(ConfigWatcher *watcher)
+{
+  if (watcher == NULL)
+  {
+    return;
+  }
+  pthread_cancel(watcher->thread);
+  pthread_join(watcher->thread, NULL);
+  close(watcher->inotifyFd);
+  free(watcher->pending);
+  free(watcher->configName);
+  free(watcher->dirName);
+  free(watcher->baseName);
+  free(watcher);
+}
@@ -0,0 +1,24 @@
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "signals.h"
+#include <pthread.h>
+
+typedef struct ConfigWatcher
+{
+  char *configName;
+  char *dirName;
+  char *baseName;
+  // The size of the catalogue, which a reload doesn't change.
+  int nbLengths;
+  int inotifyFd;
+  pthread_t thread;
+  // Published by the watcher thread, taken by the render loop.
+  Signal *pending;
+} ConfigWatcher;
+
+ConfigWatcher *StartConfigWatcher(const char *config_name, int nbLengths);
+Signal *TakeReloadedSignals(ConfigWatcher *watcher);
+void StopConfigWatcher(ConfigWatcher *watcher);
+
+#endif